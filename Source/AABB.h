@@ -0,0 +1,124 @@
+#pragma once
+
+#ifndef AABB_H
+#define AABB_H
+
+#include <utility>
+#include "Interval.h"
+#include "Ray.h"
+
+class AABB
+{
+public:
+  Interval x, y, z;
+
+  AABB() {} // The default AABB is empty, since intervals are empty by default
+
+  AABB(const Interval& x, const Interval& y, const Interval& z) : x(x), y(y), z(z) {}
+
+  AABB(const Point3& a, const Point3& b)
+  {
+    // Treat the two points a and b as extrema for the bounding box, so we don't require a
+    // particular minimum/maximum coordinate order
+    x = (a[0] <= b[0]) ? Interval(a[0], b[0]) : Interval(b[0], a[0]);
+    y = (a[1] <= b[1]) ? Interval(a[1], b[1]) : Interval(b[1], a[1]);
+    z = (a[2] <= b[2]) ? Interval(a[2], b[2]) : Interval(b[2], a[2]);
+  }
+
+  AABB(const AABB& box0, const AABB& box1)
+  {
+    x = Interval(box0.x, box1.x);
+    y = Interval(box0.y, box1.y);
+    z = Interval(box0.z, box1.z);
+  }
+
+  const Interval& AxisInterval(int n) const
+  {
+    if (n == 1) return y;
+    if (n == 2) return z;
+    return x;
+  }
+
+  bool IsEmpty() const
+  {
+    return x.min > x.max || y.min > y.max || z.min > z.max;
+  }
+
+  Point3 Centroid() const
+  {
+    return Point3(0.5 * (x.min + x.max), 0.5 * (y.min + y.max), 0.5 * (z.min + z.max));
+  }
+
+  double SurfaceArea() const
+  {
+    if (IsEmpty())
+    {
+      return 0;
+    }
+
+    auto dx = x.Size();
+    auto dy = y.Size();
+    auto dz = z.Size();
+    return 2 * (dx * dy + dy * dz + dz * dx);
+  }
+
+  int LongestAxis() const
+  {
+    // Returns the index of the longest axis of the bounding box
+    if (x.Size() > y.Size())
+    {
+      return x.Size() > z.Size() ? 0 : 2;
+    }
+
+    return y.Size() > z.Size() ? 1 : 2;
+  }
+
+  bool Hit(const Ray& r, Interval rayT) const
+  {
+    const Point3& rayOrig = r.Origin();
+    const Vec3& rayDir = r.Direction();
+
+    return Hit(rayOrig, Vec3(1.0 / rayDir[0], 1.0 / rayDir[1], 1.0 / rayDir[2]), rayT);
+  }
+
+  bool Hit(const Point3& rayOrig, const Vec3& invDir, Interval rayT) const
+  {
+    // Slab test against a precomputed inverse direction, so traversals pay for the three
+    // divisions once per ray instead of once per box. The far distance is widened by its
+    // rounding error, so rays grazing a box, such as rays through a shared mesh vertex on a
+    // box face, are never culled
+
+    const Real farScale = 1 + 2 * 3 * std::numeric_limits<Real>::epsilon();
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+      const Interval& ax = AxisInterval(axis);
+
+      auto t0 = (ax.min - rayOrig[axis]) * invDir[axis];
+      auto t1 = (ax.max - rayOrig[axis]) * invDir[axis];
+
+      if (t0 > t1)
+      {
+        std::swap(t0, t1);
+      }
+      t1 *= farScale;
+
+      if (t0 > rayT.min) rayT.min = t0;
+      if (t1 < rayT.max) rayT.max = t1;
+
+      if (rayT.max < rayT.min)
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  static const AABB empty, universe;
+};
+
+const AABB AABB::empty    = AABB(Interval::empty,    Interval::empty,    Interval::empty);
+const AABB AABB::universe = AABB(Interval::universe, Interval::universe, Interval::universe);
+
+#endif // AABB_H
\ No newline at end of file
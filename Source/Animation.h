@@ -0,0 +1,168 @@
+#pragma once
+
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "Transform.h"
+
+struct Quaternion
+{
+  // Unit quaternion, the form rotations are interpolated in, since interpolating matrices
+  // shears and shrinks whatever turns between two keys
+  double w = 1, x = 0, y = 0, z = 0;
+
+  static Quaternion FromAxisAngle(const Vec3& axis, double degrees)
+  {
+    Vec3 a = Normalized(axis);
+    double half = DegToRad(degrees) / 2;
+    double s = std::sin(half);
+
+    Quaternion q;
+    q.w = std::cos(half);
+    q.x = a.X() * s;
+    q.y = a.Y() * s;
+    q.z = a.Z() * s;
+    return q;
+  }
+
+  static Quaternion Slerp(const Quaternion& a, Quaternion b, double t)
+  {
+    // Constant-speed rotation from a to b along the shorter way round
+    double cosAngle = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+    if (cosAngle < 0)
+    {
+      b.w = -b.w; b.x = -b.x; b.y = -b.y; b.z = -b.z;
+      cosAngle = -cosAngle;
+    }
+
+    // Nearly equal rotations fall back to a normalized blend, where the sine below vanishes
+    double wa = 1 - t, wb = t;
+    if (cosAngle < 0.9995)
+    {
+      double angle = std::acos(cosAngle);
+      double s = std::sin(angle);
+      wa = std::sin((1 - t) * angle) / s;
+      wb = std::sin(t * angle) / s;
+    }
+
+    Quaternion q;
+    q.w = wa * a.w + wb * b.w;
+    q.x = wa * a.x + wb * b.x;
+    q.y = wa * a.y + wb * b.y;
+    q.z = wa * a.z + wb * b.z;
+
+    double length = std::sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    q.w /= length; q.x /= length; q.y /= length; q.z /= length;
+    return q;
+  }
+
+  Transform ToTransform() const
+  {
+    double s = std::sqrt(x * x + y * y + z * z);
+    if (s == 0)
+    {
+      return Transform();
+    }
+    return Transform::Rotate(RadToDeg(2 * std::atan2(s, w)), Vec3(Real(x / s), Real(y / s), Real(z / s)));
+  }
+};
+
+class AnimatedTransform
+{
+  // Transform that changes over time, given by keys of a translation, a rotation and a uniform
+  // scale. Translations and scales are interpolated linearly between keys and rotations along
+  // the shorter arc, so keys should be less than half a turn apart. Rotation and scale happen
+  // about the pivot, which the translation then moves
+
+public:
+  Point3 pivot = Point3(0, 0, 0);
+  bool loop = false;  // Times past the last key wrap around to the first instead of holding it
+
+  void AddKey(double time, const Vec3& translation, const Vec3& axis = Vec3(0, 1, 0), double degrees = 0, Real scale = 1)
+  {
+    Key key;
+    key.time = time;
+    key.translation = translation;
+    key.rotation = Quaternion::FromAxisAngle(axis, degrees);
+    key.scale = scale;
+
+    auto later = std::upper_bound(keys.begin(), keys.end(), time, [](double t, const Key& k) { return t < k.time; });
+    keys.insert(later, key);
+  }
+
+  bool Empty() const { return keys.empty(); }
+
+  Transform At(double time) const
+  {
+    // Identity without keys, the first or last key outside their range unless looping
+    if (keys.empty())
+    {
+      return Transform();
+    }
+
+    double first = keys.front().time;
+    double span = keys.back().time - first;
+    if (loop && span > 0)
+    {
+      time = first + (time - first) - span * std::floor((time - first) / span);
+    }
+
+    auto next = std::upper_bound(keys.begin(), keys.end(), time, [](double t, const Key& k) { return t < k.time; });
+    if (next == keys.begin())
+    {
+      return Compose(keys.front().translation, keys.front().rotation, keys.front().scale);
+    }
+    if (next == keys.end())
+    {
+      return Compose(keys.back().translation, keys.back().rotation, keys.back().scale);
+    }
+
+    const Key& a = *(next - 1);
+    const Key& b = *next;
+    double t = (time - a.time) / (b.time - a.time);
+    return Compose(Real(1 - t) * a.translation + Real(t) * b.translation,
+                   Quaternion::Slerp(a.rotation, b.rotation, t),
+                   Real((1 - t) * a.scale + t * b.scale));
+  }
+
+private:
+  struct Key
+  {
+    double     time;
+    Vec3       translation;
+    Quaternion rotation;
+    Real       scale;
+  };
+
+  std::vector<Key> keys;  // Sorted by time
+
+  Transform Compose(const Vec3& translation, const Quaternion& rotation, Real scale) const
+  {
+    return Transform::Translate(pivot + translation) * rotation.ToTransform() * Transform::Scale(scale) * Transform::Translate(-pivot);
+  }
+};
+
+inline AnimatedTransform Orbit(const Point3& center, const Vec3& axis, double degreesPerSecond)
+{
+  // Turns about an axis through center at a steady speed, forever. Keys a quarter turn apart
+  // keep every rotation on the arc it should take
+  AnimatedTransform orbit;
+  if (degreesPerSecond == 0)
+  {
+    return orbit;
+  }
+
+  orbit.pivot = center;
+  orbit.loop = true;
+  double period = 360 / std::fabs(degreesPerSecond);
+  for (int k = 0; k <= 4; k++)
+  {
+    orbit.AddKey(period * k / 4, Vec3(0, 0, 0), axis, (degreesPerSecond > 0 ? 90 : -90) * k);
+  }
+  return orbit;
+}
+
+#endif // ANIMATION_H
\ No newline at end of file
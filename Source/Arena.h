@@ -0,0 +1,155 @@
+#pragma once
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class MonotonicArena
+{
+  // Memory handed out by bumping a pointer through large blocks, and given back only all at
+  // once when the arena is destroyed. Allocations carry no header and no free list, so objects
+  // allocated one after the other sit next to each other, and building millions of them costs
+  // a pointer bump each instead of a trip through malloc
+
+public:
+  explicit MonotonicArena(size_t blockBytes = size_t(4) << 20) : blockBytes(blockBytes) {}
+  ~MonotonicArena() { Release(); }
+
+  MonotonicArena(const MonotonicArena&) = delete;
+  MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+  void* Allocate(size_t bytes, size_t alignment)
+  {
+    // Allocations larger than a block get a block of their own
+    uintptr_t aligned = (uintptr_t(cursor) + alignment - 1) & ~uintptr_t(alignment - 1);
+    if (cursor == nullptr || aligned + bytes > uintptr_t(end))
+    {
+      size_t size = std::max(blockBytes, bytes + alignment);
+      char* block = static_cast<char*>(std::malloc(size));
+      if (block == nullptr)
+      {
+        throw std::bad_alloc();
+      }
+      blocks.push_back(block);
+      reserved += size;
+      cursor = block;
+      end = block + size;
+      aligned = (uintptr_t(cursor) + alignment - 1) & ~uintptr_t(alignment - 1);
+    }
+
+    cursor = reinterpret_cast<char*>(aligned + bytes);
+    used += bytes;
+    return reinterpret_cast<void*>(aligned);
+  }
+
+  void Release()
+  {
+    // Frees every block. Objects in the arena must have been destroyed already
+    for (char* block : blocks)
+    {
+      std::free(block);
+    }
+    blocks.clear();
+    cursor = end = nullptr;
+    reserved = used = 0;
+  }
+
+  size_t BytesReserved() const { return reserved; }  // Taken from the system
+  size_t BytesUsed() const { return used; }          // Handed out
+
+private:
+  size_t blockBytes;
+  std::vector<char*> blocks;
+  char* cursor = nullptr;
+  char* end = nullptr;
+  size_t reserved = 0;
+  size_t used = 0;
+};
+
+template <typename T>
+struct Handle
+{
+  // Stable reference to an object in a pool: its index, which stays valid as the pool grows
+  int index = -1;
+
+  bool Valid() const { return index >= 0; }
+};
+
+template <typename T>
+class ArenaPool
+{
+  // Objects of one type, stored contiguously in chunks taken from an arena. Chunks are a
+  // power of two objects long, so a handle finds its object with a shift and a mask, and
+  // objects never move once made. Destroying the pool runs the destructors, the arena gives
+  // the memory back
+
+public:
+  explicit ArenaPool(MonotonicArena& arena) : arena(arena)
+  {
+    while ((size_t(2) << chunkShift) * sizeof(T) <= chunkBytes)
+    {
+      chunkShift++;
+    }
+  }
+
+  ~ArenaPool() { Clear(); }
+
+  ArenaPool(const ArenaPool&) = delete;
+  ArenaPool& operator=(const ArenaPool&) = delete;
+
+  template <typename... Args>
+  Handle<T> Add(Args&&... args)
+  {
+    size_t slot = size_t(count) & ChunkMask();
+    if (slot == 0 && size_t(count) >> chunkShift == chunks.size())
+    {
+      chunks.push_back(static_cast<T*>(arena.Allocate(sizeof(T) << chunkShift, alignof(T))));
+    }
+
+    new (chunks[size_t(count) >> chunkShift] + slot) T(std::forward<Args>(args)...);
+    Handle<T> handle;
+    handle.index = count++;
+    return handle;
+  }
+
+  T& operator[](Handle<T> handle) { return At(handle.index); }
+  const T& operator[](Handle<T> handle) const { return At(handle.index); }
+
+  T& At(int index) { return chunks[size_t(index) >> chunkShift][size_t(index) & ChunkMask()]; }
+  const T& At(int index) const { return chunks[size_t(index) >> chunkShift][size_t(index) & ChunkMask()]; }
+
+  int Size() const { return count; }
+
+  void Clear()
+  {
+    // Destroys every object. Their chunks stay in the arena and are reused by later adds
+    if (!std::is_trivially_destructible<T>::value)
+    {
+      for (int i = 0; i < count; i++)
+      {
+        At(i).~T();
+      }
+    }
+    count = 0;
+  }
+
+private:
+  static const size_t chunkBytes = size_t(64) << 10;  // Chunks are the most objects that fit, at least one
+
+  MonotonicArena& arena;
+  std::vector<T*> chunks;
+  int count = 0;
+  int chunkShift = 0;
+
+  size_t ChunkMask() const { return (size_t(1) << chunkShift) - 1; }
+};
+
+#endif // ARENA_H
\ No newline at end of file
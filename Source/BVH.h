@@ -0,0 +1,453 @@
+#pragma once
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "AABB.h"
+#include "Hittable.h"
+#include "HittableList.h"
+
+const int bvhMaxDepth = 64;  // Deepest tree the builder makes, and the traversal stack size
+
+struct BVHNode
+{
+  AABB box;
+  int offset;   // Leaf: first entry in the primitive order. Interior: index of the second child
+  int count;    // Primitive count for leaves, 0 for interior nodes
+  int axis;     // Split axis of interior nodes, used to visit the nearer child first
+
+  const AABB& Box() const { return box; }
+  int Count() const       { return count; }
+  int Axis() const        { return axis; }
+};
+
+struct CompactBVHNode
+{
+  // A BVHNode in 32 bytes instead of 64, for trees over many small primitives such as the
+  // triangles of a mesh. The box is rounded outward to float, so it still holds everything
+  // the original box did, and the count and axis share one word
+
+  float boxMin[3];
+  float boxMax[3];
+  int offset;          // As in BVHNode
+  uint32_t countAxis;  // Primitive count times 4, plus the split axis
+
+  CompactBVHNode() {}
+
+  explicit CompactBVHNode(const BVHNode& node) :
+    offset(node.offset), countAxis((uint32_t(node.count) << 2) | uint32_t(node.axis))
+  {
+    for (int axis = 0; axis < 3; axis++)
+    {
+      const Interval& extent = node.box.AxisInterval(axis);
+      boxMin[axis] = RoundDown(extent.min);
+      boxMax[axis] = -RoundDown(-extent.max);
+    }
+  }
+
+  AABB Box() const
+  {
+    return AABB(Interval(boxMin[0], boxMax[0]), Interval(boxMin[1], boxMax[1]), Interval(boxMin[2], boxMax[2]));
+  }
+
+  int Count() const { return int(countAxis >> 2); }
+  int Axis() const  { return int(countAxis & 3); }
+
+private:
+  static float RoundDown(Real value)
+  {
+    float rounded = float(value);
+    return (rounded > value) ? std::nextafter(rounded, -std::numeric_limits<float>::infinity()) : rounded;
+  }
+};
+
+template <typename Node, typename LeafHit>
+bool TraverseBVH(const std::vector<Node>& nodes, const Ray& r, Interval rayT, LeafHit leafHit)
+{
+  // Walks a flattened tree of BVHNode or CompactBVHNode front to back. leafHit(first, count,
+  // rayT) tests the primitives of a leaf and must shrink rayT.max to the closest hit found, so
+  // every box visited afterwards is culled against it
+
+  if (nodes.empty())
+  {
+    return false;
+  }
+
+  const Point3& origin = r.Origin();
+  const Vec3& dir = r.Direction();
+  Vec3 invDir(1.0 / dir[0], 1.0 / dir[1], 1.0 / dir[2]);
+  bool dirIsNeg[3] = { invDir[0] < 0, invDir[1] < 0, invDir[2] < 0 };
+
+  int stack[bvhMaxDepth];
+  int stackSize = 0;
+  int current = 0;
+  bool hitAnything = false;
+
+  while (true)
+  {
+    const Node& node = nodes[current];
+    ENGINE_STAT(RenderStats::Thread().nodeTests++);
+
+    if (node.Box().Hit(origin, invDir, rayT))
+    {
+      if (node.Count() > 0)
+      {
+        if (leafHit(node.offset, node.Count(), rayT))
+        {
+          hitAnything = true;
+        }
+      }
+      else
+      {
+        // Visit the child on the near side of the split plane first, defer the other one
+        if (dirIsNeg[node.Axis()])
+        {
+          stack[stackSize++] = current + 1;
+          current = node.offset;
+        }
+        else
+        {
+          stack[stackSize++] = node.offset;
+          current = current + 1;
+        }
+        continue;
+      }
+    }
+
+    if (stackSize == 0)
+    {
+      break;
+    }
+    current = stack[--stackSize];
+  }
+
+  return hitAnything;
+}
+
+class BVHTree
+{
+  // Flattened bounding volume hierarchy over a set of primitive bounds. Nodes are stored in
+  // depth-first order, so the first child of an interior node is always the node right after
+  // it. The tree knows nothing about the primitives themselves: leaves hand a range of the
+  // primitive order back to the caller, which makes it reusable for any primitive storage
+
+public:
+  static const int maxDepth = bvhMaxDepth;
+
+  std::vector<BVHNode> nodes;
+  std::vector<int> order;  // Primitive indices, leaf ranges index into this array
+
+  template <typename PrimitiveBounds>
+  void Build(int count, PrimitiveBounds primitiveBounds, int maxLeafSize = 4, int minLeafSize = 1)
+  {
+    // Builds over count primitives, the box of primitive i being primitiveBounds(i). Ranges of
+    // at most minLeafSize primitives always become leaves, which trades some traversal speed
+    // for fewer nodes on very large primitive sets
+    nodes.clear();
+    order.resize(size_t(count));
+
+    if (count == 0)
+    {
+      return;
+    }
+
+    // The build partitions copies of the boxes rather than indices into them, so every pass
+    // over a range reads one contiguous run of memory. They are the only copy the build
+    // makes, so callers hand boxes over one at a time instead of building an array of them
+    std::vector<BuildEntry> entries(static_cast<size_t>(count));
+    for (int i = 0; i < count; i++)
+    {
+      entries[i].box = primitiveBounds(i);
+      entries[i].index = i;
+    }
+
+    // No tree has more than 2 * count - 1 nodes. Reserving them up front means the nodes are
+    // never copied to a larger vector mid-build, and the pages of the reserve the build never
+    // reaches are never touched
+    nodes.reserve(2 * size_t(count) - 1);
+    maxLeafSize = std::max(maxLeafSize, 1);
+    BuildRecursive(entries, 0, count, 0, maxLeafSize, std::min(minLeafSize, maxLeafSize));
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+      order[i] = entries[i].index;
+    }
+  }
+
+  template <typename LeafHit>
+  bool Traverse(const Ray& r, Interval rayT, LeafHit leafHit) const
+  {
+    // See TraverseBVH
+    return TraverseBVH(nodes, r, rayT, leafHit);
+  }
+
+  static size_t BuildBytesPerPrimitive()
+  {
+    // Scratch memory Build takes per primitive, besides the nodes
+    return sizeof(BuildEntry) + sizeof(int);
+  }
+
+  template <typename LeafBounds>
+  void Refit(LeafBounds leafBounds)
+  {
+    // Recomputes every box after the primitives moved, keeping the tree's shape. leafBounds(
+    // first, count) returns the box of a leaf's primitives. Children always come after their
+    // parent, so one sweep from the back sees both children of a node before the node
+    for (int n = int(nodes.size()) - 1; n >= 0; n--)
+    {
+      BVHNode& node = nodes[n];
+      node.box = (node.count > 0) ? leafBounds(node.offset, node.count) : AABB(nodes[n + 1].box, nodes[node.offset].box);
+    }
+  }
+
+private:
+  static const int binCount = 16;
+
+  struct Bin
+  {
+    AABB box;
+    int count = 0;
+  };
+
+  struct BuildEntry
+  {
+    AABB box;
+    int index;  // Into the bounds given to Build
+
+    Real Centroid(int axis) const
+    {
+      // The box's centroid on one axis, the same value as AABB::Centroid
+      const Interval& extent = box.AxisInterval(axis);
+      return Real(0.5 * (extent.min + extent.max));
+    }
+  };
+
+  int BuildRecursive(
+      std::vector<BuildEntry>& entries,
+      int begin,
+      int end,
+      int depth,
+      int maxLeafSize,
+      int minLeafSize)
+  {
+    int nodeIndex = int(nodes.size());
+    nodes.push_back(BVHNode());
+
+    AABB box;
+    AABB centroidBox;
+    for (int i = begin; i < end; i++)
+    {
+      Point3 centroid = entries[i].box.Centroid();
+      box = AABB(box, entries[i].box);
+      centroidBox = AABB(centroidBox, AABB(centroid, centroid));
+    }
+
+    int count = end - begin;
+    nodes[nodeIndex].box = box;
+
+    // Leaves can't be split any further when every centroid sits on the same point, and deep
+    // trees are cut off so traversal never overflows its stack
+    int axis = centroidBox.LongestAxis();
+    const Interval& extent = centroidBox.AxisInterval(axis);
+    if (count <= minLeafSize || extent.Size() <= 0 || depth >= maxDepth - 1)
+    {
+      return MakeLeaf(nodeIndex, begin, count);
+    }
+
+    // Evaluate the surface area heuristic over binned split candidates on every axis. One
+    // pass over the range fills the bins of all three
+    double bestCost = infinity;
+    int bestAxis = -1;
+    int bestSplit = -1;
+
+    Bin bins[3][binCount];
+    double scales[3];
+    bool splittable[3];
+    for (int a = 0; a < 3; a++)
+    {
+      const Interval& axisExtent = centroidBox.AxisInterval(a);
+      splittable[a] = axisExtent.Size() > 0;
+      scales[a] = splittable[a] ? binCount / axisExtent.Size() : 0;
+    }
+
+    for (int i = begin; i < end; i++)
+    {
+      const BuildEntry& entry = entries[i];
+      for (int a = 0; a < 3; a++)
+      {
+        if (splittable[a])
+        {
+          Bin& bin = bins[a][BinIndex(entry.Centroid(a), centroidBox.AxisInterval(a).min, scales[a])];
+          bin.count++;
+          bin.box = AABB(bin.box, entry.box);
+        }
+      }
+    }
+
+    for (int a = 0; a < 3; a++)
+    {
+      if (!splittable[a])
+      {
+        continue;
+      }
+
+      // Sweep from the right to collect the cost of every right-hand partition, then from the
+      // left to finish each candidate
+      double rightArea[binCount];
+      int rightCount[binCount];
+      AABB rightBox;
+      int rightSum = 0;
+      for (int b = binCount - 1; b > 0; b--)
+      {
+        rightBox = AABB(rightBox, bins[a][b].box);
+        rightSum += bins[a][b].count;
+        rightArea[b] = rightBox.SurfaceArea();
+        rightCount[b] = rightSum;
+      }
+
+      AABB leftBox;
+      int leftSum = 0;
+      for (int b = 0; b < binCount - 1; b++)
+      {
+        leftBox = AABB(leftBox, bins[a][b].box);
+        leftSum += bins[a][b].count;
+
+        if (leftSum == 0 || rightCount[b + 1] == 0)
+        {
+          continue;
+        }
+
+        double cost = leftBox.SurfaceArea() * leftSum + rightArea[b + 1] * rightCount[b + 1];
+        if (cost < bestCost)
+        {
+          bestCost = cost;
+          bestAxis = a;
+          bestSplit = b;
+        }
+      }
+    }
+
+    // Costs are relative to the parent area, with traversal as expensive as one intersection
+    double parentArea = box.SurfaceArea();
+    double splitCost = (parentArea > 0) ? 1.0 + bestCost / parentArea : 1.0 + count;
+    if (bestAxis < 0 || (count <= maxLeafSize && count <= splitCost))
+    {
+      return MakeLeaf(nodeIndex, begin, count);
+    }
+
+    const Interval& splitExtent = centroidBox.AxisInterval(bestAxis);
+    double scale = binCount / splitExtent.Size();
+    auto middle = std::partition(entries.begin() + begin, entries.begin() + end, [&](const BuildEntry& entry)
+    {
+      return BinIndex(entry.Centroid(bestAxis), splitExtent.min, scale) <= bestSplit;
+    });
+    int mid = int(middle - entries.begin());
+
+    BuildRecursive(entries, begin, mid, depth + 1, maxLeafSize, minLeafSize);
+    int secondChild = BuildRecursive(entries, mid, end, depth + 1, maxLeafSize, minLeafSize);
+
+    nodes[nodeIndex].offset = secondChild;
+    nodes[nodeIndex].count = 0;
+    nodes[nodeIndex].axis = bestAxis;
+    return nodeIndex;
+  }
+
+  int MakeLeaf(int nodeIndex, int begin, int count)
+  {
+    nodes[nodeIndex].offset = begin;
+    nodes[nodeIndex].count = count;
+    nodes[nodeIndex].axis = 0;
+    return nodeIndex;
+  }
+
+  static int BinIndex(double centroid, double extentMin, double scale)
+  {
+    int b = int((centroid - extentMin) * scale);
+    return (b < 0) ? 0 : (b >= binCount ? binCount - 1 : b);
+  }
+};
+
+class BVH : public Hittable
+{
+public:
+  BVH(const HittableList& list, int maxLeafSize = 4) : BVH(list.objects, maxLeafSize) {}
+
+  BVH(const std::vector<std::shared_ptr<Hittable>>& objects, int maxLeafSize = 4) : owned(objects)
+  {
+    Build(objects, maxLeafSize);
+  }
+
+  BVH(const std::vector<const Hittable*>& objects, int maxLeafSize = 4)
+  {
+    // Objects owned elsewhere, such as by a Scene, which must outlive the BVH
+    Build(objects, maxLeafSize);
+  }
+
+  bool Hit(const Ray& r, Interval rayT, HitRecord& rec) const override
+  {
+    return tree.Traverse(r, rayT, [&](int first, int count, Interval& t)
+    {
+      bool hitAnything = false;
+
+      for (int i = first; i < first + count; i++)
+      {
+        if (primitives[i]->Hit(r, t, rec))
+        {
+          hitAnything = true;
+          t.max = rec.t;
+        }
+      }
+
+      return hitAnything;
+    });
+  }
+
+  AABB BoundingBox() const override { return bbox; }
+
+  void Refit()
+  {
+    // Updates the boxes after primitives moved, such as instances given a new transform. It
+    // costs a pass over the primitives instead of a rebuild, but the tree keeps the grouping
+    // it was built with, so traversal slows down as primitives drift far from where they were
+    tree.Refit([&](int first, int count)
+    {
+      AABB box;
+      for (int i = first; i < first + count; i++)
+      {
+        box = AABB(box, primitives[i]->BoundingBox());
+      }
+      return box;
+    });
+
+    bbox = tree.nodes.empty() ? AABB::empty : tree.nodes[0].box;
+  }
+
+private:
+  BVHTree tree;
+  std::vector<const Hittable*> primitives;       // In leaf order
+  std::vector<std::shared_ptr<Hittable>> owned;  // Kept alive when given as shared pointers
+  AABB bbox;
+
+  template <typename Objects>
+  void Build(const Objects& objects, int maxLeafSize)
+  {
+    tree.Build(int(objects.size()), [&](int i) { return objects[i]->BoundingBox(); }, maxLeafSize);
+
+    // Store the primitives in leaf order, so a leaf's primitives sit next to each other
+    primitives.reserve(objects.size());
+    for (int index : tree.order)
+    {
+      primitives.push_back(&*objects[index]);
+    }
+
+    bbox = tree.nodes.empty() ? AABB::empty : tree.nodes[0].box;
+  }
+};
+
+#endif // BVH_H
\ No newline at end of file
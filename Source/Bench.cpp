@@ -0,0 +1,737 @@
+#include "Engine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BVH.h"
+#include "Camera.h"
+#include "Denoiser.h"
+#include "Hittable.h"
+#include "HittableList.h"
+#include "Instance.h"
+#include "Lights.h"
+#include "Material.h"
+#include "Sampler.h"
+#include "Scene.h"
+#include "Scenes.h"
+#include "Simd.h"
+#include "Sphere.h"
+#include "SphereSoA.h"
+#include "TriangleMesh.h"
+
+// Benchmark suite: microbenchmarks of the hot functions, then end-to-end renders of fixed-seed
+// scenes. Results are written as JSON so runs can be compared across versions
+
+struct MicroResult
+{
+  std::string name;
+  long long operations;  // Operations in the fastest run
+  double seconds;        // Wall time of the fastest run
+};
+
+struct RenderResult
+{
+  std::string name;
+  int width;
+  int height;
+  int samplesPerPixel;
+  long long samples;
+  long long rays;
+  double seconds;
+};
+
+// Written by every microbenchmark so the compiler cannot drop the measured work
+static volatile double sink;
+
+static double Seconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename Operation>
+static MicroResult RunMicro(const std::string& name, double minSeconds, Operation operation)
+{
+  // operation(n) performs n operations. The count doubles until a run lasts minSeconds, then
+  // the fastest of three runs at that count is kept
+
+  std::clog << "Running " << name << '\n';
+
+  long long n = 1;
+  double elapsed = 0;
+  while (true)
+  {
+    auto start = std::chrono::steady_clock::now();
+    operation(n);
+    elapsed = Seconds(start);
+
+    if (elapsed >= minSeconds)
+    {
+      break;
+    }
+    n *= 2;
+  }
+
+  for (int run = 0; run < 2; run++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    operation(n);
+    elapsed = std::fmin(elapsed, Seconds(start));
+  }
+
+  MicroResult result;
+  result.name = name;
+  result.operations = n;
+  result.seconds = elapsed;
+  return result;
+}
+
+// Ray counting for the end-to-end renders. Every thread counts into its own slot, and the
+// slots are only summed once the render is over
+
+struct RayCount
+{
+  long long rays = 0;
+  char padding[56];  // Keep slots of different threads off the same cache line
+};
+
+static std::mutex rayCountMutex;
+static std::vector<RayCount*> rayCounts;
+
+static RayCount& ThreadRayCount()
+{
+  thread_local RayCount* count = nullptr;
+  if (!count)
+  {
+    count = new RayCount();
+    std::lock_guard<std::mutex> lock(rayCountMutex);
+    rayCounts.push_back(count);
+  }
+  return *count;
+}
+
+static long long TakeRayCount()
+{
+  // Returns the rays counted since the last call
+  std::lock_guard<std::mutex> lock(rayCountMutex);
+  long long total = 0;
+  for (RayCount* count : rayCounts)
+  {
+    total += count->rays;
+    count->rays = 0;
+  }
+  return total;
+}
+
+class CountingHittable : public Hittable
+{
+  // Forwards to the scene and counts every ray traced through it
+
+public:
+  explicit CountingHittable(const Hittable& world) : world(world) {}
+
+  bool Hit(const Ray& r, Interval rayT, HitRecord& rec) const override
+  {
+    ThreadRayCount().rays++;
+    return world.Hit(r, rayT, rec);
+  }
+
+  AABB BoundingBox() const override { return world.BoundingBox(); }
+
+private:
+  const Hittable& world;
+};
+
+static Vec3 RejectionNormalizedVector(Rng& rng)
+{
+  // The rejection loop RandomNormalizedVector used before its closed form, kept to compare
+  // against. About half of the points of the cube fall outside the sphere and are drawn again
+  while (true)
+  {
+    auto p = Vec3::Random(-1, 1, rng);
+    auto lenSq = p.LengthSquared();
+
+    if (std::numeric_limits<Real>::min() < lenSq && lenSq <= 1)
+    {
+      return p / std::sqrt(lenSq);
+    }
+  }
+}
+
+static std::vector<Ray> RandomRays(int count, double originDistance, double targetExtent, Rng& rng)
+{
+  // Rays starting on a sphere of radius originDistance around the origin and aimed at random
+  // points inside a cube of half size targetExtent, so a part of them misses
+  std::vector<Ray> rays;
+  for (int i = 0; i < count; i++)
+  {
+    Point3 origin = Real(originDistance) * RandomNormalizedVector(rng);
+    Point3 target = Vec3::Random(-targetExtent, targetExtent, rng);
+    rays.push_back(Ray(origin, target - origin));
+  }
+  return rays;
+}
+
+static void TessellateSphere(TriangleMesh& mesh, int rings)
+{
+  // Unit sphere at the origin as a latitude-longitude grid of 4 * rings^2 triangles
+  int segments = 2 * rings;
+  for (int i = 0; i <= rings; i++)
+  {
+    double theta = pi * i / rings;
+    for (int j = 0; j < segments; j++)
+    {
+      double phi = 2 * pi * j / segments;
+      mesh.AddVertex(TriangleMesh::Vertex(float(std::sin(theta) * std::cos(phi)), float(std::cos(theta)), float(std::sin(theta) * std::sin(phi))));
+    }
+  }
+
+  for (int i = 0; i < rings; i++)
+  {
+    for (int j = 0; j < segments; j++)
+    {
+      uint32_t a = uint32_t(i * segments + j);
+      uint32_t b = uint32_t((i + 1) * segments + j);
+      uint32_t c = uint32_t((i + 1) * segments + (j + 1) % segments);
+      uint32_t d = uint32_t(i * segments + (j + 1) % segments);
+      mesh.AddTriangle(a, b, c);
+      mesh.AddTriangle(a, c, d);
+    }
+  }
+
+  mesh.Build();
+}
+
+static std::vector<MicroResult> RunMicrobenchmarks(double minSeconds)
+{
+  std::vector<MicroResult> results;
+  Rng rng(2024);
+
+  const int rayCount = 4096;  // Power of two, indexed with a mask
+  std::vector<Ray> rays = RandomRays(rayCount, 4, 1.5, rng);
+
+  Sphere sphere(Point3(0, 0, 0), 1, 0);
+  results.push_back(RunMicro("Sphere::Hit", minSeconds, [&](long long n)
+  {
+    HitRecord rec;
+    int hits = 0;
+    for (long long k = 0; k < n; k++)
+    {
+      hits += sphere.Hit(rays[k & (rayCount - 1)], Interval(0, infinity), rec) ? 1 : 0;
+    }
+    sink = hits;
+  }));
+
+  TriangleMesh mesh;
+  TessellateSphere(mesh, 64);
+  results.push_back(RunMicro("TriangleMesh::Hit/" + std::to_string(mesh.TriangleCount()), minSeconds, [&](long long n)
+  {
+    HitRecord rec;
+    int hits = 0;
+    for (long long k = 0; k < n; k++)
+    {
+      hits += mesh.Hit(rays[k & (rayCount - 1)], Interval(0, infinity), rec) ? 1 : 0;
+    }
+    sink = hits;
+  }));
+
+  std::vector<Ray> sceneRays = RandomRays(rayCount, 8, 4, rng);
+  const int listSizes[] = { 1, 16, 256, 4096 };
+  for (int size : listSizes)
+  {
+    HittableList list;
+    for (int i = 0; i < size; i++)
+    {
+      list.Add(std::make_shared<Sphere>(Vec3::Random(-4, 4, rng), Real(RandomDouble(0.05, 0.3, rng)), 0));
+    }
+
+    results.push_back(RunMicro("HittableList::Hit/" + std::to_string(size), minSeconds, [&](long long n)
+    {
+      HitRecord rec;
+      int hits = 0;
+      for (long long k = 0; k < n; k++)
+      {
+        hits += list.Hit(sceneRays[k & (rayCount - 1)], Interval(0, infinity), rec) ? 1 : 0;
+      }
+      sink = hits;
+    }));
+  }
+
+  // Per-frame cost of moving instances in an animation: refitting their BVH against building
+  // a new one. One operation is the whole tree
+  {
+    auto unitSphere = std::make_shared<Sphere>(Point3(0, 0, 0), 1, 0);
+    HittableList moving;
+    for (int i = 0; i < 4096; i++)
+    {
+      Transform objectToWorld = Transform::Translate(Vec3::Random(-8, 8, rng)) * Transform::Scale(Real(RandomDouble(0.05, 0.3, rng)));
+      moving.Add(std::make_shared<Instance>(*unitSphere, objectToWorld, 0));
+    }
+    BVH tree(moving);
+
+    results.push_back(RunMicro("BVH::Build/4096 instances", minSeconds, [&](long long n)
+    {
+      double sum = 0;
+      for (long long k = 0; k < n; k++)
+      {
+        BVH rebuilt(moving);
+        sum += rebuilt.BoundingBox().x.max;
+      }
+      sink = sum;
+    }));
+
+    results.push_back(RunMicro("BVH::Refit/4096 instances", minSeconds, [&](long long n)
+    {
+      double sum = 0;
+      for (long long k = 0; k < n; k++)
+      {
+        tree.Refit();
+        sum += tree.BoundingBox().x.max;
+      }
+      sink = sum;
+    }));
+  }
+
+  // Setting up a scene of many placed meshes: one shared_ptr per instance in a list and a BVH
+  // over the list, against the same instances in a Scene's arena. One operation is the whole
+  // scene, from its first instance to its built BVH
+  {
+    const int instanceCount = 65536;
+    std::vector<Transform> placements;
+    for (int i = 0; i < instanceCount; i++)
+    {
+      placements.push_back(Transform::Translate(Vec3::Random(-64, 64, rng)) * Transform::Scale(Real(RandomDouble(0.05, 0.3, rng))));
+    }
+
+    auto sharedMesh = std::make_shared<TriangleMesh>(0);
+    TessellateSphere(*sharedMesh, 8);
+
+    results.push_back(RunMicro("HittableList+BVH/" + std::to_string(instanceCount) + " instances", minSeconds, [&](long long n)
+    {
+      double sum = 0;
+      for (long long k = 0; k < n; k++)
+      {
+        HittableList list;
+        for (const Transform& objectToWorld : placements)
+        {
+          list.Add(std::make_shared<Instance>(*sharedMesh, objectToWorld));
+        }
+        BVH tree(list);
+        sum += tree.BoundingBox().x.max;
+      }
+      sink = sum;
+    }));
+
+    results.push_back(RunMicro("Scene::Build/" + std::to_string(instanceCount) + " instances", minSeconds, [&](long long n)
+    {
+      double sum = 0;
+      for (long long k = 0; k < n; k++)
+      {
+        Scene scene;
+        MeshHandle mesh = scene.AddMesh(0);
+        TessellateSphere(scene[mesh], 8);
+        for (const Transform& objectToWorld : placements)
+        {
+          scene.AddInstance(mesh, objectToWorld);
+        }
+        scene.Build();
+        sum += scene.BoundingBox().x.max;
+      }
+      sink = sum;
+    }));
+  }
+
+  // Hit records of real hits on the unit sphere, for the scatter benchmarks
+  std::vector<Ray> hitRays;
+  std::vector<HitRecord> hitRecords;
+  for (const Ray& r : rays)
+  {
+    HitRecord rec;
+    if (sphere.Hit(r, Interval(0, infinity), rec))
+    {
+      sphere.CompleteHit(r, rec);
+      hitRays.push_back(r);
+      hitRecords.push_back(rec);
+    }
+  }
+
+  struct NamedMaterial
+  {
+    const char* name;
+    Material material;
+  };
+  const NamedMaterial materials[] =
+  {
+    { "Material::Scatter/Lambertian", Lambertian(Color(0.5, 0.5, 0.5)) },
+    { "Material::Scatter/Metal",      Metal(Color(0.7, 0.6, 0.5), 0.3) },
+    { "Material::Scatter/Dielectric", Dielectric(1.5) }
+  };
+  for (const NamedMaterial& named : materials)
+  {
+    results.push_back(RunMicro(named.name, minSeconds, [&](long long n)
+    {
+      Color attenuation;
+      Ray scattered;
+      Sampler sampler;
+      double sum = 0;
+      for (long long k = 0; k < n; k++)
+      {
+        size_t index = size_t(k % (long long)hitRecords.size());
+        if (named.material.Scatter(hitRays[index], hitRecords[index], attenuation, scattered, sampler))
+        {
+          sum += scattered.Direction().X();
+        }
+      }
+      sink = sum;
+    }));
+  }
+
+  // One camera sample's worth of numbers: the pixel and lens pairs, then three bounces
+  struct NamedSampler
+  {
+    const char* name;
+    SamplerType type;
+  };
+  const NamedSampler samplers[] =
+  {
+    { "Sampler/Independent", SamplerType::Independent },
+    { "Sampler/Stratified",  SamplerType::Stratified },
+    { "Sampler/Sobol",       SamplerType::Sobol },
+    { "Sampler/BlueNoise",   SamplerType::BlueNoise }
+  };
+  BlueNoise::Value(0, 0); // Makes the mask outside the timed loop
+  for (const NamedSampler& named : samplers)
+  {
+    results.push_back(RunMicro(named.name, minSeconds, [&](long long n)
+    {
+      double sum = 0;
+      for (long long k = 0; k < n; k++)
+      {
+        Sampler sampler(named.type, int(k & 255), int((k >> 8) & 255), uint64_t(k & 0xffff), int(k >> 16), 64, 0);
+        double u, v;
+        sampler.Get2D(u, v);
+        sum += u + v;
+        sampler.Get2D(u, v);
+        sum += u + v;
+        for (int bounce = 0; bounce < 3; bounce++)
+        {
+          sampler.StartBounce(bounce);
+          sampler.Get2D(u, v);
+          sum += u + v + sampler.Get1D();
+        }
+      }
+      sink = sum;
+    }));
+  }
+
+  // Direction sampling, one operation per direction: the rejection loop the closed forms
+  // replaced, then each closed form one call at a time and a batch at a time from the same pairs
+  results.push_back(RunMicro("RandomNormalizedVector/rejection", minSeconds, [&](long long n)
+  {
+    double sum = 0;
+    for (long long k = 0; k < n; k++)
+    {
+      sum += RejectionNormalizedVector(rng).X();
+    }
+    sink = sum;
+  }));
+
+  results.push_back(RunMicro("RandomNormalizedVector", minSeconds, [&](long long n)
+  {
+    double sum = 0;
+    for (long long k = 0; k < n; k++)
+    {
+      sum += RandomNormalizedVector(rng).X();
+    }
+    sink = sum;
+  }));
+
+  const int batchSize = 1024;
+  DirectionBatch directions;
+  directions.Resize(batchSize);
+  for (int i = 0; i < batchSize; i++)
+  {
+    directions.u[i] = RandomDouble(rng);
+    directions.v[i] = RandomDouble(rng);
+    directions.SetNormal(i, hitRecords[size_t(i) % hitRecords.size()].normal);
+  }
+
+  results.push_back(RunMicro("SampleUniformSphere", minSeconds, [&](long long n)
+  {
+    double sum = 0;
+    for (long long k = 0; k < n; k++)
+    {
+      int i = int(k & (batchSize - 1));
+      sum += SampleUniformSphere(directions.u[i], directions.v[i]).X();
+    }
+    sink = sum;
+  }));
+
+  results.push_back(RunMicro("DirectionBatch::UniformSphere", minSeconds, [&](long long n)
+  {
+    double sum = 0;
+    for (long long k = 0; k < n; k += batchSize)
+    {
+      directions.UniformSphere(int(std::min<long long>(batchSize, n - k)));
+      sum += directions.x[0];
+    }
+    sink = sum;
+  }));
+
+  results.push_back(RunMicro("SampleCosineHemisphere", minSeconds, [&](long long n)
+  {
+    double sum = 0;
+    for (long long k = 0; k < n; k++)
+    {
+      int i = int(k & (batchSize - 1));
+      Vec3 normal(Real(directions.normalX[i]), Real(directions.normalY[i]), Real(directions.normalZ[i]));
+      sum += SampleCosineHemisphere(normal, directions.u[i], directions.v[i]).X();
+    }
+    sink = sum;
+  }));
+
+  results.push_back(RunMicro("DirectionBatch::CosineHemisphere", minSeconds, [&](long long n)
+  {
+    double sum = 0;
+    for (long long k = 0; k < n; k += batchSize)
+    {
+      directions.CosineHemisphere(int(std::min<long long>(batchSize, n - k)));
+      sum += directions.x[0];
+    }
+    sink = sum;
+  }));
+
+  // One operation filters a whole noisy image, guided by features made of flat blocks, the
+  // shape of a scene of large objects
+  const int denoiseWidth = 256, denoiseHeight = 144;
+  Framebuffer noisy(denoiseWidth, denoiseHeight);
+  FeatureBuffers features;
+  features.albedo.Resize(denoiseWidth, denoiseHeight);
+  features.normal.Resize(denoiseWidth, denoiseHeight);
+  features.depth.Resize(denoiseWidth, denoiseHeight);
+  features.variance.Resize(denoiseWidth, denoiseHeight);
+  for (int j = 0; j < denoiseHeight; j++)
+  {
+    for (int i = 0; i < denoiseWidth; i++)
+    {
+      int block = (j / 16) * (denoiseWidth / 16) + i / 16;
+      Color albedo = Color(0.2, 0.4, 0.6) + Real(0.05 * (block % 8)) * Color(1, 1, 1);
+      noisy.Set(i, j, albedo * Real(RandomDouble(0, 2, rng)));
+      features.albedo.Set(i, j, albedo);
+      features.normal.Set(i, j, Normalized(Vec3(Real(block % 3), 1, Real(block % 5))));
+      features.depth.Set(i, j, Color(1, 1, 1) * Real(2 + block % 7));
+      features.variance.Set(i, j, Color(0.02, 0.02, 0.02));
+    }
+  }
+  Denoiser denoiser;
+  denoiser.threadCount = 1;
+  Framebuffer denoised;
+  results.push_back(RunMicro("Denoiser::Denoise/" + std::to_string(denoiseWidth) + "x" + std::to_string(denoiseHeight), minSeconds, [&](long long n)
+  {
+    for (long long k = 0; k < n; k++)
+    {
+      denoiser.Denoise(noisy, features, denoised);
+    }
+    sink = denoised.Data()[0];
+  }));
+
+  std::vector<Color> colors(rayCount);
+  for (Color& c : colors)
+  {
+    c = Color::Random(rng);
+  }
+  results.push_back(RunMicro("WriteColor", minSeconds, [&](long long n)
+  {
+    std::ostringstream out;
+    for (long long k = 0; k < n; k++)
+    {
+      if ((k & (rayCount - 1)) == 0)
+      {
+        out.str("");
+      }
+      WriteColor(out, colors[k & (rayCount - 1)]);
+    }
+    sink = double(out.tellp());
+  }));
+
+  return results;
+}
+
+static RenderResult RunRender(
+    const std::string& name,
+    const Hittable& world,
+    const MaterialTable& materials,
+    const LightList& lights,
+    Camera& cam)
+{
+  std::clog << "Rendering " << name << '\n';
+
+  CountingHittable countingWorld(world);
+  Framebuffer image;
+
+  TakeRayCount();
+  auto start = std::chrono::steady_clock::now();
+  cam.Render(countingWorld, materials, lights, image);
+  double seconds = Seconds(start);
+  long long rays = TakeRayCount();
+
+  RenderResult result;
+  result.name = name;
+  result.width = image.Width();
+  result.height = image.Height();
+  result.samplesPerPixel = cam.samplesPerPixel;
+  result.samples = (long long)image.Width() * image.Height() * cam.samplesPerPixel;
+  result.rays = rays;
+  result.seconds = seconds;
+  return result;
+}
+
+static std::vector<RenderResult> RunRenders(bool quick)
+{
+  std::vector<RenderResult> results;
+
+  // Every scene is built from the same seed, so each run renders the same image
+  SphereSoA soaWorld;
+  MaterialTable materials;
+  Rng rng;
+  HittableList objects;
+  HittableList instances;
+  auto unitSphere = std::make_shared<Sphere>(Point3(0, 0, 0), 1, 0);
+  RandomSpheresScene(materials, rng, [&](const Point3& center, Real radius, MaterialId material)
+  {
+    soaWorld.Add(center, radius, material);
+    objects.Add(std::make_shared<Sphere>(center, radius, material));
+
+    // Every sphere as a placed copy of one unit sphere, for the cost of going through instances
+    Transform objectToWorld = Transform::Translate(center) * Transform::Scale(radius);
+    instances.Add(std::make_shared<Instance>(*unitSphere, objectToWorld, material));
+  });
+  soaWorld.Build();
+  BVH bvhWorld(objects);
+  BVH instancedWorld(instances);
+  LightList noLights;
+
+  Camera cam;
+  RandomSpheresCamera(cam);
+  cam.imageWidth = quick ? 160 : 360;
+  cam.samplesPerPixel = quick ? 4 : 16;
+  cam.progress = nullptr;  // Renders are timed, keep them quiet
+
+  results.push_back(RunRender("random-spheres/soa", soaWorld, materials, noLights, cam));
+  results.push_back(RunRender("random-spheres/bvh", bvhWorld, materials, noLights, cam));
+  results.push_back(RunRender("random-spheres/instanced", instancedWorld, materials, noLights, cam));
+
+  cam.integrator = Integrator::Wavefront;
+  results.push_back(RunRender("random-spheres/soa-wavefront", soaWorld, materials, noLights, cam));
+
+  // The same scene at night, lit only by small lamps: paths that only scatter against ones
+  // that also aim shadow rays at the lamps
+  SphereSoA lampWorld;
+  MaterialTable lampMaterials;
+  Rng lampRng;
+  auto addLampSphere = [&](const Point3& center, Real radius, MaterialId material)
+  {
+    lampWorld.Add(center, radius, material);
+  };
+  RandomSpheresScene(lampMaterials, lampRng, addLampSphere);
+  RandomLamps(8, lampMaterials, lampRng, addLampSphere);
+  lampWorld.Build();
+  LightList lamps;
+  lamps.AddEmissiveSpheres(lampWorld, lampMaterials);
+
+  cam.integrator = Integrator::Path;
+  cam.skyBrightness = 0;
+  cam.sampleLights = false;
+  results.push_back(RunRender("random-lamps/scatter-only", lampWorld, lampMaterials, lamps, cam));
+  cam.sampleLights = true;
+  results.push_back(RunRender("random-lamps/light-sampling", lampWorld, lampMaterials, lamps, cam));
+
+  return results;
+}
+
+static void WriteJson(std::ostream& out, bool quick, const std::vector<MicroResult>& micro, const std::vector<RenderResult>& renders)
+{
+  out.precision(6);
+
+  out << "{\n";
+  out << "  \"precision\": \"" << (sizeof(Real) == sizeof(float) ? "float" : "double") << "\",\n";
+  out << "  \"simd\": \"" << SimdLevelName(ActiveSimdLevel()) << "\",\n";
+  out << "  \"threads\": " << std::max(1u, std::thread::hardware_concurrency()) << ",\n";
+  out << "  \"quick\": " << (quick ? "true" : "false") << ",\n";
+
+  out << "  \"micro\": [\n";
+  for (size_t k = 0; k < micro.size(); k++)
+  {
+    const MicroResult& m = micro[k];
+    out << "    { \"name\": \"" << m.name << "\""
+        << ", \"operations\": " << m.operations
+        << ", \"seconds\": " << m.seconds
+        << ", \"nsPerOp\": " << m.seconds * 1e9 / m.operations
+        << ", \"mopsPerSecond\": " << m.operations / m.seconds * 1e-6
+        << " }" << (k + 1 < micro.size() ? "," : "") << '\n';
+  }
+  out << "  ],\n";
+
+  out << "  \"render\": [\n";
+  for (size_t k = 0; k < renders.size(); k++)
+  {
+    const RenderResult& r = renders[k];
+    out << "    { \"name\": \"" << r.name << "\""
+        << ", \"width\": " << r.width
+        << ", \"height\": " << r.height
+        << ", \"samplesPerPixel\": " << r.samplesPerPixel
+        << ", \"samples\": " << r.samples
+        << ", \"rays\": " << r.rays
+        << ", \"seconds\": " << r.seconds
+        << ", \"samplesPerSecond\": " << r.samples / r.seconds
+        << ", \"mraysPerSecond\": " << r.rays / r.seconds * 1e-6
+        << " }" << (k + 1 < renders.size() ? "," : "") << '\n';
+  }
+  out << "  ]\n";
+
+  out << "}\n";
+}
+
+int main(int argc, char* argv[])
+{
+  // Usage: Bench [output path] [--quick]
+  // Without an output path the JSON report is written to stdout. --quick shortens every
+  // benchmark, for smoke tests
+  std::string outputPath;
+  bool quick = false;
+
+  for (int arg = 1; arg < argc; arg++)
+  {
+    std::string option = argv[arg];
+    if (option == "--quick")
+    {
+      quick = true;
+    }
+    else
+    {
+      outputPath = option;
+    }
+  }
+
+  std::vector<MicroResult> micro = RunMicrobenchmarks(quick ? 0.02 : 0.25);
+  std::vector<RenderResult> renders = RunRenders(quick);
+
+  if (outputPath.empty())
+  {
+    WriteJson(std::cout, quick, micro, renders);
+    return 0;
+  }
+
+  std::ofstream out(outputPath);
+  WriteJson(out, quick, micro, renders);
+  if (!out)
+  {
+    std::cerr << "Could not write " << outputPath << '\n';
+    return 1;
+  }
+}
\ No newline at end of file
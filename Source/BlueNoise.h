@@ -0,0 +1,167 @@
+#pragma once
+
+#ifndef BLUE_NOISE_H
+#define BLUE_NOISE_H
+
+#include <cstdint>
+#include <vector>
+#include "Engine.h"
+
+class BlueNoise
+{
+  // Tileable blue noise mask made with Ulichney's void-and-cluster method. Every texel holds
+  // a distinct rank, and the texels below any threshold are spread as evenly as possible, so
+  // neighboring pixels that offset their samples by the mask get errors that cancel out to
+  // the eye. The mask is made on first use, which takes a few milliseconds
+
+public:
+  static const int size = 64;
+
+  static uint32_t Value(int x, int y)
+  {
+    // Rank of the texel at x, y, wrapping around, scaled to the full 32-bit range
+    static const std::vector<uint32_t> mask = Generate();
+    return mask[size_t(y & (size - 1)) * size + (x & (size - 1))];
+  }
+
+private:
+  static const int texelCount = size * size;
+  static const int radius = 6;  // Energy is only spread this far, where the Gaussian is negligible
+
+  static std::vector<uint32_t> Generate()
+  {
+    std::vector<char> initial(texelCount, 0);
+    std::vector<float> initialEnergy(texelCount, 0);
+    std::vector<uint32_t> ranks(texelCount, 0);
+
+    // Start from a random tenth of the texels, then move the point in the tightest cluster to
+    // the largest void until that no longer changes anything. It settles in far fewer moves
+    // than the cap
+    Rng rng(0x5eed);
+    int pointCount = texelCount / 10;
+    for (int placed = 0; placed < pointCount; )
+    {
+      int texel = int(rng.NextUInt() % texelCount);
+      if (!initial[texel])
+      {
+        initial[texel] = 1;
+        Splat(initialEnergy, texel, 1);
+        placed++;
+      }
+    }
+
+    for (int move = 0; move < texelCount; move++)
+    {
+      int cluster = Extreme(initial, initialEnergy, 1, true);
+      initial[cluster] = 0;
+      Splat(initialEnergy, cluster, -1);
+
+      int gap = Extreme(initial, initialEnergy, 0, false);
+      initial[gap] = 1;
+      Splat(initialEnergy, gap, 1);
+
+      if (gap == cluster)
+      {
+        break;
+      }
+    }
+
+    // Ranks below the initial points: take the tightest cluster away one at a time
+    std::vector<char> pattern(initial);
+    std::vector<float> energy(initialEnergy);
+    for (int rank = pointCount - 1; rank >= 0; rank--)
+    {
+      int cluster = Extreme(pattern, energy, 1, true);
+      pattern[cluster] = 0;
+      Splat(energy, cluster, -1);
+      ranks[cluster] = uint32_t(rank);
+    }
+
+    // Ranks up to half: fill the largest void one at a time
+    pattern = initial;
+    energy = initialEnergy;
+    int rank = pointCount;
+    for (; rank < texelCount / 2; rank++)
+    {
+      int gap = Extreme(pattern, energy, 0, false);
+      pattern[gap] = 1;
+      Splat(energy, gap, 1);
+      ranks[gap] = uint32_t(rank);
+    }
+
+    // Ranks past half: the empty texels are now the minority, so fill their tightest cluster
+    std::vector<float> emptyEnergy(texelCount, 0);
+    for (int texel = 0; texel < texelCount; texel++)
+    {
+      if (!pattern[texel])
+      {
+        Splat(emptyEnergy, texel, 1);
+      }
+    }
+
+    for (; rank < texelCount; rank++)
+    {
+      int cluster = Extreme(pattern, emptyEnergy, 0, true);
+      pattern[cluster] = 1;
+      Splat(emptyEnergy, cluster, -1);
+      ranks[cluster] = uint32_t(rank);
+    }
+
+    // Scale the ranks to 32 bits, at the middle of their interval
+    const int shift = 32 - 12;
+    static_assert(texelCount == 1 << 12, "the rank scale assumes a 64x64 mask");
+    for (uint32_t& r : ranks)
+    {
+      r = (r << shift) | (1u << (shift - 1));
+    }
+    return ranks;
+  }
+
+  static void Splat(std::vector<float>& energy, int texel, float sign)
+  {
+    // Adds the Gaussian footprint of a point at texel to every texel around it
+    static const std::vector<float> kernel = Kernel();
+
+    int x = texel % size;
+    int y = texel / size;
+    for (int dy = -radius; dy <= radius; dy++)
+    {
+      for (int dx = -radius; dx <= radius; dx++)
+      {
+        int target = ((y + dy) & (size - 1)) * size + ((x + dx) & (size - 1));
+        energy[target] += sign * kernel[(dy + radius) * (2 * radius + 1) + (dx + radius)];
+      }
+    }
+  }
+
+  static std::vector<float> Kernel()
+  {
+    const double sigma = 1.5;
+    std::vector<float> kernel((2 * radius + 1) * (2 * radius + 1));
+    for (int dy = -radius; dy <= radius; dy++)
+    {
+      for (int dx = -radius; dx <= radius; dx++)
+      {
+        kernel[(dy + radius) * (2 * radius + 1) + (dx + radius)] = float(std::exp(-(dx * dx + dy * dy) / (2 * sigma * sigma)));
+      }
+    }
+    return kernel;
+  }
+
+  static int Extreme(const std::vector<char>& pattern, const std::vector<float>& energy, char value, bool highest)
+  {
+    // Texel holding value with the highest energy (the tightest cluster) or the lowest (the
+    // largest void)
+    int best = -1;
+    for (int texel = 0; texel < texelCount; texel++)
+    {
+      if (pattern[texel] == value && (best < 0 || (highest ? energy[texel] > energy[best] : energy[texel] < energy[best])))
+      {
+        best = texel;
+      }
+    }
+    return best;
+  }
+};
+
+#endif // BLUE_NOISE_H
\ No newline at end of file
@@ -3,16 +3,69 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include "Checkpoint.h"
+#include "Features.h"
+#include "Framebuffer.h"
 #include "Hittable.h"
+#include "Lights.h"
 #include "Material.h"
+#include "RenderStats.h"
+#include "Sampler.h"
+#include "ThreadPool.h"
+#include "Wavefront.h"
+
+enum class Integrator
+{
+  Path,      // Follows one sample through all of its bounces before starting the next
+  Wavefront  // Moves a whole tile of samples through each bounce together, see Wavefront.h
+};
+
+struct RenderProgress
+{
+  int pass;            // Render pass, adaptive renders run more than one
+  int tilesDone;       // Tiles of this pass finished so far
+  int tileCount;       // Tiles in every pass
+  std::string status;  // A status line of the render instead of a tile count, when not empty
+};
+
+template <bool ThinLensT, bool RouletteT, int MaterialTypeT>
+struct PathKernel
+{
+  // Settings that hold for a whole render, fixed at compile time so the path integrator's
+  // inner loop tests none of them. Camera::SelectPathKernel picks the instantiation matching
+  // the render once, then every tile runs it
+
+  static constexpr bool thinLens = ThinLensT;          // Camera rays start on the defocus disk
+  static constexpr bool roulette = RouletteT;          // Paths get deep enough for Russian roulette
+  static constexpr int  materialType = MaterialTypeT;  // The only MaterialType there is, or -1
+
+  static constexpr bool MayHit(MaterialType type)
+  {
+    return materialType < 0 || int(type) == materialType;
+  }
+};
 
 class Camera
 {
 public:
   double aspectRatio     = 1.0;  // Ratio of image width over height
   int    imageWidth      = 100;  // Rendered image width in pixel count
-  int    samplesPerPixel = 10;   // Count of random samples for each pixel
+  int    samplesPerPixel = 10;   // Count of random samples for each pixel, the maximum when adaptive
   int    maxDepth        = 10;   // Maximum number of ray bounces into scene
+  int    rouletteDepth   = 3;    // Bounces before Russian roulette may end a path, maxDepth or more disables it
+
+  SamplerType samplerType = SamplerType::Sobol;  // Source of the pixel, lens and bounce numbers, see Sampler.h
 
   double vFov            = 90;              // Vertical view angle (field of view)
   Point3 lookFrom        = Point3(0,0,0);   // Point camera is looking from
@@ -22,30 +75,329 @@ public:
   double defocusAngle = 0;  // Variation angle of rays through each pixel
   double focusDist    = 10; // Distance from camera lookFrom point to plane of perfect focus
 
-  void Render(const Hittable& world)
+  int threadCount = 0;   // Render worker threads, 0 uses all hardware threads
+  int tileSize    = 16;  // Width and height in pixels of the square tiles handed to workers
+  int frame       = 0;   // Frame number, mixed into the seed of every sample
+
+  Integrator integrator = Integrator::Path;  // Path tracing loop used for every sample
+  bool sortWavefrontRays = false;            // Sort each wave by ray direction and origin
+  int  waveSize          = 65536;            // Most paths the wavefront integrator traces at once
+
+  bool   sampleLights  = true;  // Aim a shadow ray at a light from every diffuse hit (next-event estimation)
+  double skyBrightness = 1;     // Scale of the sky gradient, 0 leaves the scene's lights as the only light
+
+  bool   adaptiveSampling   = false;  // Stop sampling a pixel once its noise is below adaptiveThreshold
+  int    minSamplesPerPixel = 16;     // Samples every pixel gets before adaptive sampling may stop
+  int    adaptiveBatchSize  = 8;      // Samples added to a pixel between noise estimates
+  double adaptiveThreshold  = 0.01;   // Target standard error of the gamma-encoded pixel luminance
+  int    passSamples        = 0;      // Samples added to every pixel per pass of a non-adaptive render,
+                                      // 0 takes them all in one pass
+
+  std::string checkpointPath;            // Progress is saved here between passes, and a render
+                                         // resumes from it when it holds a checkpoint of the same render
+  double checkpointSeconds = 300;        // Least time between checkpoints
+  double timeBudget = 0;                 // Seconds a render may take, 0 for no limit. Budgeted renders
+                                         // take the samples that fit, up to samplesPerPixel
+  const std::atomic<bool>* stop = nullptr;  // Once set, workers start no more tiles, progress is saved
+                                            // and Render returns early, see Stopped()
+
+  // Called from a render worker each time another percent of a pass is done, and once more
+  // when the pass is complete. Render also hands it every status line it prints, from the
+  // thread that called it. Leave empty to render silently
+  std::function<void(const RenderProgress&)> progress = PrintProgress;
+
+  void Render(
+      const Hittable& world,
+      const MaterialTable& materials,
+      const LightList& lights,
+      Framebuffer& image,
+      Framebuffer* sampleCounts = nullptr,
+      FeatureBuffers* features = nullptr)
   {
+    // Renders the whole image into a linear color framebuffer. Encoding and writing it out is
+    // left to the output stage, see ImageWriter.h. lights lists the emitters of world that
+    // diffuse hits sample directly, see Lights.h. When given, sampleCounts receives the
+    // number of samples spent on every pixel, and features the albedo, normal and depth the
+    // camera rays of every pixel saw, see Features.h. With a checkpointPath, the render goes
+    // on from the checkpoint there and saves its own progress to it.
+    //
+    // A render with a timeBudget starts with a pass of one sample per pixel, which measures
+    // how fast samples are taken. Every pass after it is sized to fill half of the time left
+    // at that rate, so passes shrink as the deadline nears, and adaptive renders spend them on
+    // the noisy pixels once every pixel has the minimum sample count. Workers start no tile
+    // past the deadline, so the render ends at most about a tile late. Before the first pass,
+    // a preview takes one sample on a coarse grid of pixels, and pixels the deadline leaves
+    // without samples show the closest of them
+
+    auto phaseStart = std::chrono::steady_clock::now();
+    auto renderStart = phaseStart;
+    stats = RenderStats();
+    gatherFeatures = (features != nullptr);
+    stopped = false;
+    outOfTime = false;
+
     Initialize();
+    SelectPathKernel(materials);
+    SetPixelWindow(0, 0, imageWidth, imageHeight);
 
-    std::cout << "P3\n" << imageWidth << ' ' << imageHeight << "\n255\n";
+    // Adaptive renders run in passes: every pixel first gets the minimum sample count, then
+    // each pass adds a batch to the pixels whose neighborhood is still too noisy. Other
+    // renders add passSamples to every pixel per pass
+    int batch = std::max(adaptiveSampling ? adaptiveBatchSize : passSamples, 1);
+    int minimumTarget = std::min(std::max(minSamplesPerPixel, 2), samplesPerPixel);
+    int target = (timeBudget > 0) ? 1
+               : adaptiveSampling ? minimumTarget
+               : (passSamples > 0) ? std::min(passSamples, samplesPerPixel) : samplesPerPixel;
+    int pass = 0;
+    double resumedSeconds = 0;
+    uint64_t checkpointKey = 0;
+    if (!checkpointPath.empty())
+    {
+      checkpointKey = CheckpointKey(world, materials, lights);
+      ResumeCheckpoint(checkpointKey, pass, target, resumedSeconds);
+    }
 
-    for (int j = 0; j < imageHeight; j++)
+    long long totalSamples = 0;
+    for (const PixelState& pixel : pixels)
     {
-      std::clog << "\rScanlines remaining: " << (imageHeight - j) << ' ' << std::flush;
+      totalSamples += pixel.sampleCount;
+    }
+    long long resumedSamples = totalSamples;
+
+    stats.setupSeconds = SecondsSince(phaseStart);
+    phaseStart = std::chrono::steady_clock::now();
+    auto lastCheckpoint = phaseStart;
+
+    // Resolving the image costs about what setting up the pixels did, so the deadline leaves
+    // that much time for it
+    hasDeadline = timeBudget > 0;
+    deadline = renderStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                 std::chrono::duration<double>(timeBudget - stats.setupSeconds));
 
+    auto budgetBatch = [&](long long activePixels)
+    {
+      // Samples for every active pixel that fill half of the time left, at the rate so far
+      double rate = double(totalSamples - resumedSamples) / std::max(SecondsSince(phaseStart), 1e-6);
+      double secondsLeft = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+      return int(std::min(std::max(rate * secondsLeft / 2 / double(activePixels), 1.0), double(samplesPerPixel)));
+    };
+
+    if (hasDeadline && resumedSamples == 0)
+    {
+      pixelStride = previewStride;
+      totalSamples += RenderPass(world, materials, lights, 1, pass++);
+      pixelStride = 1;
+      target = budgetBatch((long long)pixels.size());
+    }
+
+    for (; ; pass++)
+    {
+      totalSamples += RenderPass(world, materials, lights, target, pass);
+
+      if (stopped)
+      {
+        // The pass is unfinished, a resumed render runs it again for the tiles it skipped
+        SaveCheckpoint(checkpointKey, pass, target, resumedSeconds + SecondsSince(phaseStart));
+        break;
+      }
+
+      if (target >= samplesPerPixel || outOfTime)
+      {
+        break;
+      }
+
+      long long activePixels = (long long)pixels.size();
+      if (adaptiveSampling && target >= minimumTarget)
+      {
+        activePixels = UpdateConvergence();
+        if (activePixels == 0)
+        {
+          break;
+        }
+        Report("\rAdaptive pass ", pass + 1, ": ", activePixels, " pixels left   ");
+      }
+      else
+      {
+        Report("\rPass ", pass + 1, ": ", target, " samples per pixel   ");
+      }
+
+      target = std::min(target + (hasDeadline ? budgetBatch(activePixels) : batch), samplesPerPixel);
+
+      if (SecondsSince(lastCheckpoint) >= checkpointSeconds)
+      {
+        SaveCheckpoint(checkpointKey, pass + 1, target, resumedSeconds + SecondsSince(phaseStart));
+        lastCheckpoint = std::chrono::steady_clock::now();
+      }
+    }
+
+    std::string failedPath;
+    if (!checkpoints.Finish(&failedPath))
+    {
+      Report("\nCould not write checkpoint ", failedPath, '\n');
+    }
+
+    stats.renderSeconds = SecondsSince(phaseStart);
+    phaseStart = std::chrono::steady_clock::now();
+
+    for (const RenderStats& worker : workerStats)
+    {
+      stats.Merge(worker);
+    }
+
+    image.Resize(imageWidth, imageHeight);
+    if (sampleCounts)
+    {
+      sampleCounts->Resize(imageWidth, imageHeight);
+    }
+    if (features)
+    {
+      features->albedo.Resize(imageWidth, imageHeight);
+      features->normal.Resize(imageWidth, imageHeight);
+      features->depth.Resize(imageWidth, imageHeight);
+      features->variance.Resize(imageWidth, imageHeight);
+    }
+
+    for (int j = 0; j < imageHeight; j++)
+    {
       for (int i = 0; i < imageWidth; i++)
       {
-        Color pixelColor(0,0,0);
-        for (int sample = 0; sample < samplesPerPixel; sample++)
+        // Pixels a stopped or budgeted render left without samples show the closest pixel of
+        // the preview grid, or stay black when it has none either
+        const PixelState& own = PixelAt(i, j);
+        const PixelState& pixel = (own.sampleCount > 0) ? own : PixelAt(i - i % previewStride, j - j % previewStride);
+        int count = pixel.sampleCount;
+
+        auto scale = (count == samplesPerPixel) ? pixelSamplesScale : 1.0 / std::max(count, 1);
+        image.Set(i, j, scale * pixel.sum);
+        if (sampleCounts)
         {
-          Ray r = GetRay(i, j);
-          pixelColor += RayColor(r, maxDepth, world);
+          sampleCounts->Set(i, j, Color(own.sampleCount, own.sampleCount, own.sampleCount));
         }
+        if (features)
+        {
+          double depth = pixel.depthSum / std::max(count, 1);
+          features->albedo.Set(i, j, pixel.albedoSum / std::max(count, 1));
+          features->normal.Set(i, j, pixel.normalSum / std::max(count, 1));
+          features->depth.Set(i, j, Color(depth, depth, depth));
+
+          double variance = MeanVariance(pixel);
+          features->variance.Set(i, j, Color(variance, variance, variance));
+        }
+      }
+    }
+
+    stats.resolveSeconds = SecondsSince(phaseStart);
+    stats.budgetSeconds = timeBudget;
+
+    Report(stopped ? "\rStopped at " : "\rDone. ", double(totalSamples) / (double(imageWidth) * imageHeight),
+           " samples per pixel                \n");
+    if (timeBudget > 0)
+    {
+      Report("Rendered in ", SecondsSince(renderStart), "s of a ", timeBudget, "s budget\n");
+    }
+  }
+
+  void RenderRegion(
+      const Hittable& world,
+      const MaterialTable& materials,
+      const LightList& lights,
+      int x0, int y0, int x1, int y1,
+      int sampleBegin, int sampleEnd,
+      Framebuffer& region)
+  {
+    // Takes samples [sampleBegin, sampleEnd) of the pixels in [x0, x1) x [y0, y1) and writes
+    // each pixel's share of the full image, the sum of those samples over samplesPerPixel,
+    // into region, sized to the rectangle. Samples are seeded by pixel and index alone, so
+    // adding up the regions of any split of the image and of the sample range gives the image
+    // Render makes, bit for bit when no pixel's samples are split. Renders a fixed sample
+    // count without features or progress reports, see Distributed.h
+
+    auto phaseStart = std::chrono::steady_clock::now();
+    stats = RenderStats();
+    gatherFeatures = false;
+
+    Initialize();
+    SelectPathKernel(materials);
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, imageWidth);
+    y1 = std::min(y1, imageHeight);
+    SetPixelWindow(x0, y0, std::max(x1 - x0, 0), std::max(y1 - y0, 0));
+
+    for (PixelState& pixel : pixels)
+    {
+      pixel.sampleCount = sampleBegin;
+    }
+
+    ForEachTile(x0, y0, x1, y1, [&](int tx0, int ty0, int tx1, int ty1, int worker)
+    {
+      RenderStats::Bind(&workerStats[worker]);
+      auto tileStart = std::chrono::steady_clock::now();
+
+      if (integrator == Integrator::Wavefront)
+      {
+        RenderTileWavefront(world, materials, lights, sampleEnd, tx0, ty0, tx1, ty1, waves[worker]);
+      }
+      else
+      {
+        (this->*tileKernel)(world, materials, lights, sampleEnd, tx0, ty0, tx1, ty1);
+      }
+
+      workerStats[worker].AddTile(SecondsSince(tileStart));
+      RenderStats::Bind(nullptr);
+    });
+
+    for (const RenderStats& worker : workerStats)
+    {
+      stats.Merge(worker);
+    }
 
-        WriteColor(std::cout, pixelSamplesScale * pixelColor);
+    region.Resize(windowWidth, windowHeight);
+    for (int j = y0; j < y1; j++)
+    {
+      for (int i = x0; i < x1; i++)
+      {
+        region.Set(i - x0, j - y0, pixelSamplesScale * PixelAt(i, j).sum);
       }
     }
 
-    std::clog << "\rDone.                 \n";
+    stats.renderSeconds = SecondsSince(phaseStart);
+  }
+
+  int ImageHeight() const
+  {
+    // Height of the rendered image in pixels, from the width and the aspect ratio
+    int height = int(imageWidth / aspectRatio);
+    return (height < 1) ? 1 : height;
+  }
+
+  // Counters and phase timers of the last render, see RenderStats.h
+  const RenderStats& Stats() const { return stats; }
+
+  // The last render was ended by stop before it took every sample
+  bool Stopped() const { return stopped; }
+
+  uint64_t Fingerprint(const Hittable& world, const MaterialTable& materials, const LightList& lights) const
+  {
+    // Hash of everything an image depends on, so samples taken with other settings or of
+    // another scene are never mixed in, by distributed workers or from a checkpoint. The
+    // scene is judged by its bounds and its material and light counts, which catches the
+    // likely mistakes cheaply
+    return Fingerprint(world, materials, lights, samplesPerPixel);
+  }
+
+  static void PrintProgress(const RenderProgress& p)
+  {
+    // Default progress report: the status lines, and a tile counter during the first pass,
+    // on the log
+    if (!p.status.empty())
+    {
+      std::clog << p.status << std::flush;
+    }
+    else if (p.pass == 0)
+    {
+      std::clog << "\rTiles remaining: " << (p.tileCount - p.tilesDone) << ' ' << std::flush;
+    }
   }
 
 private:
@@ -59,10 +411,53 @@ private:
   Vec3   defocusDiskU;         // Defocus disk horizontal radius
   Vec3   defocusDiskV;         // Defocus disk vertical radius
 
+  struct PixelState
+  {
+    Color  sum;                      // Sum of every sample color
+    double luminanceSum = 0;         // Sum and squared sum of sample luminances, for the noise
+    double luminanceSquaredSum = 0;  // estimates of adaptive sampling and the denoiser
+    int    sampleCount = 0;
+    bool   converged = false;
+
+    Color  albedoSum;                // Sums of the features of every sample, only
+    Vec3   normalSum;                // gathered when the render was asked for them
+    double depthSum = 0;
+  };
+
+  std::unique_ptr<ThreadPool> pool;  // Render workers, kept alive between renders
+  std::vector<PixelState> pixels;    // Sample accumulation of the current render, for the pixel window
+  int windowX0 = 0, windowY0 = 0;    // Pixels the pixel states cover: the whole image, or the
+  int windowWidth = 0;               // rectangle of a region render
+  int windowHeight = 0;
+  std::vector<float> pixelErrors;    // Noise estimate of every pixel after the last pass
+  std::vector<WavefrontQueues> waves;  // Wavefront buffers of every worker
+  std::vector<RenderStats> workerStats;  // Counters of every worker, merged into stats
+  RenderStats stats;                     // Stats of the last render
+  bool gatherFeatures = false;           // The current render fills feature buffers
+  std::atomic<bool> stopped{false};      // A worker skipped a tile because of stop
+  std::atomic<bool> outOfTime{false};    // A worker skipped a tile because of the deadline
+  bool hasDeadline = false;              // The current render has a time budget, whose tiles
+  std::chrono::steady_clock::time_point deadline;  // must start before deadline
+  int pixelStride = 1;                   // Tiles sample the pixels on this grid, of every row and column
+                                         // a multiple of it
+  static const int previewStride = 4;    // Grid of the preview of budgeted renders
+  AsyncCheckpointWriter checkpoints;
+
+  using TileKernel = long long (Camera::*)(const Hittable&, const MaterialTable&, const LightList&, int, int, int, int, int);
+  TileKernel tileKernel = nullptr;       // RenderTile specialized for the current render
+
   void Initialize()
   {
-    imageHeight = int(imageWidth / aspectRatio);
-    imageHeight = (imageHeight < 1) ? 1 : imageHeight;
+    imageHeight = ImageHeight();
+    tileSize = (tileSize < 1) ? 1 : tileSize;
+
+    int wantedThreads = (threadCount > 0) ? threadCount : int(std::thread::hardware_concurrency());
+    if (!pool || (wantedThreads > 0 && pool->Size() != wantedThreads))
+    {
+      pool.reset(new ThreadPool(threadCount));
+    }
+    waves.resize(pool->Size());
+    workerStats.assign(pool->Size(), RenderStats());
 
     pixelSamplesScale = 1.0 / samplesPerPixel;
 
@@ -97,62 +492,991 @@ private:
     defocusDiskV = v * defocusRadius;
   }
 
-  Ray GetRay(int i, int j) const
+  void SetPixelWindow(int x0, int y0, int width, int height)
+  {
+    // Clears the pixel states and makes them cover width x height pixels from x0, y0
+    windowX0 = x0;
+    windowY0 = y0;
+    windowWidth = width;
+    windowHeight = height;
+    pixels.assign(size_t(width) * height, PixelState());
+  }
+
+  PixelState& PixelAt(int i, int j)
+  {
+    return pixels[size_t(j - windowY0) * windowWidth + (i - windowX0)];
+  }
+
+  int FirstOnGrid(int start) const
+  {
+    // First coordinate from start on that is a multiple of pixelStride
+    return start + (pixelStride - start % pixelStride) % pixelStride;
+  }
+
+  template <typename TileJob>
+  void ForEachTile(TileJob job)
+  {
+    // Runs job(x0, y0, x1, y1, worker) for every tile of the image on the thread pool
+    ForEachTile(0, 0, imageWidth, imageHeight, job);
+  }
+
+  template <typename TileJob>
+  void ForEachTile(int regionX0, int regionY0, int regionX1, int regionY1, TileJob job)
+  {
+    // Same for the tiles of the rectangle [regionX0, regionX1) x [regionY0, regionY1)
+    int tilesX = (regionX1 - regionX0 + tileSize - 1) / tileSize;
+    int tilesY = (regionY1 - regionY0 + tileSize - 1) / tileSize;
+    if (tilesX <= 0 || tilesY <= 0)
+    {
+      return;
+    }
+
+    pool->ParallelFor(tilesX * tilesY, [&](int tile, int worker)
+    {
+      int x0 = regionX0 + (tile % tilesX) * tileSize;
+      int y0 = regionY0 + (tile / tilesX) * tileSize;
+      int x1 = std::min(x0 + tileSize, regionX1);
+      int y1 = std::min(y0 + tileSize, regionY1);
+
+      job(x0, y0, x1, y1, worker);
+    });
+  }
+
+  long long RenderPass(const Hittable& world, const MaterialTable& materials, const LightList& lights, int targetSamples, int pass)
+  {
+    // Brings every pixel that hasn't converged up to targetSamples and returns the number of
+    // samples taken
+    int tileCount = ((imageWidth + tileSize - 1) / tileSize) * ((imageHeight + tileSize - 1) / tileSize);
+    std::atomic<int> tilesDone(0);
+    std::atomic<long long> samplesTaken(0);
+    int reportedPercent = 0;  // Only touched by worker 0
+
+    ForEachTile([&](int x0, int y0, int x1, int y1, int worker)
+    {
+      if (stop && stop->load(std::memory_order_relaxed))
+      {
+        stopped = true;
+        return;
+      }
+      if (hasDeadline && std::chrono::steady_clock::now() >= deadline)
+      {
+        outOfTime = true;
+        return;
+      }
+
+      RenderStats::Bind(&workerStats[worker]);
+      auto tileStart = std::chrono::steady_clock::now();
+
+      if (integrator == Integrator::Wavefront)
+      {
+        samplesTaken += RenderTileWavefront(world, materials, lights, targetSamples, x0, y0, x1, y1, waves[worker]);
+      }
+      else
+      {
+        samplesTaken += (this->*tileKernel)(world, materials, lights, targetSamples, x0, y0, x1, y1);
+      }
+
+      workerStats[worker].AddTile(SecondsSince(tileStart));
+      RenderStats::Bind(nullptr);
+
+      // Reporting from one worker only keeps the callback single-threaded
+      int done = ++tilesDone;
+      int percent = int(100LL * done / tileCount);
+      if (progress && worker == 0 && percent > reportedPercent)
+      {
+        reportedPercent = percent;
+        progress(RenderProgress{ pass, done, tileCount, std::string() });
+      }
+    });
+
+    if (progress && reportedPercent < 100)
+    {
+      progress(RenderProgress{ pass, tileCount, tileCount, std::string() });
+    }
+
+    return samplesTaken;
+  }
+
+  uint64_t Fingerprint(const Hittable& world, const MaterialTable& materials, const LightList& lights, int sampleCount) const
+  {
+    // See the public overload, with sampleCount hashed in place of samplesPerPixel
+    uint64_t hash = 0x5851f42d4c957f2dULL;
+    auto mix = [&hash](double value)
+    {
+      uint64_t bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      hash = Rng::MixBits(hash ^ bits);
+    };
+
+    mix(aspectRatio);
+    mix(imageWidth);
+    mix(sampleCount);
+    mix(maxDepth);
+    mix(rouletteDepth);
+    mix(int(samplerType));
+    mix(vFov);
+    for (int axis = 0; axis < 3; axis++)
+    {
+      mix(lookFrom[axis]);
+      mix(lookAt[axis]);
+      mix(vUp[axis]);
+    }
+    mix(defocusAngle);
+    mix(focusDist);
+    mix(frame);
+    mix(sampleLights ? 1 : 0);
+    mix(skyBrightness);
+
+    AABB bounds = world.BoundingBox();
+    for (int axis = 0; axis < 3; axis++)
+    {
+      mix(bounds.AxisInterval(axis).min);
+      mix(bounds.AxisInterval(axis).max);
+    }
+    mix(materials.Size());
+    mix(lights.Size());
+    return hash;
+  }
+
+  uint64_t CheckpointKey(const Hittable& world, const MaterialTable& materials, const LightList& lights) const
+  {
+    // The fingerprint, plus the settings that decide which pixels get samples and what is
+    // gathered with them. The pass size of non-adaptive renders may change between runs, and
+    // so may the sample count: samples are seeded by their index, so a render stopped at a
+    // lower count goes on to a higher one. Only stratified samples depend on the count, their
+    // strata split each dimension into one per sample, so for them it stays in the key
+    int sampleCount = (samplerType == SamplerType::Stratified) ? samplesPerPixel : 0;
+    uint64_t key = Fingerprint(world, materials, lights, sampleCount);
+    const double settings[] = {
+      adaptiveSampling ? 1.0 : 0.0, double(minSamplesPerPixel), double(adaptiveBatchSize), adaptiveThreshold,
+      gatherFeatures ? 1.0 : 0.0
+    };
+    for (double value : settings)
+    {
+      uint64_t bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      key = Rng::MixBits(key ^ bits);
+    }
+    return key;
+  }
+
+  void ResumeCheckpoint(uint64_t key, int& pass, int& target, double& renderSeconds)
+  {
+    // Loads the pixel states and the pass to go on with from checkpointPath, when it holds a
+    // checkpoint of this render. Samples are seeded by pixel and index alone, so the resumed
+    // render takes exactly the samples the stopped one had left, and ends with the same image
+    CheckpointHeader header;
+    std::vector<char> records;
+    std::string error;
+    if (!CheckpointFile::Read(checkpointPath, header, records, error))
+    {
+      if (!error.empty())
+      {
+        Report("Ignoring checkpoint: ", error, '\n');
+      }
+      return;
+    }
+
+    if (header.recordBytes != sizeof(PixelState) || header.renderKey != key || header.width != imageWidth || header.height != imageHeight)
+    {
+      Report("Ignoring checkpoint ", checkpointPath, ": it was saved by another render or build\n");
+      return;
+    }
+
+    if (header.target > samplesPerPixel)
+    {
+      Report("Ignoring checkpoint ", checkpointPath, ": it has more samples per pixel than this render takes\n");
+      return;
+    }
+
+    std::memcpy(pixels.data(), records.data(), records.size());
+    pass = header.pass;
+    target = header.target;
+    renderSeconds = header.renderSeconds;
+    Report("Resuming from ", checkpointPath, " after ", renderSeconds, "s of rendering\n");
+  }
+
+  void SaveCheckpoint(uint64_t key, int pass, int target, double renderSeconds)
+  {
+    // Copies the pixel states for the checkpoint writer, which saves them while the render
+    // goes on
+    static_assert(std::is_trivially_copyable<PixelState>::value, "pixel states are saved as they are in memory");
+    if (checkpointPath.empty())
+    {
+      return;
+    }
+
+    CheckpointHeader header;
+    CheckpointFile::InitHeader(header);
+    header.recordBytes = uint32_t(sizeof(PixelState));
+    header.renderKey = key;
+    header.width = imageWidth;
+    header.height = imageHeight;
+    header.pass = pass;
+    header.target = target;
+    header.renderSeconds = renderSeconds;
+
+    std::vector<char>& buffer = checkpoints.Buffer();
+    buffer.resize(pixels.size() * sizeof(PixelState));
+    std::memcpy(buffer.data(), pixels.data(), buffer.size());
+    checkpoints.Write(checkpointPath, header);
+  }
+
+  template <class... Parts>
+  void Report(const Parts&... parts) const
+  {
+    // Hands progress a status line, written from its parts as a stream would
+    if (progress)
+    {
+      std::ostringstream line;
+      (line << ... << parts);
+      progress(RenderProgress{ 0, 0, 0, line.str() });
+    }
+  }
+
+  static double SecondsSince(std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  void SelectPathKernel(const MaterialTable& materials)
+  {
+    // Points tileKernel at the RenderTile instantiation for this render's lens, depth and
+    // materials. Each setting becomes a variant of compile-time constants, and visiting them
+    // together picks one of every combination. Only all-diffuse scenes get a material kernel
+    // of their own: every instantiation is a copy of the whole path loop, and past about
+    // eight of them the compiler stops inlining the samplers and scatter kernels into them
+    using Switch = std::variant<std::false_type, std::true_type>;
+    using MaterialChoice = std::variant<
+        std::integral_constant<int, -1>,
+        std::integral_constant<int, int(MaterialType::Lambertian)>>;
+
+    auto toSwitch = [](bool on) { return on ? Switch(std::true_type()) : Switch(std::false_type()); };
+
+    // Roulette starts with the bounce after rouletteDepth - 1, which paths only reach when it
+    // is within maxDepth
+    Switch thinLens = toSwitch(defocusAngle > 0);
+    Switch roulette = toSwitch(rouletteDepth <= maxDepth);
+
+    MaterialType type;
+    MaterialChoice materialType;
+    if (materials.SingleType(type) && type == MaterialType::Lambertian)
+    {
+      materialType = std::integral_constant<int, int(MaterialType::Lambertian)>();
+    }
+
+    tileKernel = std::visit([](auto lens, auto deep, auto only) -> TileKernel
+    {
+      return &Camera::RenderTile<PathKernel<decltype(lens)::value, decltype(deep)::value, decltype(only)::value>>;
+    }, thinLens, roulette, materialType);
+  }
+
+  template <class Kernel>
+  long long RenderTile(
+      const Hittable& world,
+      const MaterialTable& materials,
+      const LightList& lights,
+      int targetSamples,
+      int x0, int y0, int x1, int y1)
+  {
+    // Samples the pixels in [x0, x1) x [y0, y1) on the pixel grid and returns the number of
+    // samples taken. Tiles never overlap, so workers can update their pixels without
+    // synchronization
+
+    long long tileSamples = 0;
+
+    for (int j = FirstOnGrid(y0); j < y1; j += pixelStride)
+    {
+      for (int i = FirstOnGrid(x0); i < x1; i += pixelStride)
+      {
+        // Every sample seeds its own sampler from where it is, not from who renders it, so
+        // the image is the same for any thread count or tile schedule
+        uint64_t pixelIndex = uint64_t(j) * imageWidth + i;
+        PixelState& pixel = PixelAt(i, j);
+
+        if (pixel.converged)
+        {
+          continue;
+        }
+
+        for (int sample = pixel.sampleCount; sample < targetSamples; sample++)
+        {
+          Sampler sampler(samplerType, i, j, pixelIndex, sample, samplesPerPixel, frame);
+          Ray r = GetRay<Kernel::thinLens>(i, j, sampler);
+          SampleFeatures features;
+          AddSample(pixel, RayColor<Kernel>(r, maxDepth, world, materials, lights, sampler, gatherFeatures ? &features : nullptr));
+          if (gatherFeatures)
+          {
+            AddFeatures(pixel, features);
+          }
+          tileSamples++;
+        }
+
+        pixel.sampleCount = std::max(pixel.sampleCount, targetSamples);
+      }
+    }
+
+    return tileSamples;
+  }
+
+  long long RenderTileWavefront(
+      const Hittable& world,
+      const MaterialTable& materials,
+      const LightList& lights,
+      int targetSamples,
+      int x0, int y0, int x1, int y1,
+      WavefrontQueues& queues)
+  {
+    // Same contract as RenderTile, but the tile's samples are traced as waves. Samples are
+    // listed in the order RenderTile takes them and every path owns the sampler RenderTile
+    // would give it, so both integrators produce the same image
+
+    queues.samplePixels.clear();
+    queues.sampleIndices.clear();
+
+    for (int j = FirstOnGrid(y0); j < y1; j += pixelStride)
+    {
+      for (int i = FirstOnGrid(x0); i < x1; i += pixelStride)
+      {
+        uint64_t pixelIndex = uint64_t(j) * imageWidth + i;
+        PixelState& pixel = PixelAt(i, j);
+
+        if (pixel.converged)
+        {
+          continue;
+        }
+
+        for (int sample = pixel.sampleCount; sample < targetSamples; sample++)
+        {
+          queues.samplePixels.push_back(pixelIndex);
+          queues.sampleIndices.push_back(sample);
+        }
+
+        pixel.sampleCount = std::max(pixel.sampleCount, targetSamples);
+      }
+    }
+
+    int sampleCount = int(queues.samplePixels.size());
+    int wave = std::max(waveSize, 1);
+
+    for (int begin = 0; begin < sampleCount; begin += wave)
+    {
+      int end = std::min(begin + wave, sampleCount);
+
+      // Camera ray generation
+      queues.paths.clear();
+      queues.results.assign(end - begin, Color(0, 0, 0));
+      if (gatherFeatures)
+      {
+        queues.features.assign(end - begin, SampleFeatures());
+      }
+
+      for (int k = begin; k < end; k++)
+      {
+        uint64_t pixelIndex = queues.samplePixels[k];
+        int i = int(pixelIndex % imageWidth);
+        int j = int(pixelIndex / imageWidth);
+
+        WavefrontPath path;
+        path.sampler = Sampler(samplerType, i, j, pixelIndex, queues.sampleIndices[k], samplesPerPixel, frame);
+        path.ray = GetRay(i, j, path.sampler);
+        path.throughput = Color(1, 1, 1);
+        path.scatterPdf = 0;
+        path.findFeatures = gatherFeatures;
+        path.sample = k - begin;
+        path.bounce = 0;
+
+        if (maxDepth > 0)
+        {
+          queues.paths.push_back(path);
+        }
+      }
+
+      TraceWave(world, materials, lights, queues);
+
+      for (int k = begin; k < end; k++)
+      {
+        uint64_t pixelIndex = queues.samplePixels[k];
+        PixelState& pixel = PixelAt(int(pixelIndex % imageWidth), int(pixelIndex / imageWidth));
+        AddSample(pixel, queues.results[k - begin]);
+        if (gatherFeatures)
+        {
+          AddFeatures(pixel, queues.features[k - begin]);
+        }
+      }
+    }
+
+    return sampleCount;
+  }
+
+  void TraceWave(const Hittable& world, const MaterialTable& materials, const LightList& lights, WavefrontQueues& queues) const
+  {
+    AABB bounds = world.BoundingBox();
+
+    while (!queues.paths.empty())
+    {
+      if (sortWavefrontRays)
+      {
+        queues.SortPaths(bounds);
+      }
+
+      // Intersection stage: find every closest hit and bin the paths by material type.
+      // Paths that escape pick up the background and leave the wave
+      size_t pathCount = queues.paths.size();
+      queues.hits.resize(pathCount);
+      for (auto& bin : queues.bins)
+      {
+        bin.clear();
+      }
+
+      for (size_t p = 0; p < pathCount; p++)
+      {
+        WavefrontPath& path = queues.paths[p];
+        HitRecord& rec = queues.hits[p];
+
+        ENGINE_STAT(CountRay(path.bounce));
+
+        // Scattered rays start off their surface (see OffsetRayOrigin), so any t past 0 is a real hit
+        if (!world.Hit(path.ray, Interval(0, infinity), rec))
+        {
+          ENGINE_STAT(CountEscape(path.bounce));
+          queues.results[path.sample] += path.throughput * Background(path.ray);
+          continue;
+        }
+
+        rec.object->CompleteHit(path.ray, rec);
+        const Material& material = materials[rec.material];
+        ENGINE_STAT(RenderStats::Thread().hits[int(material.Type())]++);
+
+        if (path.findFeatures)
+        {
+          path.findFeatures = !RecordFeatures(queues.features[path.sample], path.ray, rec, material, path.bounce, path.throughput);
+        }
+
+        if (material.Type() == MaterialType::DiffuseLight)
+        {
+          queues.results[path.sample] += path.throughput * EmissionWeight(lights, rec, path.ray, path.scatterPdf) * material.Emission();
+        }
+
+        queues.bins[int(material.Type())].push_back(int(p));
+      }
+
+      // Scatter stage: one kernel per material type over its whole bin. Survivors are
+      // compacted into the next wave. Diffuse paths trace their shadow rays here, before
+      // scattering, which is when RayColor traces them too
+      queues.nextPaths.clear();
+      ScatterLambertianBin(world, materials, lights, queues, queues.bins[int(MaterialType::Lambertian)]);
+      ScatterBin<&Material::ScatterMetal>(queues, materials, queues.bins[int(MaterialType::Metal)]);
+      ScatterBin<&Material::ScatterDielectric>(queues, materials, queues.bins[int(MaterialType::Dielectric)]);
+      ScatterBin<&Material::ScatterLight>(queues, materials, queues.bins[int(MaterialType::DiffuseLight)]);
+
+      queues.paths.swap(queues.nextPaths);
+    }
+  }
+
+  void ScatterLambertianBin(
+      const Hittable& world,
+      const MaterialTable& materials,
+      const LightList& lights,
+      WavefrontQueues& queues,
+      const std::vector<int>& bin) const
+  {
+    // Diffuse paths draw their numbers first, shadow rays included, then get every direction
+    // from one batched kernel. Each path still draws in the order RayColor does
+    const bool nextEvent = sampleLights && !lights.Empty();
+    DirectionBatch& directions = queues.directions;
+    directions.Resize(bin.size());
+
+    for (size_t i = 0; i < bin.size(); i++)
+    {
+      WavefrontPath& path = queues.paths[bin[i]];
+      const HitRecord& rec = queues.hits[bin[i]];
+      path.sampler.StartBounce(path.bounce);
+
+      if (nextEvent)
+      {
+        queues.results[path.sample] += path.throughput * SampleLight(world, materials, lights, materials[rec.material], rec, path.sampler);
+      }
+
+      path.sampler.Get2D(directions.u[i], directions.v[i]);
+      directions.SetNormal(i, rec.normal);
+    }
+
+    directions.CosineHemisphere(int(bin.size()));
+
+    for (size_t i = 0; i < bin.size(); i++)
+    {
+      WavefrontPath path = queues.paths[bin[i]];
+      const HitRecord& rec = queues.hits[bin[i]];
+
+      Ray scattered;
+      Color attenuation;
+      materials[rec.material].ScatterLambertian(rec, directions.Result(i), attenuation, scattered);
+      path.scatterPdf = nextEvent ? Material::LambertianPdf(rec.normal, scattered.Direction()) : 0;
+      ContinuePath(queues, path, scattered, attenuation);
+    }
+  }
+
+  template <bool (Material::*Kernel)(const Ray&, const HitRecord&, Color&, Ray&, Sampler&) const>
+  void ScatterBin(WavefrontQueues& queues, const MaterialTable& materials, const std::vector<int>& bin) const
+  {
+    // Materials that sample no lights and scatter with their own kernel
+    for (int p : bin)
+    {
+      WavefrontPath path = queues.paths[p];
+      const HitRecord& rec = queues.hits[p];
+      const Material& material = materials[rec.material];
+      path.sampler.StartBounce(path.bounce);
+
+      Ray scattered;
+      Color attenuation;
+      if (!(material.*Kernel)(path.ray, rec, attenuation, scattered, path.sampler))
+      {
+        ENGINE_STAT(CountAbsorbed(material.Type(), path.bounce));
+        continue;
+      }
+
+      path.scatterPdf = 0;
+      ContinuePath(queues, path, scattered, attenuation);
+    }
+  }
+
+  void ContinuePath(WavefrontQueues& queues, WavefrontPath& path, const Ray& scattered, const Color& attenuation) const
+  {
+    // Moves a scattered path on to the next wave, unless roulette or the depth limit ends it
+    path.throughput = path.throughput * attenuation;
+    path.ray = scattered;
+
+    if (!SurvivesRoulette(path.bounce, path.throughput, path.sampler))
+    {
+      ENGINE_STAT(CountRouletteKill(path.bounce));
+      return;
+    }
+
+    if (++path.bounce >= maxDepth)
+    {
+      ENGINE_STAT(CountMaxDepth(maxDepth));
+      return;
+    }
+
+    queues.nextPaths.push_back(path);
+  }
+
+  static void AddFeatures(PixelState& pixel, const SampleFeatures& features)
+  {
+    pixel.albedoSum += features.albedo;
+    pixel.normalSum += features.normal;
+    pixel.depthSum += features.depth;
+  }
+
+  static bool RecordFeatures(
+      SampleFeatures& features,
+      const Ray& r,
+      const HitRecord& rec,
+      const Material& material,
+      int bounce,
+      const Color& throughput)
+  {
+    // Records a hit of a path still looking for its features, and returns true once it has
+    // them. Depth is the camera ray's. Mirrors and glass show other surfaces, so albedo and
+    // normal come from the first surface seen through them, tinted by what the path passed
+    // through, and the denoiser keeps the edges of reflections and refractions too
+    if (bounce == 0)
+    {
+      features.depth = rec.t * r.Direction().Length();
+    }
+
+    MaterialType type = material.Type();
+    if (type == MaterialType::Dielectric || (type == MaterialType::Metal && material.Fuzz() == 0))
+    {
+      return false;
+    }
+
+    // Lights have no albedo, their emission stands in for it so they still have edges
+    const Color& e = material.Emission();
+    Color albedo = (type == MaterialType::DiffuseLight)
+                 ? Color(std::fmin(e.X(), Real(1)), std::fmin(e.Y(), Real(1)), std::fmin(e.Z(), Real(1)))
+                 : material.Albedo();
+
+    features.albedo = throughput * albedo;
+    features.normal = rec.normal;
+    return true;
+  }
+
+  void AddSample(PixelState& pixel, const Color& sampleColor) const
+  {
+    pixel.sum += sampleColor;
+    if (adaptiveSampling || gatherFeatures)
+    {
+      double luminance = Luminance(sampleColor);
+      pixel.luminanceSum += luminance;
+      pixel.luminanceSquaredSum += luminance * luminance;
+    }
+  }
+
+  int UpdateConvergence()
+  {
+    // Marks the pixels whose 3x3 neighborhood is below the noise threshold as converged and
+    // returns the number still active. Looking at the neighbors catches pixels whose first
+    // samples happened to miss a rare bright path that the pixels around them found
+
+    pixelErrors.resize(pixels.size());
+    for (size_t p = 0; p < pixels.size(); p++)
+    {
+      pixelErrors[p] = float(PixelError(pixels[p]));
+    }
+
+    std::atomic<int> activePixels(0);
+    ForEachTile([&](int x0, int y0, int x1, int y1, int)
+    {
+      int active = 0;
+      for (int j = y0; j < y1; j++)
+      {
+        for (int i = x0; i < x1; i++)
+        {
+          PixelState& pixel = PixelAt(i, j);
+          if (pixel.converged)
+          {
+            continue;
+          }
+
+          float error = 0;
+          for (int nj = std::max(j - 1, 0); nj <= std::min(j + 1, imageHeight - 1); nj++)
+          {
+            for (int ni = std::max(i - 1, 0); ni <= std::min(i + 1, imageWidth - 1); ni++)
+            {
+              error = std::max(error, pixelErrors[size_t(nj) * imageWidth + ni]);
+            }
+          }
+
+          pixel.converged = error < adaptiveThreshold || pixel.sampleCount >= samplesPerPixel;
+          active += pixel.converged ? 0 : 1;
+        }
+      }
+      activePixels += active;
+    });
+
+    return activePixels;
+  }
+
+  static double Luminance(const Color& c)
+  {
+    return 0.2126 * c.X() + 0.7152 * c.Y() + 0.0722 * c.Z();
+  }
+
+  static double MeanVariance(const PixelState& pixel)
+  {
+    // Variance of the pixel's mean luminance, estimated from the variance of its samples. A
+    // single sample can't show its variance and is taken to be as noisy as it is bright
+    int n = pixel.sampleCount;
+    double mean = pixel.luminanceSum / std::max(n, 1);
+    if (n < 2)
+    {
+      return mean * mean;
+    }
+
+    double variance = (pixel.luminanceSquaredSum - n * mean * mean) / (n - 1);
+    return std::fmax(variance, 0.0) / n;
+  }
+
+  static double PixelError(const PixelState& pixel)
+  {
+    // Estimates the standard error of the pixel mean from the sample variance, then converts
+    // it to gamma space (the output applies a square root), where the eye judges noise. Dark
+    // pixels are clamped so a handful of black samples can't claim a perfect estimate
+
+    int n = pixel.sampleCount;
+    if (n < 2)
+    {
+      return infinity;
+    }
+
+    double mean = pixel.luminanceSum / n;
+    double standardError = std::sqrt(MeanVariance(pixel));
+
+    return standardError / (2 * std::sqrt(std::fmax(mean, 1e-3)));
+  }
+
+  Ray GetRay(int i, int j, Sampler& sampler) const
+  {
+    return (defocusAngle <= 0) ? GetRay<false>(i, j, sampler) : GetRay<true>(i, j, sampler);
+  }
+
+  template <bool ThinLens>
+  Ray GetRay(int i, int j, Sampler& sampler) const
   {
     // Construct a camera ray originating from the defocus disk and directed at a randomly
     // sampled point around the pixel location i, j
 
-    auto offset = SampleSquare();
+    auto offset = SampleSquare(sampler);
     auto pixelSample = pixel00Loc
     + ((i + offset.X()) * pixelDeltaU)
     + ((j + offset.Y()) * pixelDeltaV);
 
-    auto rayOrigin = (defocusAngle <= 0) ? center : DefocusDiskSample();;
+    Point3 rayOrigin;
+    if constexpr (ThinLens)
+    {
+      rayOrigin = DefocusDiskSample(sampler);
+    }
+    else
+    {
+      rayOrigin = center;
+    }
     auto rayDirection = pixelSample - rayOrigin;
 
     return Ray(rayOrigin, rayDirection);
   }
 
-  Vec3 SampleSquare() const
+  Vec3 SampleSquare(Sampler& sampler) const
   {
-    // Returns the vector to a random point in the [-.5, -.5] - [+.5, +.5] unit square
-    // TODO: Replace 0.5 with a pixel spacing variable (?)
-    return Vec3(RandomDouble() - 0.5, RandomDouble() - 0.5, 0);
+    // Returns the vector to a random point in the [-.5, -.5] - [+.5, +.5] unit square. The
+    // offset is in pixels and GetRay scales it by the pixel deltas, so it follows the spacing
+    double u, v;
+    sampler.Get2D(u, v);
+    return Vec3(u - 0.5, v - 0.5, 0);
   }
 
-  Point3 DefocusDiskSample() const
+  Point3 DefocusDiskSample(Sampler& sampler) const
   {
     // Returns a random point in the camera defocus disk
-    auto p = RandomNormalized2DVector();
+    double u, v;
+    sampler.Get2D(u, v);
+    auto p = SampleConcentricDisk(u, v);
     return center + (p[0] * defocusDiskU) + (p[1] * defocusDiskV);
   }
 
-  Color RayColor(const Ray& r, int depth, const Hittable& world) const
+  template <class Kernel>
+  Color RayColor(
+      const Ray& r,
+      int depth,
+      const Hittable& world,
+      const MaterialTable& materials,
+      const LightList& lights,
+      Sampler& sampler,
+      SampleFeatures* features = nullptr) const
   {
-    // If we've exceeded the ray bounce limit, no more light is gathered
-    if (depth <= 0)
-    {
-      return Color(0, 0, 0);
-    }
+    // Follows the path one bounce at a time, carrying the product of every attenuation so far
+    // as its throughput, instead of recursing once per bounce. Light is gathered as the path
+    // goes: emitters it hits, shadow rays from its diffuse hits, and the sky it escapes to.
+    // When given, features receives the albedo, normal and depth the path saw, see
+    // RecordFeatures, and stays empty if it escaped first. Branches on settings Kernel fixes
+    // are resolved at compile time
 
+    Ray ray = r;
+    Color throughput(1, 1, 1);
+    Color radiance(0, 0, 0);
+    double scatterPdf = 0;  // Density ray was scattered with, 0 when that bounce sampled no light
     HitRecord rec;
+    const bool nextEvent = sampleLights && !lights.Empty();
+    bool findFeatures = (features != nullptr);
 
-    // Choose 0.001 as minimum t value to solve shadow acne
-    if (world.Hit(r, Interval(0.001, infinity), rec))
+    for (int bounce = 0; bounce < depth; bounce++)
     {
+      ENGINE_STAT(CountRay(bounce));
+
+      // Scattered rays start off their surface (see OffsetRayOrigin), so any t past 0 is a real hit
+      if (!world.Hit(ray, Interval(0, infinity), rec))
+      {
+        ENGINE_STAT(CountEscape(bounce));
+        return radiance + throughput * Background(ray);
+      }
+
+      rec.object->CompleteHit(ray, rec);
+
+      const Material& material = materials[rec.material];
+      ENGINE_STAT(RenderStats::Thread().hits[int(material.Type())]++);
+
+      if (findFeatures)
+      {
+        findFeatures = !RecordFeatures(*features, ray, rec, material, bounce, throughput);
+      }
+
+      sampler.StartBounce(bounce);
+      bool diffuse = Kernel::MayHit(MaterialType::Lambertian) && nextEvent && material.Type() == MaterialType::Lambertian;
+      if (Kernel::MayHit(MaterialType::DiffuseLight) && material.Type() == MaterialType::DiffuseLight)
+      {
+        radiance += throughput * EmissionWeight(lights, rec, ray, scatterPdf) * material.Emission();
+      }
+      else if (diffuse)
+      {
+        radiance += throughput * SampleLight(world, materials, lights, material, rec, sampler);
+      }
+
       Ray scattered;
       Color attenuation;
-      if (rec.material->Scatter(r, rec, attenuation, scattered))
+      if (!Scatter<Kernel>(material, ray, rec, attenuation, scattered, sampler))
       {
-        return attenuation * RayColor(scattered, depth - 1, world);
+        ENGINE_STAT(CountAbsorbed(material.Type(), bounce));
+        return radiance;
       }
+
+      scatterPdf = diffuse ? Material::LambertianPdf(rec.normal, scattered.Direction()) : 0;
+      throughput = throughput * attenuation;
+      ray = scattered;
+
+      if constexpr (Kernel::roulette)
+      {
+        if (!SurvivesRoulette(bounce, throughput, sampler))
+        {
+          ENGINE_STAT(CountRouletteKill(bounce));
+          return radiance;
+        }
+      }
+    }
+
+    // If we've exceeded the ray bounce limit, no more light is gathered
+    ENGINE_STAT(CountMaxDepth(depth));
+    return radiance;
+  }
+
+  template <class Kernel>
+  static bool Scatter(
+      const Material& material,
+      const Ray& rIn,
+      const HitRecord& rec,
+      Color& attenuation,
+      Ray& scattered,
+      Sampler& sampler)
+  {
+    // Scatters with the material's own kernel when the scene has one type only, or through
+    // Material::Scatter's switch otherwise
+    if constexpr (Kernel::materialType == int(MaterialType::Lambertian))
+    {
+      return material.ScatterLambertian(rIn, rec, attenuation, scattered, sampler);
+    }
+    else
+    {
+      return material.Scatter(rIn, rec, attenuation, scattered, sampler);
+    }
+  }
+
+  // Direct lighting, shared by both integrators. A diffuse hit gathers light two ways: a
+  // shadow ray toward a point picked on a light, and its scattered ray finding a light by
+  // chance. Multiple importance sampling weighs each by the power heuristic, so neither
+  // counts the same light twice and each covers the cases the other samples poorly: small or
+  // distant lights for shadow rays, large and close ones for scattering
+
+  Color SampleLight(
+      const Hittable& world,
+      const MaterialTable& materials,
+      const LightList& lights,
+      const Material& material,
+      const HitRecord& rec,
+      Sampler& sampler) const
+  {
+    // Light reaching a Lambertian hit through one shadow ray, times its BRDF and cosine
+    LightSample sample;
+    if (!lights.Sample(rec.p, sampler, sample))
+    {
+      return Color(0, 0, 0);
+    }
+
+    double cosine = Dot(rec.normal, sample.direction);
+    if (cosine <= 0)
+    {
+      return Color(0, 0, 0);
+    }
+
+    // Whatever the shadow ray hits first must be the light itself. Rays grazing its rim may
+    // round past it and find nothing, which counts as reaching it
+    ENGINE_STAT(RenderStats::Thread().shadowRays++);
+    HitRecord shadow;
+    Interval toLight(0, sample.distance * Real(1.001));
+    if (world.Hit(rec.SpawnRay(sample.direction), toLight, shadow) && lights.Find(shadow) != sample.light)
+    {
       return Color(0, 0, 0);
     }
 
+    double scatterPdf = cosine / pi;
+    double weight = PowerHeuristic(sample.pdf, scatterPdf);
+    const Color& emission = materials[lights.MaterialOf(sample.light)].Emission();
+
+    return (weight * scatterPdf / sample.pdf) * material.Albedo() * emission;
+  }
+
+  static double EmissionWeight(const LightList& lights, const HitRecord& rec, const Ray& ray, double scatterPdf)
+  {
+    // Weight of a light found by a scattered ray. Only bounces that also sent a shadow ray
+    // could have found it both ways, and lights missing from the list are never sampled
+    if (scatterPdf <= 0)
+    {
+      return 1;
+    }
+
+    int light = lights.Find(rec);
+    return (light < 0) ? 1 : PowerHeuristic(scatterPdf, lights.Pdf(light, ray.Origin()));
+  }
+
+  static double PowerHeuristic(double pdf, double otherPdf)
+  {
+    return (pdf * pdf) / (pdf * pdf + otherPdf * otherPdf);
+  }
+
+  // Path events for RenderStats, shared by both integrators. bounce is the index of the ray
+  // the event happened to, so a path that ends there traced bounce + 1 rays
+
+  static void CountRay(int bounce)
+  {
+    RenderStats& stats = RenderStats::Thread();
+    (bounce == 0) ? stats.cameraRays++ : stats.secondaryRays++;
+  }
+
+  static void CountEscape(int bounce)
+  {
+    RenderStats& stats = RenderStats::Thread();
+    stats.escapedRays++;
+    stats.AddPath(bounce + 1);
+  }
+
+  static void CountAbsorbed(MaterialType type, int bounce)
+  {
+    RenderStats& stats = RenderStats::Thread();
+    stats.absorbed[int(type)]++;
+    stats.AddPath(bounce + 1);
+  }
+
+  static void CountRouletteKill(int bounce)
+  {
+    RenderStats& stats = RenderStats::Thread();
+    stats.rouletteTerminations++;
+    stats.AddPath(bounce + 1);
+  }
+
+  static void CountMaxDepth(int depth)
+  {
+    RenderStats& stats = RenderStats::Thread();
+    stats.maxDepthTerminations++;
+    stats.AddPath(depth);
+  }
+
+  Color Background(const Ray& r) const
+  {
     Vec3 normalizedDirection = Normalized(r.Direction());
     auto a = 0.5 * (normalizedDirection.Y() + 1.0);
 
-    return (1.0 - a) * Color(1.0, 1.0, 1.0) + a * Color(0.5, 0.7, 1.0);
+    return skyBrightness * ((1.0 - a) * Color(1.0, 1.0, 1.0) + a * Color(0.5, 0.7, 1.0));
+  }
+
+  bool SurvivesRoulette(int bounce, Color& throughput, Sampler& sampler) const
+  {
+    // Russian roulette: past the minimum depth, a path survives with a probability equal to
+    // its largest throughput component and survivors are boosted by the inverse, so dim paths
+    // end early while the expected value stays the same
+
+    if (bounce + 1 < rouletteDepth)
+    {
+      return true;
+    }
+
+    auto survival = std::fmin(std::fmax(throughput.X(), std::fmax(throughput.Y(), throughput.Z())), 1.0);
+
+    if (sampler.Get1D() >= survival)
+    {
+      return false;
+    }
+
+    throughput /= survival;
+    return true;
   }
 };
 
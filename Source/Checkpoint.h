@@ -0,0 +1,179 @@
+#pragma once
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Checkpoints of a render in progress, so a render that is stopped or killed can go on where
+// it left off. A checkpoint file is a CheckpointHeader followed by the camera's pixel states,
+// copied as they are in memory. Only the build that wrote a checkpoint reads it back, which
+// the header checks along with the render it belongs to
+
+struct CheckpointHeader
+{
+  char     magic[8];       // "RTCHECK" and a zero byte
+  uint32_t version;
+  uint32_t recordBytes;    // Size of one pixel state in the build that wrote the file
+  uint64_t renderKey;      // Fingerprint of the camera settings and the scene
+  int32_t  width;
+  int32_t  height;
+  int32_t  pass;           // Pass to go on with, and the sample count it brings every
+  int32_t  target;         // pixel to, which some are short of after a stop mid-pass
+  double   renderSeconds;  // Time spent rendering the saved samples, over every run
+};
+
+class CheckpointFile
+{
+public:
+  static const uint32_t version = 1;
+
+  static void InitHeader(CheckpointHeader& header)
+  {
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, Magic(), 8);
+    header.version = version;
+  }
+
+  static bool Read(const std::string& path, CheckpointHeader& header, std::vector<char>& records, std::string& error)
+  {
+    // Reads the header and the records after it. A missing file leaves error empty, it is
+    // what every render that wasn't stopped before finds
+    error.clear();
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+    {
+      return false;
+    }
+
+    bool valid = std::fread(&header, sizeof(header), 1, file) == 1
+              && std::memcmp(header.magic, Magic(), 8) == 0
+              && header.version == version
+              && header.width > 0 && header.height > 0;
+    if (valid)
+    {
+      records.resize(size_t(header.width) * size_t(header.height) * header.recordBytes);
+      valid = std::fread(records.data(), 1, records.size(), file) == records.size() && std::fgetc(file) == EOF;
+    }
+    std::fclose(file);
+
+    if (!valid)
+    {
+      error = path + " is not a checkpoint, or it is truncated";
+    }
+    return valid;
+  }
+
+  static bool Write(const std::string& path, const CheckpointHeader& header, const void* records, size_t bytes)
+  {
+    // Writes a file next to path and renames it over path once it is on disk, so a crash at
+    // any point leaves either the old checkpoint or the new one, never a mix
+    std::string partial = path + ".partial";
+    FILE* file = std::fopen(partial.c_str(), "wb");
+    if (!file)
+    {
+      return false;
+    }
+
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1
+                && std::fwrite(records, 1, bytes, file) == bytes
+                && std::fflush(file) == 0;
+#ifdef _WIN32
+    written = written && _commit(_fileno(file)) == 0;
+#else
+    written = written && fsync(fileno(file)) == 0;
+#endif
+    written = (std::fclose(file) == 0) && written;
+
+#ifdef _WIN32
+    written = written && MoveFileExA(partial.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    written = written && std::rename(partial.c_str(), path.c_str()) == 0;
+#endif
+    if (!written)
+    {
+      std::remove(partial.c_str());
+    }
+    return written;
+  }
+
+private:
+  static const char* Magic() { return "RTCHECK"; }
+};
+
+class AsyncCheckpointWriter
+{
+  // Writes checkpoints on a thread of its own, so rendering goes on while one is saved. The
+  // renderer copies its state into Buffer() and hands it over with Write. One checkpoint is
+  // written at a time: taking the buffer first waits for the write before
+
+public:
+  AsyncCheckpointWriter() {}
+  AsyncCheckpointWriter(const AsyncCheckpointWriter&) = delete;
+  AsyncCheckpointWriter& operator=(const AsyncCheckpointWriter&) = delete;
+
+  ~AsyncCheckpointWriter() { Finish(); }
+
+  std::vector<char>& Buffer()
+  {
+    Wait();
+    return pending;
+  }
+
+  void Write(const std::string& path, const CheckpointHeader& header)
+  {
+    // Saves header and the buffer to path. Failures are reported by Finish
+    Wait();
+    writer = std::thread([this, path, header]()
+    {
+      if (!CheckpointFile::Write(path, header, pending.data(), pending.size()))
+      {
+        failedPath = failedPath.empty() ? path : failedPath;
+      }
+    });
+  }
+
+  bool Finish(std::string* failed = nullptr)
+  {
+    // Waits for the last write. Returns false if any write failed since the last Finish, and
+    // names the first one
+    Wait();
+    if (failed)
+    {
+      *failed = failedPath;
+    }
+    bool written = failedPath.empty();
+    failedPath.clear();
+    return written;
+  }
+
+private:
+  std::thread writer;
+  std::vector<char> pending;
+  std::string failedPath;
+
+  void Wait()
+  {
+    if (writer.joinable())
+    {
+      writer.join();
+    }
+  }
+};
+
+#endif // CHECKPOINT_H
\ No newline at end of file
@@ -19,7 +19,7 @@ inline double LinearToGamma(double linearComponent)
   return 0;
 }
 
-void WriteColor(std::ostream& out, const Color& pixelColor)
+inline void ColorToBytes(const Color& pixelColor, unsigned char bytes[3])
 {
   auto r = pixelColor.X();
   auto g = pixelColor.Y();
@@ -32,12 +32,18 @@ void WriteColor(std::ostream& out, const Color& pixelColor)
 
   // Translate the [0,1] component values to the byte range [0,255]
   static const Interval intensity(0.000, 0.999);
-  int rByte = int(256 * intensity.Clamp(r));
-  int gByte = int(256 * intensity.Clamp(g));
-  int bByte = int(256 * intensity.Clamp(b));
+  bytes[0] = (unsigned char)(256 * intensity.Clamp(r));
+  bytes[1] = (unsigned char)(256 * intensity.Clamp(g));
+  bytes[2] = (unsigned char)(256 * intensity.Clamp(b));
+}
+
+inline void WriteColor(std::ostream& out, const Color& pixelColor)
+{
+  unsigned char bytes[3];
+  ColorToBytes(pixelColor, bytes);
 
   // Write out the pixel color components
-  out << rByte << ' ' << gByte << ' ' << bByte << '\n';
+  out << int(bytes[0]) << ' ' << int(bytes[1]) << ' ' << int(bytes[2]) << '\n';
 }
 
 #endif // COLOR_H
\ No newline at end of file
@@ -0,0 +1,596 @@
+#pragma once
+
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "Features.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+class Denoiser
+{
+  // Edge-avoiding a-trous wavelet filter, after Dammertz et al., "Edge-Avoiding A-Trous
+  // Wavelet Transform for fast Global Illumination Filtering", with the variance-guided color
+  // weight of Schied et al.'s SVGF. Each pass blurs with a 5x5 B-spline kernel whose taps are
+  // 1, 2, 4, ... pixels apart, so three passes reach across 29 pixels for 75 taps per pixel.
+  // Taps are weighed down by how far they are from the center pixel in albedo, normal and
+  // depth, so the blur stops at the edges the feature buffers show, and in luminance, measured
+  // against the pixel's noise, so noisy pixels are smoothed hard while clean ones keep their
+  // detail. Every pass also filters the variance, which tightens the next pass.
+  //
+  // Color is divided by the albedo before filtering and multiplied back after, so only the
+  // lighting is blurred and surface colors stay as sharp as the albedo buffer
+
+public:
+  int    iterations  = 3;     // Filter passes, each with twice the tap spacing of the last. More blur fine detail
+  double colorSigma  = 3;     // Tolerated luminance difference, in standard deviations of the pixel's noise
+  double normalSigma = 0.5;   // Tolerated distance between normals
+  double albedoSigma = 0.1;   // Tolerated distance between albedos
+  double depthSigma  = 0.05;  // Tolerated depth difference, relative to depth, per pixel of tap spacing
+  int    threadCount = 0;     // Filter threads, 0 uses all hardware threads
+
+  void Denoise(const Framebuffer& color, const FeatureBuffers& features, Framebuffer& output)
+  {
+    // Filters color, guided by the features rendered with it, into output
+    width = color.Width();
+    height = color.Height();
+    size_t pixelCount = size_t(width) * height;
+    output.Resize(width, height);
+    if (pixelCount == 0)
+    {
+      return;
+    }
+
+    const float* c = color.Data();
+    const float* a = features.albedo.Data();
+    const float* n = features.normal.Data();
+    const float* z = features.depth.Data();
+    const float* v = features.variance.Data();
+
+    for (int k = 0; k < 3; k++)
+    {
+      irradiance[k].resize(pixelCount);
+      filtered[k].resize(pixelCount);
+      albedo[k].resize(pixelCount);
+      normal[k].resize(pixelCount);
+    }
+    variance.resize(pixelCount);
+    filteredVariance.resize(pixelCount);
+    depth.resize(pixelCount);
+    key.resize(pixelCount);
+    colorScale.resize(pixelCount);
+    depthScale.resize(pixelCount);
+
+    for (size_t p = 0; p < pixelCount; p++)
+    {
+      for (int k = 0; k < 3; k++)
+      {
+        albedo[k][p] = a[p * 3 + k];
+        normal[k][p] = n[p * 3 + k];
+        irradiance[k][p] = c[p * 3 + k] / Modulation(a[p * 3 + k]);
+      }
+      depth[p] = z[p * 3];
+
+      // The variance is of the color's luminance, scale it to the irradiance's
+      float modulation = Luminance(Modulation(a[p * 3]), Modulation(a[p * 3 + 1]), Modulation(a[p * 3 + 2]));
+      variance[p] = v[p * 3] / (modulation * modulation);
+    }
+
+    int wantedThreads = (threadCount > 0) ? threadCount : int(std::thread::hardware_concurrency());
+    if (!pool || (wantedThreads > 0 && pool->Size() != wantedThreads))
+    {
+      pool.reset(new ThreadPool(threadCount));
+    }
+
+    SpanKernel filterSpan = SelectKernel();
+
+    for (int pass = 0; pass < iterations; pass++)
+    {
+      FilterPass f;
+      f.width = width;
+      f.height = height;
+      f.step = 1 << std::min(pass, 20);
+      f.normalScale = float(1 / (normalSigma * normalSigma));
+      f.albedoScale = float(1 / (albedoSigma * albedoSigma));
+      f.key = key.data();
+      f.colorScale = colorScale.data();
+      f.depthScale = depthScale.data();
+      f.depth = depth.data();
+      f.inVariance = variance.data();
+      f.outVariance = filteredVariance.data();
+      for (int k = 0; k < 3; k++)
+      {
+        f.in[k] = irradiance[k].data();
+        f.out[k] = filtered[k].data();
+        f.albedo[k] = albedo[k].data();
+        f.normal[k] = normal[k].data();
+      }
+
+      // Per-pixel terms of the center pixel first, then the filter itself, which reads them
+      // from its neighbors
+      pool->ParallelFor(height, [&](int y, int)
+      {
+        PrepareRow(f, y);
+      });
+
+      pool->ParallelFor(height, [&](int y, int)
+      {
+        int begin = std::min(2 * f.step, width);
+        int end = std::max(width - 2 * f.step, begin);
+
+        int x = 0;
+        for (; x < begin; x++)
+        {
+          FilterPixel(f, x, y);
+        }
+        for (x = filterSpan(f, y, x, end); x < width; x++)
+        {
+          FilterPixel(f, x, y);
+        }
+      });
+
+      for (int k = 0; k < 3; k++)
+      {
+        irradiance[k].swap(filtered[k]);
+      }
+      variance.swap(filteredVariance);
+    }
+
+    float* out = output.Data();
+    for (size_t p = 0; p < pixelCount; p++)
+    {
+      for (int k = 0; k < 3; k++)
+      {
+        out[p * 3 + k] = irradiance[k][p] * Modulation(a[p * 3 + k]);
+      }
+    }
+  }
+
+private:
+  struct FilterPass
+  {
+    int width, height;
+    int step;                 // Pixels between taps
+    float normalScale;        // One over the square of each sigma
+    float albedoScale;
+    const float* in[3];       // Irradiance before and after the pass
+    float* out[3];
+    const float* inVariance;  // Variance of the irradiance's luminance before and after the pass
+    float* outVariance;
+    const float* key;         // Luminance of in
+    const float* colorScale;  // One over the square of the tolerated luminance difference of each pixel
+    const float* depthScale;  // One over the square of the tolerated depth difference of each pixel
+    const float* depth;
+    const float* albedo[3];
+    const float* normal[3];
+  };
+
+  typedef int (*SpanKernel)(const FilterPass& f, int y, int x, int end);
+
+  int width = 0;
+  int height = 0;
+  std::vector<float> irradiance[3];  // Color over albedo, one plane per channel, so SIMD kernels
+  std::vector<float> filtered[3];    // load neighboring pixels with one instruction
+  std::vector<float> variance;
+  std::vector<float> filteredVariance;
+  std::vector<float> albedo[3];
+  std::vector<float> normal[3];
+  std::vector<float> depth;
+  std::vector<float> key;
+  std::vector<float> colorScale;
+  std::vector<float> depthScale;
+  std::unique_ptr<ThreadPool> pool;
+
+  static float Luminance(float r, float g, float b)
+  {
+    return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+  }
+
+  static float Modulation(float albedo)
+  {
+    // Albedo channel the color is divided by. Black surfaces and escaped rays have no
+    // albedo to divide by and are filtered as they are
+    return (albedo > 0.01f) ? albedo : 1.0f;
+  }
+
+  void PrepareRow(const FilterPass& f, int y)
+  {
+    // The variance a single pixel estimates from its samples is itself noisy, so the color
+    // tolerance uses a 3x3 blur of it. Pixels that escaped have no depth and only blend with
+    // pixels that escaped too
+    const float minVariance = 1e-6f;
+    const float missScale = 1e4f;
+    static const float blur[3] = { 0.25f, 0.5f, 0.25f };
+    float depthTolerance = float(depthSigma) * f.step;
+    float sigmaSquared = float(colorSigma * colorSigma);
+
+    for (int x = 0; x < width; x++)
+    {
+      size_t p = size_t(y) * width + x;
+      key[p] = Luminance(f.in[0][p], f.in[1][p], f.in[2][p]);
+
+      float blurred = 0, blurWeight = 0;
+      for (int dy = -1; dy <= 1; dy++)
+      {
+        for (int dx = -1; dx <= 1; dx++)
+        {
+          int qx = x + dx, qy = y + dy;
+          if (qx >= 0 && qx < width && qy >= 0 && qy < height)
+          {
+            float w = blur[dy + 1] * blur[dx + 1];
+            blurred += w * f.inVariance[size_t(qy) * width + qx];
+            blurWeight += w;
+          }
+        }
+      }
+      colorScale[p] = 1 / (sigmaSquared * (blurred / blurWeight) + minVariance);
+
+      float tolerance = depthTolerance * depth[p];
+      depthScale[p] = (depth[p] > 0) ? 1 / (tolerance * tolerance) : missScale;
+    }
+  }
+
+  static float TapWeight(int dx, int dy)
+  {
+    static const float spline[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+    return spline[dy + 2] * spline[dx + 2];
+  }
+
+  static float ExpNegative(float x)
+  {
+    // e^-x for x >= 0, to about 2e-4: e^-x = 2^-t, where the whole part of t goes straight
+    // into the exponent bits and a Taylor polynomial covers the fraction. The SIMD kernels
+    // repeat it operation for operation, so every kernel gives the same image
+    x = (x < 86.0f) ? x : 86.0f;
+    float t = x * 1.44269504f;
+    int32_t whole = int32_t(t);
+    float fraction = t - float(whole);
+
+    float p = -0.00133336f;
+    p = p * fraction + 0.00961813f;
+    p = p * fraction + -0.05550411f;
+    p = p * fraction + 0.24022651f;
+    p = p * fraction + -0.69314718f;
+    p = p * fraction + 1.0f;
+
+    uint32_t bits;
+    std::memcpy(&bits, &p, sizeof(bits));
+    bits -= uint32_t(whole) << 23;
+    std::memcpy(&p, &bits, sizeof(p));
+    return p;
+  }
+
+  static void FilterPixel(const FilterPass& f, int x, int y)
+  {
+    size_t p = size_t(y) * f.width + x;
+    float centerKey = f.key[p];
+    float centerColorScale = f.colorScale[p];
+    float centerDepthScale = f.depthScale[p];
+    float centerDepth = f.depth[p];
+    float a0 = f.albedo[0][p], a1 = f.albedo[1][p], a2 = f.albedo[2][p];
+    float n0 = f.normal[0][p], n1 = f.normal[1][p], n2 = f.normal[2][p];
+
+    float sum0 = 0, sum1 = 0, sum2 = 0, varianceSum = 0, weightSum = 0;
+    for (int dy = -2; dy <= 2; dy++)
+    {
+      int qy = y + dy * f.step;
+      if (qy < 0 || qy >= f.height)
+      {
+        continue;
+      }
+
+      for (int dx = -2; dx <= 2; dx++)
+      {
+        int qx = x + dx * f.step;
+        if (qx < 0 || qx >= f.width)
+        {
+          continue;
+        }
+
+        size_t q = size_t(qy) * f.width + qx;
+        float dk = centerKey - f.key[q];
+        float dn0 = n0 - f.normal[0][q], dn1 = n1 - f.normal[1][q], dn2 = n2 - f.normal[2][q];
+        float da0 = a0 - f.albedo[0][q], da1 = a1 - f.albedo[1][q], da2 = a2 - f.albedo[2][q];
+        float dz = centerDepth - f.depth[q];
+
+        float distance = dk * dk * centerColorScale
+                       + (dn0 * dn0 + dn1 * dn1 + dn2 * dn2) * f.normalScale
+                       + (da0 * da0 + da1 * da1 + da2 * da2) * f.albedoScale
+                       + dz * dz * centerDepthScale;
+        float w = TapWeight(dx, dy) * ExpNegative(distance);
+
+        sum0 += w * f.in[0][q];
+        sum1 += w * f.in[1][q];
+        sum2 += w * f.in[2][q];
+        varianceSum += w * w * f.inVariance[q];
+        weightSum += w;
+      }
+    }
+
+    // The center tap always has weight, so weightSum is never zero
+    f.out[0][p] = sum0 / weightSum;
+    f.out[1][p] = sum1 / weightSum;
+    f.out[2][p] = sum2 / weightSum;
+    f.outVariance[p] = varianceSum / (weightSum * weightSum);
+  }
+
+  static int FilterSpanScalar(const FilterPass& f, int y, int x, int end)
+  {
+    for (; x < end; x++)
+    {
+      FilterPixel(f, x, y);
+    }
+    return x;
+  }
+
+  static SpanKernel SelectKernel()
+  {
+#if ENGINE_SIMD_X86
+    switch (ActiveSimdLevel())
+    {
+      case SimdLevel::AVX512: return &FilterSpanAVX512;
+      case SimdLevel::AVX2:   return &FilterSpanAVX2;
+      case SimdLevel::SSE2:   return &FilterSpanSSE2;
+      default:                break;
+    }
+#endif
+    return &FilterSpanScalar;
+  }
+
+  // SIMD kernels filter a run of pixels whose taps all fall inside the row, one pixel per
+  // lane, and return the first pixel they left for the scalar loop
+
+#if ENGINE_SIMD_X86
+  ENGINE_TARGET_SSE2
+  static __m128 ExpNegativeSSE2(__m128 x)
+  {
+    x = _mm_min_ps(x, _mm_set1_ps(86.0f));
+    __m128 t = _mm_mul_ps(x, _mm_set1_ps(1.44269504f));
+    __m128i whole = _mm_cvttps_epi32(t);
+    __m128 fraction = _mm_sub_ps(t, _mm_cvtepi32_ps(whole));
+
+    __m128 p = _mm_set1_ps(-0.00133336f);
+    p = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(0.00961813f));
+    p = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(-0.05550411f));
+    p = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(0.24022651f));
+    p = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(-0.69314718f));
+    p = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(1.0f));
+
+    return _mm_castsi128_ps(_mm_sub_epi32(_mm_castps_si128(p), _mm_slli_epi32(whole, 23)));
+  }
+
+  ENGINE_TARGET_SSE2
+  static int FilterSpanSSE2(const FilterPass& f, int y, int x, int end)
+  {
+    const __m128 normalScale = _mm_set1_ps(f.normalScale);
+    const __m128 albedoScale = _mm_set1_ps(f.albedoScale);
+
+    for (; x + 4 <= end; x += 4)
+    {
+      size_t p = size_t(y) * f.width + x;
+      __m128 centerKey = _mm_loadu_ps(f.key + p);
+      __m128 centerColorScale = _mm_loadu_ps(f.colorScale + p);
+      __m128 centerDepthScale = _mm_loadu_ps(f.depthScale + p);
+      __m128 centerDepth = _mm_loadu_ps(f.depth + p);
+      __m128 a0 = _mm_loadu_ps(f.albedo[0] + p), a1 = _mm_loadu_ps(f.albedo[1] + p), a2 = _mm_loadu_ps(f.albedo[2] + p);
+      __m128 n0 = _mm_loadu_ps(f.normal[0] + p), n1 = _mm_loadu_ps(f.normal[1] + p), n2 = _mm_loadu_ps(f.normal[2] + p);
+
+      __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps(), sum2 = _mm_setzero_ps();
+      __m128 varianceSum = _mm_setzero_ps(), weightSum = _mm_setzero_ps();
+      for (int dy = -2; dy <= 2; dy++)
+      {
+        int qy = y + dy * f.step;
+        if (qy < 0 || qy >= f.height)
+        {
+          continue;
+        }
+
+        for (int dx = -2; dx <= 2; dx++)
+        {
+          size_t q = size_t(qy) * f.width + x + dx * f.step;
+          __m128 dk = _mm_sub_ps(centerKey, _mm_loadu_ps(f.key + q));
+          __m128 dn0 = _mm_sub_ps(n0, _mm_loadu_ps(f.normal[0] + q));
+          __m128 dn1 = _mm_sub_ps(n1, _mm_loadu_ps(f.normal[1] + q));
+          __m128 dn2 = _mm_sub_ps(n2, _mm_loadu_ps(f.normal[2] + q));
+          __m128 da0 = _mm_sub_ps(a0, _mm_loadu_ps(f.albedo[0] + q));
+          __m128 da1 = _mm_sub_ps(a1, _mm_loadu_ps(f.albedo[1] + q));
+          __m128 da2 = _mm_sub_ps(a2, _mm_loadu_ps(f.albedo[2] + q));
+          __m128 dz = _mm_sub_ps(centerDepth, _mm_loadu_ps(f.depth + q));
+
+          __m128 normalDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dn0, dn0), _mm_mul_ps(dn1, dn1)), _mm_mul_ps(dn2, dn2));
+          __m128 albedoDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(da0, da0), _mm_mul_ps(da1, da1)), _mm_mul_ps(da2, da2));
+          __m128 distance = _mm_mul_ps(_mm_mul_ps(dk, dk), centerColorScale);
+          distance = _mm_add_ps(distance, _mm_mul_ps(normalDistance, normalScale));
+          distance = _mm_add_ps(distance, _mm_mul_ps(albedoDistance, albedoScale));
+          distance = _mm_add_ps(distance, _mm_mul_ps(_mm_mul_ps(dz, dz), centerDepthScale));
+          __m128 w = _mm_mul_ps(_mm_set1_ps(TapWeight(dx, dy)), ExpNegativeSSE2(distance));
+
+          sum0 = _mm_add_ps(sum0, _mm_mul_ps(w, _mm_loadu_ps(f.in[0] + q)));
+          sum1 = _mm_add_ps(sum1, _mm_mul_ps(w, _mm_loadu_ps(f.in[1] + q)));
+          sum2 = _mm_add_ps(sum2, _mm_mul_ps(w, _mm_loadu_ps(f.in[2] + q)));
+          varianceSum = _mm_add_ps(varianceSum, _mm_mul_ps(_mm_mul_ps(w, w), _mm_loadu_ps(f.inVariance + q)));
+          weightSum = _mm_add_ps(weightSum, w);
+        }
+      }
+
+      _mm_storeu_ps(f.out[0] + p, _mm_div_ps(sum0, weightSum));
+      _mm_storeu_ps(f.out[1] + p, _mm_div_ps(sum1, weightSum));
+      _mm_storeu_ps(f.out[2] + p, _mm_div_ps(sum2, weightSum));
+      _mm_storeu_ps(f.outVariance + p, _mm_div_ps(varianceSum, _mm_mul_ps(weightSum, weightSum)));
+    }
+
+    return x;
+  }
+
+  ENGINE_TARGET_AVX2
+  static __m256 ExpNegativeAVX2(__m256 x)
+  {
+    x = _mm256_min_ps(x, _mm256_set1_ps(86.0f));
+    __m256 t = _mm256_mul_ps(x, _mm256_set1_ps(1.44269504f));
+    __m256i whole = _mm256_cvttps_epi32(t);
+    __m256 fraction = _mm256_sub_ps(t, _mm256_cvtepi32_ps(whole));
+
+    __m256 p = _mm256_set1_ps(-0.00133336f);
+    p = _mm256_add_ps(_mm256_mul_ps(p, fraction), _mm256_set1_ps(0.00961813f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, fraction), _mm256_set1_ps(-0.05550411f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, fraction), _mm256_set1_ps(0.24022651f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, fraction), _mm256_set1_ps(-0.69314718f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, fraction), _mm256_set1_ps(1.0f));
+
+    return _mm256_castsi256_ps(_mm256_sub_epi32(_mm256_castps_si256(p), _mm256_slli_epi32(whole, 23)));
+  }
+
+  ENGINE_TARGET_AVX2
+  static int FilterSpanAVX2(const FilterPass& f, int y, int x, int end)
+  {
+    const __m256 normalScale = _mm256_set1_ps(f.normalScale);
+    const __m256 albedoScale = _mm256_set1_ps(f.albedoScale);
+
+    for (; x + 8 <= end; x += 8)
+    {
+      size_t p = size_t(y) * f.width + x;
+      __m256 centerKey = _mm256_loadu_ps(f.key + p);
+      __m256 centerColorScale = _mm256_loadu_ps(f.colorScale + p);
+      __m256 centerDepthScale = _mm256_loadu_ps(f.depthScale + p);
+      __m256 centerDepth = _mm256_loadu_ps(f.depth + p);
+      __m256 a0 = _mm256_loadu_ps(f.albedo[0] + p), a1 = _mm256_loadu_ps(f.albedo[1] + p), a2 = _mm256_loadu_ps(f.albedo[2] + p);
+      __m256 n0 = _mm256_loadu_ps(f.normal[0] + p), n1 = _mm256_loadu_ps(f.normal[1] + p), n2 = _mm256_loadu_ps(f.normal[2] + p);
+
+      __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps(), sum2 = _mm256_setzero_ps();
+      __m256 varianceSum = _mm256_setzero_ps(), weightSum = _mm256_setzero_ps();
+      for (int dy = -2; dy <= 2; dy++)
+      {
+        int qy = y + dy * f.step;
+        if (qy < 0 || qy >= f.height)
+        {
+          continue;
+        }
+
+        for (int dx = -2; dx <= 2; dx++)
+        {
+          size_t q = size_t(qy) * f.width + x + dx * f.step;
+          __m256 dk = _mm256_sub_ps(centerKey, _mm256_loadu_ps(f.key + q));
+          __m256 dn0 = _mm256_sub_ps(n0, _mm256_loadu_ps(f.normal[0] + q));
+          __m256 dn1 = _mm256_sub_ps(n1, _mm256_loadu_ps(f.normal[1] + q));
+          __m256 dn2 = _mm256_sub_ps(n2, _mm256_loadu_ps(f.normal[2] + q));
+          __m256 da0 = _mm256_sub_ps(a0, _mm256_loadu_ps(f.albedo[0] + q));
+          __m256 da1 = _mm256_sub_ps(a1, _mm256_loadu_ps(f.albedo[1] + q));
+          __m256 da2 = _mm256_sub_ps(a2, _mm256_loadu_ps(f.albedo[2] + q));
+          __m256 dz = _mm256_sub_ps(centerDepth, _mm256_loadu_ps(f.depth + q));
+
+          __m256 normalDistance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dn0, dn0), _mm256_mul_ps(dn1, dn1)), _mm256_mul_ps(dn2, dn2));
+          __m256 albedoDistance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(da0, da0), _mm256_mul_ps(da1, da1)), _mm256_mul_ps(da2, da2));
+          __m256 distance = _mm256_mul_ps(_mm256_mul_ps(dk, dk), centerColorScale);
+          distance = _mm256_add_ps(distance, _mm256_mul_ps(normalDistance, normalScale));
+          distance = _mm256_add_ps(distance, _mm256_mul_ps(albedoDistance, albedoScale));
+          distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_mul_ps(dz, dz), centerDepthScale));
+          __m256 w = _mm256_mul_ps(_mm256_set1_ps(TapWeight(dx, dy)), ExpNegativeAVX2(distance));
+
+          sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(w, _mm256_loadu_ps(f.in[0] + q)));
+          sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(w, _mm256_loadu_ps(f.in[1] + q)));
+          sum2 = _mm256_add_ps(sum2, _mm256_mul_ps(w, _mm256_loadu_ps(f.in[2] + q)));
+          varianceSum = _mm256_add_ps(varianceSum, _mm256_mul_ps(_mm256_mul_ps(w, w), _mm256_loadu_ps(f.inVariance + q)));
+          weightSum = _mm256_add_ps(weightSum, w);
+        }
+      }
+
+      _mm256_storeu_ps(f.out[0] + p, _mm256_div_ps(sum0, weightSum));
+      _mm256_storeu_ps(f.out[1] + p, _mm256_div_ps(sum1, weightSum));
+      _mm256_storeu_ps(f.out[2] + p, _mm256_div_ps(sum2, weightSum));
+      _mm256_storeu_ps(f.outVariance + p, _mm256_div_ps(varianceSum, _mm256_mul_ps(weightSum, weightSum)));
+    }
+
+    return x;
+  }
+
+  ENGINE_TARGET_AVX512
+  static __m512 ExpNegativeAVX512(__m512 x)
+  {
+    x = _mm512_min_ps(x, _mm512_set1_ps(86.0f));
+    __m512 t = _mm512_mul_ps(x, _mm512_set1_ps(1.44269504f));
+    __m512i whole = _mm512_cvttps_epi32(t);
+    __m512 fraction = _mm512_sub_ps(t, _mm512_cvtepi32_ps(whole));
+
+    __m512 p = _mm512_set1_ps(-0.00133336f);
+    p = _mm512_add_ps(_mm512_mul_ps(p, fraction), _mm512_set1_ps(0.00961813f));
+    p = _mm512_add_ps(_mm512_mul_ps(p, fraction), _mm512_set1_ps(-0.05550411f));
+    p = _mm512_add_ps(_mm512_mul_ps(p, fraction), _mm512_set1_ps(0.24022651f));
+    p = _mm512_add_ps(_mm512_mul_ps(p, fraction), _mm512_set1_ps(-0.69314718f));
+    p = _mm512_add_ps(_mm512_mul_ps(p, fraction), _mm512_set1_ps(1.0f));
+
+    return _mm512_castsi512_ps(_mm512_sub_epi32(_mm512_castps_si512(p), _mm512_slli_epi32(whole, 23)));
+  }
+
+  ENGINE_TARGET_AVX512
+  static int FilterSpanAVX512(const FilterPass& f, int y, int x, int end)
+  {
+    const __m512 normalScale = _mm512_set1_ps(f.normalScale);
+    const __m512 albedoScale = _mm512_set1_ps(f.albedoScale);
+
+    for (; x + 16 <= end; x += 16)
+    {
+      size_t p = size_t(y) * f.width + x;
+      __m512 centerKey = _mm512_loadu_ps(f.key + p);
+      __m512 centerColorScale = _mm512_loadu_ps(f.colorScale + p);
+      __m512 centerDepthScale = _mm512_loadu_ps(f.depthScale + p);
+      __m512 centerDepth = _mm512_loadu_ps(f.depth + p);
+      __m512 a0 = _mm512_loadu_ps(f.albedo[0] + p), a1 = _mm512_loadu_ps(f.albedo[1] + p), a2 = _mm512_loadu_ps(f.albedo[2] + p);
+      __m512 n0 = _mm512_loadu_ps(f.normal[0] + p), n1 = _mm512_loadu_ps(f.normal[1] + p), n2 = _mm512_loadu_ps(f.normal[2] + p);
+
+      __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps(), sum2 = _mm512_setzero_ps();
+      __m512 varianceSum = _mm512_setzero_ps(), weightSum = _mm512_setzero_ps();
+      for (int dy = -2; dy <= 2; dy++)
+      {
+        int qy = y + dy * f.step;
+        if (qy < 0 || qy >= f.height)
+        {
+          continue;
+        }
+
+        for (int dx = -2; dx <= 2; dx++)
+        {
+          size_t q = size_t(qy) * f.width + x + dx * f.step;
+          __m512 dk = _mm512_sub_ps(centerKey, _mm512_loadu_ps(f.key + q));
+          __m512 dn0 = _mm512_sub_ps(n0, _mm512_loadu_ps(f.normal[0] + q));
+          __m512 dn1 = _mm512_sub_ps(n1, _mm512_loadu_ps(f.normal[1] + q));
+          __m512 dn2 = _mm512_sub_ps(n2, _mm512_loadu_ps(f.normal[2] + q));
+          __m512 da0 = _mm512_sub_ps(a0, _mm512_loadu_ps(f.albedo[0] + q));
+          __m512 da1 = _mm512_sub_ps(a1, _mm512_loadu_ps(f.albedo[1] + q));
+          __m512 da2 = _mm512_sub_ps(a2, _mm512_loadu_ps(f.albedo[2] + q));
+          __m512 dz = _mm512_sub_ps(centerDepth, _mm512_loadu_ps(f.depth + q));
+
+          __m512 normalDistance = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dn0, dn0), _mm512_mul_ps(dn1, dn1)), _mm512_mul_ps(dn2, dn2));
+          __m512 albedoDistance = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(da0, da0), _mm512_mul_ps(da1, da1)), _mm512_mul_ps(da2, da2));
+          __m512 distance = _mm512_mul_ps(_mm512_mul_ps(dk, dk), centerColorScale);
+          distance = _mm512_add_ps(distance, _mm512_mul_ps(normalDistance, normalScale));
+          distance = _mm512_add_ps(distance, _mm512_mul_ps(albedoDistance, albedoScale));
+          distance = _mm512_add_ps(distance, _mm512_mul_ps(_mm512_mul_ps(dz, dz), centerDepthScale));
+          __m512 w = _mm512_mul_ps(_mm512_set1_ps(TapWeight(dx, dy)), ExpNegativeAVX512(distance));
+
+          sum0 = _mm512_add_ps(sum0, _mm512_mul_ps(w, _mm512_loadu_ps(f.in[0] + q)));
+          sum1 = _mm512_add_ps(sum1, _mm512_mul_ps(w, _mm512_loadu_ps(f.in[1] + q)));
+          sum2 = _mm512_add_ps(sum2, _mm512_mul_ps(w, _mm512_loadu_ps(f.in[2] + q)));
+          varianceSum = _mm512_add_ps(varianceSum, _mm512_mul_ps(_mm512_mul_ps(w, w), _mm512_loadu_ps(f.inVariance + q)));
+          weightSum = _mm512_add_ps(weightSum, w);
+        }
+      }
+
+      _mm512_storeu_ps(f.out[0] + p, _mm512_div_ps(sum0, weightSum));
+      _mm512_storeu_ps(f.out[1] + p, _mm512_div_ps(sum1, weightSum));
+      _mm512_storeu_ps(f.out[2] + p, _mm512_div_ps(sum2, weightSum));
+      _mm512_storeu_ps(f.outVariance + p, _mm512_div_ps(varianceSum, _mm512_mul_ps(weightSum, weightSum)));
+    }
+
+    return x;
+  }
+#endif
+};
+
+#endif // DENOISER_H
\ No newline at end of file
@@ -0,0 +1,884 @@
+#pragma once
+
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Camera.h"
+#include "Framebuffer.h"
+#include "RenderStats.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Distributed rendering: a coordinator splits the image into jobs, each a tile and a range of
+// its sample indices, and hands them to worker processes, local ones it starts itself or ones
+// on other hosts that connect to it. Workers build the same scene from the same options,
+// render their jobs with Camera::RenderRegion and send back float tiles, which the
+// coordinator adds up. Every sample is seeded from its pixel and index alone, so the result
+// doesn't depend on which worker rendered what, and it matches a local render bit for bit
+// when the sample range isn't split.
+//
+// Messages travel over stream sockets: a header of two 32-bit words, the type and the size of
+// the payload that follows. Like the binary scene files, everything is in host byte order,
+// which is little endian on every machine we build for.
+//   Hello   both ways when a worker connects: protocol version, then the worker's fingerprint
+//           of its scene and camera (see Camera::Fingerprint), which must match the coordinator's
+//   Job     coordinator to worker: id, x0, y0, x1, y1, sampleBegin, sampleEnd as 32-bit ints
+//   Result  worker to coordinator: job id, render seconds as a double, then the tile's RGB
+//           floats row by row
+//   Quit    coordinator to worker: no more jobs, the worker exits
+//
+// Workers that close their connection or stop answering lose their jobs to the others. Once
+// the queue runs dry, idle workers also take a second copy of the oldest jobs still running,
+// so one slow worker can't hold up the end of the render; whichever copy comes back first is
+// kept. POSIX only, Windows builds report that it isn't supported
+
+const uint32_t renderProtocolVersion = 1;
+
+enum class RenderMessage : uint32_t
+{
+  Hello = 1,
+  Job = 2,
+  Result = 3,
+  Quit = 4
+};
+
+struct RenderJob
+{
+  int32_t id;
+  int32_t x0, y0, x1, y1;            // Tile, in pixels
+  int32_t sampleBegin, sampleEnd;    // Sample indices of every pixel of the tile
+};
+
+#ifndef _WIN32
+
+class RenderConnection
+{
+  // One end of a stream socket carrying protocol messages. Sends never raise SIGPIPE, a peer
+  // that went away shows up as a failed call instead
+
+public:
+  explicit RenderConnection(int descriptor) : descriptor(descriptor) {}
+  RenderConnection(const RenderConnection&) = delete;
+  RenderConnection& operator=(const RenderConnection&) = delete;
+
+  ~RenderConnection() { Close(); }
+
+  int Descriptor() const { return descriptor; }
+
+  void Close()
+  {
+    if (descriptor >= 0)
+    {
+      close(descriptor);
+    }
+    descriptor = -1;
+  }
+
+  bool Send(RenderMessage type, const void* payload, size_t size)
+  {
+    uint32_t header[2] = { uint32_t(type), uint32_t(size) };
+    buffer.resize(sizeof(header) + size);
+    std::memcpy(buffer.data(), header, sizeof(header));
+    if (size > 0)
+    {
+      std::memcpy(buffer.data() + sizeof(header), payload, size);
+    }
+    return SendAll(buffer.data(), buffer.size());
+  }
+
+  bool Receive(RenderMessage& type, std::vector<unsigned char>& payload)
+  {
+    // Blocks until a whole message has arrived. Fails on a closed or broken connection, a
+    // receive timeout, or a header no peer of ours would send
+    uint32_t header[2];
+    if (!ReceiveAll(header, sizeof(header)) || header[1] > maxPayload)
+    {
+      return false;
+    }
+
+    type = RenderMessage(header[0]);
+    payload.resize(header[1]);
+    return header[1] == 0 || ReceiveAll(payload.data(), header[1]);
+  }
+
+  void SetReceiveTimeout(double seconds)
+  {
+    timeval timeout;
+    timeout.tv_sec = long(seconds);
+    timeout.tv_usec = long((seconds - double(timeout.tv_sec)) * 1e6);
+    setsockopt(descriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  }
+
+private:
+  static const uint32_t maxPayload = 1u << 30;
+
+  int descriptor;
+  std::vector<unsigned char> buffer;
+
+  bool SendAll(const unsigned char* data, size_t size)
+  {
+    while (size > 0)
+    {
+      ssize_t sent = send(descriptor, data, size, MSG_NOSIGNAL);
+      if (sent < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (sent <= 0)
+      {
+        return false;
+      }
+      data += sent;
+      size -= size_t(sent);
+    }
+    return true;
+  }
+
+  bool ReceiveAll(void* destination, size_t size)
+  {
+    unsigned char* data = static_cast<unsigned char*>(destination);
+    while (size > 0)
+    {
+      ssize_t received = recv(descriptor, data, size, 0);
+      if (received < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (received <= 0)
+      {
+        return false;
+      }
+      data += received;
+      size -= size_t(received);
+    }
+    return true;
+  }
+};
+
+inline bool ParseHostPort(const std::string& address, std::string& host, std::string& port)
+{
+  // Splits host:port at its last colon, so bracketless IPv6 hosts still work
+  size_t colon = address.rfind(':');
+  if (colon == std::string::npos || colon + 1 == address.size())
+  {
+    return false;
+  }
+  host = address.substr(0, colon);
+  port = address.substr(colon + 1);
+  return true;
+}
+
+inline int ConnectToCoordinator(const std::string& address, std::string& error)
+{
+  // Opens a TCP connection to a coordinator at host:port and returns its descriptor, or -1
+  std::string host, port;
+  if (!ParseHostPort(address, host, port))
+  {
+    error = "expected host:port, got " + address;
+    return -1;
+  }
+
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  addrinfo* addresses = nullptr;
+  int status = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+  if (status != 0)
+  {
+    error = gai_strerror(status);
+    return -1;
+  }
+
+  int descriptor = -1;
+  for (addrinfo* a = addresses; a && descriptor < 0; a = a->ai_next)
+  {
+    descriptor = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+    if (descriptor >= 0 && connect(descriptor, a->ai_addr, a->ai_addrlen) != 0)
+    {
+      close(descriptor);
+      descriptor = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+
+  if (descriptor < 0)
+  {
+    error = "could not connect to " + address + ": " + std::strerror(errno);
+    return -1;
+  }
+
+  int noDelay = 1;
+  setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  return descriptor;
+}
+
+inline bool RunRenderWorker(
+    int descriptor,
+    Camera& cam,
+    const Hittable& world,
+    const MaterialTable& materials,
+    const LightList& lights,
+    std::string& error)
+{
+  // Serves the jobs of a coordinator over an open connection, which it takes over, until the
+  // coordinator says it is done or goes away. Returns false when the coordinator can't be
+  // greeted or speaks another version of the protocol
+  RenderConnection connection(descriptor);
+  cam.progress = nullptr;
+
+  uint32_t hello[3] = { renderProtocolVersion, 0, 0 };
+  uint64_t fingerprint = cam.Fingerprint(world, materials, lights);
+  std::memcpy(&hello[1], &fingerprint, sizeof(fingerprint));
+  if (!connection.Send(RenderMessage::Hello, hello, sizeof(hello)))
+  {
+    error = "lost the coordinator before the first job";
+    return false;
+  }
+
+  RenderMessage type;
+  std::vector<unsigned char> payload;
+  std::vector<unsigned char> result;
+  Framebuffer region;
+
+  while (connection.Receive(type, payload))
+  {
+    if (type == RenderMessage::Hello)
+    {
+      uint32_t version = 0;
+      std::memcpy(&version, payload.data(), std::min(payload.size(), sizeof(version)));
+      if (version != renderProtocolVersion)
+      {
+        error = "the coordinator speaks protocol version " + std::to_string(version);
+        return false;
+      }
+    }
+    else if (type == RenderMessage::Job && payload.size() == sizeof(RenderJob))
+    {
+      RenderJob job;
+      std::memcpy(&job, payload.data(), sizeof(job));
+      cam.RenderRegion(world, materials, lights, job.x0, job.y0, job.x1, job.y1, job.sampleBegin, job.sampleEnd, region);
+
+      double seconds = cam.Stats().renderSeconds;
+      size_t pixelBytes = size_t(region.Width()) * region.Height() * 3 * sizeof(float);
+      result.resize(sizeof(job.id) + sizeof(seconds) + pixelBytes);
+      std::memcpy(&result[0], &job.id, sizeof(job.id));
+      std::memcpy(&result[sizeof(job.id)], &seconds, sizeof(seconds));
+      std::memcpy(&result[sizeof(job.id) + sizeof(seconds)], region.Data(), pixelBytes);
+
+      if (!connection.Send(RenderMessage::Result, result.data(), result.size()))
+      {
+        break;
+      }
+    }
+    else if (type == RenderMessage::Quit)
+    {
+      break;
+    }
+  }
+
+  // A coordinator that goes away is done with us too, it may have kept another copy of the
+  // job we were rendering
+  return true;
+}
+
+class RenderCoordinator
+{
+  // Hands out the jobs of one image to local and remote workers and merges their tiles. Local
+  // workers are copies of this executable started with extra arguments, remote workers
+  // connect to the port given to Listen while the render runs
+
+public:
+  int    jobSize       = 64;   // Width and height in pixels of the tile of every job
+  int    sampleSplits  = 1;    // Sample ranges each tile's samples are split into
+  int    jobsInFlight  = 2;    // Jobs queued on a worker at once, so it never waits for the next
+  double workerTimeout = 300;  // Seconds a worker may go without returning a job before it is dropped
+
+  RenderCoordinator() {}
+  RenderCoordinator(const RenderCoordinator&) = delete;
+  RenderCoordinator& operator=(const RenderCoordinator&) = delete;
+
+  ~RenderCoordinator() { Shutdown(); }
+
+  void Shutdown()
+  {
+    // Tells every worker to quit and stops listening. Workers stay connected between renders
+    // until then
+    for (auto& worker : workers)
+    {
+      Drop(*worker, false);
+    }
+    workers.clear();
+
+    if (listener >= 0)
+    {
+      close(listener);
+    }
+    listener = -1;
+  }
+
+  bool StartLocalWorkers(int count, const std::string& executable, const std::vector<std::string>& arguments, std::string& error)
+  {
+    // Starts count copies of executable, each given arguments plus a --worker-fd option naming
+    // the socket that connects it to the coordinator
+    for (int k = 0; k < count; k++)
+    {
+      int ends[2];
+      if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, ends) != 0)
+      {
+        error = std::string("could not create a worker socket: ") + std::strerror(errno);
+        return false;
+      }
+
+      std::vector<std::string> workerArguments(1, executable);
+      workerArguments.insert(workerArguments.end(), arguments.begin(), arguments.end());
+      workerArguments.push_back("--worker-fd");
+      workerArguments.push_back(std::to_string(workerDescriptor));
+
+      std::vector<char*> argv;
+      for (std::string& argument : workerArguments)
+      {
+        argv.push_back(&argument[0]);
+      }
+      argv.push_back(nullptr);
+
+      pid_t pid = fork();
+      if (pid < 0)
+      {
+        close(ends[0]);
+        close(ends[1]);
+        error = std::string("could not start a worker: ") + std::strerror(errno);
+        return false;
+      }
+
+      if (pid == 0)
+      {
+        // Child: only its own end of the socket survives the exec, at the agreed descriptor
+        if (ends[1] == workerDescriptor)
+        {
+          fcntl(ends[1], F_SETFD, 0);
+        }
+        else
+        {
+          dup2(ends[1], workerDescriptor);
+        }
+        execv("/proc/self/exe", argv.data());
+        execvp(executable.c_str(), argv.data());
+        _exit(127);
+      }
+
+      close(ends[1]);
+      Add(ends[0], pid, "local worker " + std::to_string(pid));
+    }
+    return true;
+  }
+
+  bool Listen(const std::string& port, std::string& error)
+  {
+    // Accepts remote workers on a TCP port of every interface for as long as the coordinator
+    // lives
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    addrinfo* addresses = nullptr;
+    int status = getaddrinfo(nullptr, port.c_str(), &hints, &addresses);
+    if (status != 0)
+    {
+      error = gai_strerror(status);
+      return false;
+    }
+
+    // Prefer a dual-stack IPv6 socket, which takes IPv4 connections too
+    for (int pass = 0; pass < 2 && listener < 0; pass++)
+    {
+      for (addrinfo* a = addresses; a && listener < 0; a = a->ai_next)
+      {
+        if ((pass == 0) != (a->ai_family == AF_INET6))
+        {
+          continue;
+        }
+
+        listener = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+        int on = 1, off = 0;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (a->ai_family == AF_INET6)
+        {
+          setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        }
+
+        if (listener >= 0 && (bind(listener, a->ai_addr, a->ai_addrlen) != 0 || listen(listener, 16) != 0))
+        {
+          close(listener);
+          listener = -1;
+        }
+      }
+    }
+    freeaddrinfo(addresses);
+
+    if (listener < 0)
+    {
+      error = "could not listen on port " + port + ": " + std::strerror(errno);
+      return false;
+    }
+    return true;
+  }
+
+  bool Render(const Camera& cam, uint64_t fingerprint, Framebuffer& image, RenderStats& stats, std::string& error)
+  {
+    // Renders cam's image on the workers into image. Fails when every worker is gone and none
+    // can connect to replace them
+    auto renderStart = std::chrono::steady_clock::now();
+    stats = RenderStats();
+    expectedFingerprint = fingerprint;
+    progress = cam.progress;
+
+    int width = cam.imageWidth;
+    int height = cam.ImageHeight();
+    int samples = std::max(cam.samplesPerPixel, 1);
+    int size = std::max(jobSize, 1);
+    splits = std::min(std::max(sampleSplits, 1), samples);
+    int tilesX = (width + size - 1) / size;
+    int tilesY = (height + size - 1) / size;
+
+    // Job tile * splits + split takes the split-th sample range of the tile
+    jobs.clear();
+    pending.clear();
+    for (int tile = 0; tile < tilesX * tilesY; tile++)
+    {
+      for (int split = 0; split < splits; split++)
+      {
+        JobState state;
+        state.job.id = int32_t(jobs.size());
+        state.job.x0 = (tile % tilesX) * size;
+        state.job.y0 = (tile / tilesX) * size;
+        state.job.x1 = std::min(state.job.x0 + size, width);
+        state.job.y1 = std::min(state.job.y0 + size, height);
+        state.job.sampleBegin = int32_t(int64_t(samples) * split / splits);
+        state.job.sampleEnd = int32_t(int64_t(samples) * (split + 1) / splits);
+        pending.push_back(int(jobs.size()));
+        jobs.push_back(state);
+      }
+    }
+
+    image.Resize(width, height);
+    int jobsLeft = int(jobs.size());
+    int reportedLeft = -1;
+    std::vector<pollfd> polled;
+    RenderMessage type;
+    std::vector<unsigned char> payload;
+
+    while (jobsLeft > 0)
+    {
+      if (workers.empty() && listener < 0)
+      {
+        error = "every worker was lost with " + std::to_string(jobsLeft) + " jobs left";
+        return false;
+      }
+
+      for (auto& worker : workers)
+      {
+        Assign(*worker);
+      }
+      RemoveDropped();
+
+      if (jobsLeft != reportedLeft)
+      {
+        Report("\rJobs remaining: ", jobsLeft, " on ", workers.size(), " workers ");
+        reportedLeft = jobsLeft;
+      }
+
+      // Wait for results, with a timeout so stalled workers are noticed
+      polled.clear();
+      for (auto& worker : workers)
+      {
+        polled.push_back(pollfd{ worker->connection->Descriptor(), POLLIN, 0 });
+      }
+      if (listener >= 0)
+      {
+        polled.push_back(pollfd{ listener, POLLIN, 0 });
+      }
+
+      if (poll(polled.data(), nfds_t(polled.size()), 1000) < 0 && errno != EINTR)
+      {
+        error = std::string("could not wait for workers: ") + std::strerror(errno);
+        return false;
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      for (size_t w = 0; w < workers.size(); w++)
+      {
+        Worker& worker = *workers[w];
+        if (!(polled[w].revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+          if (!worker.running.empty() && std::chrono::duration<double>(now - worker.lastHeard).count() > workerTimeout)
+          {
+            Report("\r", worker.name, " stopped answering, dropping it\n");
+            Drop(worker, true);
+          }
+          continue;
+        }
+
+        if (!worker.connection->Receive(type, payload))
+        {
+          Report("\r", worker.name, " was lost, requeueing ", worker.running.size(), " jobs\n");
+          Drop(worker, true);
+          continue;
+        }
+
+        worker.lastHeard = now;
+        if (type == RenderMessage::Hello)
+        {
+          uint64_t fingerprint = 0;
+          uint32_t version = 0;
+          if (payload.size() >= sizeof(version) + sizeof(fingerprint))
+          {
+            std::memcpy(&version, payload.data(), sizeof(version));
+            std::memcpy(&fingerprint, payload.data() + sizeof(version), sizeof(fingerprint));
+          }
+
+          if (version != renderProtocolVersion || fingerprint != expectedFingerprint)
+          {
+            Report("\r", worker.name, " renders another scene or version, dropping it\n");
+            Drop(worker, true);
+            continue;
+          }
+          worker.ready = true;
+        }
+        else if (type == RenderMessage::Result && worker.ready)
+        {
+          if (!Accept(worker, payload, image, stats, jobsLeft))
+          {
+            Report("\r", worker.name, " sent a malformed result, dropping it\n");
+            Drop(worker, true);
+          }
+        }
+      }
+
+      // Dropped workers leave after the loop, so the poll entries line up until then
+      RemoveDropped();
+
+      if (listener >= 0 && (polled.back().revents & POLLIN))
+      {
+        int descriptor = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (descriptor >= 0)
+        {
+          int noDelay = 1;
+          setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+          Add(descriptor, -1, "remote worker " + std::to_string(++remoteCount));
+          Report("\r", workers.back()->name, " connected\n");
+        }
+      }
+    }
+
+    stats.renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+    Report("\rDone. ", samples, " samples per pixel from ", workers.size(), " workers      \n");
+    return true;
+  }
+
+private:
+  static const int workerDescriptor = 3;  // Where local workers find their socket
+  static const int maxCopies = 2;         // Workers a job may run on at once
+
+  struct JobState
+  {
+    RenderJob job;
+    int copies = 0;                  // Workers currently running the job
+    bool done = false;
+    std::vector<float> pixels;       // Result, kept until every split of its tile is in
+    std::chrono::steady_clock::time_point started;
+  };
+
+  struct Worker
+  {
+    std::unique_ptr<RenderConnection> connection;  // Null once the worker is dropped
+    pid_t pid = -1;                                // Local workers only
+    std::string name;
+    bool ready = false;                            // Said hello with the right fingerprint
+    std::vector<int> running;                      // Jobs sent and not returned yet
+    std::chrono::steady_clock::time_point lastHeard;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<JobState> jobs;
+  std::deque<int> pending;       // Jobs no worker is running
+  int splits = 1;                // Jobs of every tile in the current render
+  int listener = -1;
+  int remoteCount = 0;
+  uint64_t expectedFingerprint = 0;
+  std::function<void(const RenderProgress&)> progress;  // The camera's, for the current render
+
+  void Add(int descriptor, pid_t pid, const std::string& name)
+  {
+    std::unique_ptr<Worker> worker(new Worker());
+    worker->connection.reset(new RenderConnection(descriptor));
+    worker->connection->SetReceiveTimeout(30);  // A message that starts arriving finishes soon
+    worker->pid = pid;
+    worker->name = name;
+    worker->lastHeard = std::chrono::steady_clock::now();
+
+    uint32_t hello[3] = { renderProtocolVersion, 0, 0 };
+    worker->connection->Send(RenderMessage::Hello, hello, sizeof(hello));
+    workers.push_back(std::move(worker));
+  }
+
+  void Drop(Worker& worker, bool requeue)
+  {
+    // Closes a worker's connection and puts its unfinished jobs back at the front of the queue
+    if (!worker.connection)
+    {
+      return;
+    }
+
+    worker.connection->Send(RenderMessage::Quit, nullptr, 0);
+    worker.connection.reset();
+
+    for (int id : worker.running)
+    {
+      JobState& state = jobs[id];
+      if (!state.done && --state.copies == 0 && requeue)
+      {
+        pending.push_front(id);
+      }
+    }
+    worker.running.clear();
+
+    if (worker.pid > 0)
+    {
+      // A local worker that doesn't quit within a second is stopped
+      bool exited = false;
+      for (int wait = 0; wait < 100 && !exited; wait++)
+      {
+        exited = waitpid(worker.pid, nullptr, WNOHANG) != 0;
+        if (!exited)
+        {
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+      }
+      if (!exited)
+      {
+        kill(worker.pid, SIGKILL);
+        waitpid(worker.pid, nullptr, 0);
+      }
+      worker.pid = -1;
+    }
+  }
+
+  template <class... Parts>
+  void Report(const Parts&... parts) const
+  {
+    // Hands progress a status line, the way the camera reports its own
+    if (progress)
+    {
+      std::ostringstream line;
+      (line << ... << parts);
+      progress(RenderProgress{ 0, 0, 0, line.str() });
+    }
+  }
+
+  void RemoveDropped()
+  {
+    size_t kept = 0;
+    for (size_t w = 0; w < workers.size(); w++)
+    {
+      if (workers[w]->connection)
+      {
+        workers[kept++] = std::move(workers[w]);
+      }
+    }
+    workers.resize(kept);
+  }
+
+  void Assign(Worker& worker)
+  {
+    // Tops up a ready worker's queue from the pending jobs. An idle worker facing an empty
+    // queue takes a copy of the job that has been running longest instead
+    while (worker.connection && worker.ready && int(worker.running.size()) < std::max(jobsInFlight, 1))
+    {
+      int id = -1;
+      while (!pending.empty() && id < 0)
+      {
+        id = pending.front();
+        pending.pop_front();
+        id = jobs[id].done ? -1 : id;
+      }
+
+      if (id < 0 && worker.running.empty())
+      {
+        for (const JobState& state : jobs)
+        {
+          if (!state.done && state.copies > 0 && state.copies < maxCopies &&
+              (id < 0 || state.started < jobs[id].started))
+          {
+            id = state.job.id;
+          }
+        }
+      }
+
+      if (id < 0)
+      {
+        return;
+      }
+
+      // The timeout runs from the first job of an idle worker
+      auto now = std::chrono::steady_clock::now();
+      worker.lastHeard = worker.running.empty() ? now : worker.lastHeard;
+
+      JobState& state = jobs[id];
+      if (state.copies++ == 0)
+      {
+        state.started = now;
+      }
+      worker.running.push_back(id);
+
+      if (!worker.connection->Send(RenderMessage::Job, &state.job, sizeof(state.job)))
+      {
+        Report("\r", worker.name, " was lost, requeueing ", worker.running.size(), " jobs\n");
+        Drop(worker, true);
+      }
+    }
+  }
+
+  bool Accept(Worker& worker, const std::vector<unsigned char>& payload, Framebuffer& image, RenderStats& stats, int& jobsLeft)
+  {
+    // Takes a result, the first to come back for its job, and merges its tile once every
+    // sample range of the tile is in. Ranges are added in order, so the image doesn't depend
+    // on which came back first
+    int32_t id;
+    double seconds;
+    if (payload.size() < sizeof(id) + sizeof(seconds))
+    {
+      return false;
+    }
+    std::memcpy(&id, payload.data(), sizeof(id));
+    std::memcpy(&seconds, payload.data() + sizeof(id), sizeof(seconds));
+
+    auto running = std::find(worker.running.begin(), worker.running.end(), id);
+    if (running == worker.running.end())
+    {
+      return false;
+    }
+
+    // A malformed result leaves the job with the worker, so dropping the worker requeues it
+    JobState& state = jobs[id];
+    const RenderJob& job = state.job;
+    size_t floatCount = size_t(job.x1 - job.x0) * (job.y1 - job.y0) * 3;
+    if (payload.size() != sizeof(id) + sizeof(seconds) + floatCount * sizeof(float))
+    {
+      return false;
+    }
+
+    worker.running.erase(running);
+    state.copies--;
+    if (state.done)
+    {
+      return true;
+    }
+
+    state.done = true;
+    state.pixels.resize(floatCount);
+    std::memcpy(state.pixels.data(), payload.data() + sizeof(id) + sizeof(seconds), floatCount * sizeof(float));
+    stats.AddTile(seconds);
+    jobsLeft--;
+
+    int first = id - id % splits;
+    int last = first + splits;
+
+    for (int k = first; k < last; k++)
+    {
+      if (!jobs[k].done)
+      {
+        return true;
+      }
+    }
+
+    int tileWidth = job.x1 - job.x0;
+    for (int k = first; k < last; k++)
+    {
+      const float* source = jobs[k].pixels.data();
+      for (int j = job.y0; j < job.y1; j++)
+      {
+        float* row = image.Data() + (size_t(j) * image.Width() + job.x0) * 3;
+        for (int c = 0; c < tileWidth * 3; c++)
+        {
+          row[c] += *source++;
+        }
+      }
+      std::vector<float>().swap(jobs[k].pixels);
+    }
+    return true;
+  }
+};
+
+#else
+
+// Windows builds have no workers: every entry point reports that
+
+inline int ConnectToCoordinator(const std::string&, std::string& error)
+{
+  error = "distributed rendering needs POSIX sockets";
+  return -1;
+}
+
+inline bool RunRenderWorker(int, Camera&, const Hittable&, const MaterialTable&, const LightList&, std::string& error)
+{
+  error = "distributed rendering needs POSIX sockets";
+  return false;
+}
+
+class RenderCoordinator
+{
+public:
+  int    jobSize       = 64;
+  int    sampleSplits  = 1;
+  int    jobsInFlight  = 2;
+  double workerTimeout = 300;
+
+  bool StartLocalWorkers(int, const std::string&, const std::vector<std::string>&, std::string& error)
+  {
+    error = "distributed rendering needs POSIX sockets";
+    return false;
+  }
+
+  bool Listen(const std::string&, std::string& error)
+  {
+    error = "distributed rendering needs POSIX sockets";
+    return false;
+  }
+
+  bool Render(const Camera&, uint64_t, Framebuffer&, RenderStats&, std::string& error)
+  {
+    error = "distributed rendering needs POSIX sockets";
+    return false;
+  }
+};
+
+#endif // _WIN32
+
+#endif // DISTRIBUTED_H
\ No newline at end of file
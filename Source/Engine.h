@@ -4,10 +4,19 @@
 #define ENGINE_H
 
 #include <cmath>
-#include <random>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include "Rng.h"
+
+// Scalar type of geometry and color math. Builds configured with ENGINE_USE_FLOAT render in
+// single precision, which doubles the SIMD width and halves the size of geometry arrays
+
+#if ENGINE_USE_FLOAT
+using Real = float;
+#else
+using Real = double;
+#endif
 
 // Constants
 
@@ -26,18 +35,16 @@ inline double RadToDeg(double radians)
   return radians * 180.0 / pi;
 }
 
-inline double RandomDouble()
+inline double RandomDouble(Rng& rng)
 {
   // Returns a random real in [0,1)
-  static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-  static std::mt19937 generator;
-  return distribution(generator);
+  return rng.NextDouble();
 }
 
-inline double RandomDouble(double min, double max)
+inline double RandomDouble(double min, double max, Rng& rng)
 {
   // Returns a random real in [min, max)
-  return min + (max - min) * RandomDouble();
+  return min + (max - min) * RandomDouble(rng);
 }
 
 // Common Headers
@@ -46,5 +53,6 @@ inline double RandomDouble(double min, double max)
 #include "Interval.h"
 #include "Ray.h"
 #include "Vec3.h"
+#include "Sampling.h"
 
 #endif // ENGINE_H
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+
+#ifndef FEATURES_H
+#define FEATURES_H
+
+#include "Color.h"
+#include "Framebuffer.h"
+
+// Feature (auxiliary) buffers: what the camera rays see, without any of the lighting noise.
+// The denoiser uses them to tell edges in the scene from noise, see Denoiser.h. Albedo and
+// normal are taken through mirrors and glass, from the first surface seen in them
+
+struct SampleFeatures
+{
+  Color  albedo = Color(0, 0, 0);  // Surface color, emission clamped to 1 on lights. Black where the path escaped
+  Vec3   normal = Vec3(0, 0, 0);   // Unit normal facing the ray. Zero where the path escaped
+  double depth = 0;                // Distance along the camera ray to its hit. Zero where it escaped
+};
+
+struct FeatureBuffers
+{
+  // Every feature averaged over the samples of each pixel, and how noisy the pixel is. Depth
+  // and variance are repeated in all three channels so every buffer can be written like an
+  // image
+  Framebuffer albedo;
+  Framebuffer normal;
+  Framebuffer depth;
+  Framebuffer variance;  // Variance of the pixel's mean luminance, estimated from its samples
+};
+
+#endif // FEATURES_H
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <vector>
+#include "Color.h"
+
+class Framebuffer
+{
+  // Linear RGB image in single precision, row-major from the top left pixel. Renderers write
+  // into it and the output stage encodes the whole buffer at once
+
+public:
+  Framebuffer() {}
+
+  Framebuffer(int width, int height) { Resize(width, height); }
+
+  void Resize(int newWidth, int newHeight)
+  {
+    // Resizes the buffer and clears every pixel to black
+    width = newWidth;
+    height = newHeight;
+    pixels.assign(size_t(width) * height * 3, 0.0f);
+  }
+
+  int Width() const  { return width; }
+  int Height() const { return height; }
+
+  void Set(int i, int j, const Color& pixelColor)
+  {
+    float* p = &pixels[(size_t(j) * width + i) * 3];
+    p[0] = float(pixelColor.X());
+    p[1] = float(pixelColor.Y());
+    p[2] = float(pixelColor.Z());
+  }
+
+  Color Get(int i, int j) const
+  {
+    const float* p = &pixels[(size_t(j) * width + i) * 3];
+    return Color(p[0], p[1], p[2]);
+  }
+
+  const float* Data() const { return pixels.data(); }
+  float* Data()             { return pixels.data(); }
+
+private:
+  int width = 0;
+  int height = 0;
+  std::vector<float> pixels;
+};
+
+#endif // FRAMEBUFFER_H
\ No newline at end of file
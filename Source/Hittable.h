@@ -3,16 +3,28 @@
 #ifndef HITTABLE_H
 #define HITTABLE_H
 
+#include "AABB.h"
 #include "Ray.h"
+#include "RenderStats.h"
 
-class Material;
+class Hittable;
+
+// Index of a material in the scene's MaterialTable
+using MaterialId = int;
 
 struct HitRecord
 {
+  // Closest-hit searches only fill t, object, primitive, instanced and material. The point,
+  // normal and error bound are filled once the final hit is known, by rec.object->CompleteHit
+
+  Real t;
+  const Hittable* object;     // Primitive that was hit
+  int primitive;              // Index of the primitive inside object, for primitive groups
+  const Hittable* instanced;  // Object hit inside an Instance, when object is the Instance
+  MaterialId material;
   Point3 p;
   Vec3 normal;
-  std::shared_ptr<Material> material;
-  double t;
+  Real pError;                // Bound on the rounding error of p, see OffsetRayOrigin
   bool frontFace;
 
   void SetFaceNormal(const Ray& r, const Vec3& outwardNormal)
@@ -23,6 +35,12 @@ struct HitRecord
     frontFace = Dot(r.Direction(), outwardNormal) < 0;
     normal = frontFace ? outwardNormal : -outwardNormal;
   }
+
+  Ray SpawnRay(const Vec3& direction) const
+  {
+    // Ray leaving the surface at p, starting far enough off it to never hit it again
+    return Ray(OffsetRayOrigin(p, pError, normal, direction), direction);
+  }
 };
 
 class Hittable
@@ -30,7 +48,14 @@ class Hittable
 public:
   virtual ~Hittable() = default;
 
+  // Finds the closest hit inside rayT. rec is only written when a hit is found
   virtual bool Hit(const Ray& r, Interval rayT, HitRecord& rec) const = 0;
+
+  // Fills the surface point and normal of a hit found by Hit. Aggregates never report
+  // themselves as the object hit, so they don't need to override this
+  virtual void CompleteHit(const Ray& r, HitRecord& rec) const {}
+
+  virtual AABB BoundingBox() const = 0;
 };
 
 #endif // HITTABLE_H
\ No newline at end of file
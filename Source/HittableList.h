@@ -15,31 +15,50 @@ public:
   HittableList() {}
   HittableList(std::shared_ptr<Hittable> object) { Add(object); }
 
-  void Clear() { objects.clear(); }
+  void Clear()
+  {
+    objects.clear();
+    bbox = AABB();
+  }
 
   void Add(std::shared_ptr<Hittable> object)
   {
     objects.push_back(object);
+    bbox = AABB(bbox, object->BoundingBox());
+  }
+
+  void UpdateBounds()
+  {
+    // Recomputes the bounding box after objects in the list moved
+    bbox = AABB();
+    for (const auto& object : objects)
+    {
+      bbox = AABB(bbox, object->BoundingBox());
+    }
   }
 
   bool Hit(const Ray& r, Interval rayT, HitRecord& rec) const override
   {
-    HitRecord tempRec;
+    // Objects only write rec when they find a closer hit, so there is nothing to copy back
     bool hitAnything = false;
     auto closestSoFar = rayT.max;
 
     for (const auto& object : objects)
     {
-      if (object->Hit(r, Interval(rayT.min, closestSoFar), tempRec))
+      if (object->Hit(r, Interval(rayT.min, closestSoFar), rec))
       {
         hitAnything = true;
-        closestSoFar = tempRec.t;
-        rec = tempRec;
+        closestSoFar = rec.t;
       }
     }
 
     return hitAnything;
   }
+
+  AABB BoundingBox() const override { return bbox; }
+
+private:
+  AABB bbox;
 };
 
 #endif // HITTABLE_LIST_H
\ No newline at end of file
@@ -0,0 +1,457 @@
+#pragma once
+
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Color.h"
+#include "Framebuffer.h"
+
+enum class ImageFormat
+{
+  PPM,  // Binary (P6) portable pixmap, 8 bits per channel, gamma encoded
+  PNG,  // Deflate-compressed RGB, 8 bits per channel, gamma encoded
+  PFM   // Portable float map, linear 32-bit float per channel for tone mapping and compositing
+};
+
+inline bool ImageFormatFromName(std::string name, ImageFormat& format)
+{
+  // Accepts a format name or file extension, case insensitive and with or without the dot
+  if (!name.empty() && name[0] == '.')
+  {
+    name = name.substr(1);
+  }
+  for (auto& c : name)
+  {
+    c = char(std::tolower((unsigned char)c));
+  }
+
+  if (name == "ppm") { format = ImageFormat::PPM; return true; }
+  if (name == "png") { format = ImageFormat::PNG; return true; }
+  if (name == "pfm") { format = ImageFormat::PFM; return true; }
+  return false;
+}
+
+inline ImageFormat ImageFormatFromPath(const std::string& path)
+{
+  // Picks the format from the file extension, falling back to PPM
+  ImageFormat format = ImageFormat::PPM;
+  auto dot = path.find_last_of('.');
+  if (dot != std::string::npos)
+  {
+    ImageFormatFromName(path.substr(dot), format);
+  }
+  return format;
+}
+
+class ImageEncoder
+{
+  // Encodes a whole framebuffer into one memory block, so writing it out is a single bulk
+  // write instead of one formatted write per pixel
+
+public:
+  static std::vector<unsigned char> Encode(const Framebuffer& image, ImageFormat format)
+  {
+    switch (format)
+    {
+      case ImageFormat::PNG: return EncodePNG(image);
+      case ImageFormat::PFM: return EncodePFM(image);
+      default:               return EncodePPM(image);
+    }
+  }
+
+private:
+  static void Append(std::vector<unsigned char>& out, const std::string& text)
+  {
+    out.insert(out.end(), text.begin(), text.end());
+  }
+
+  static void AppendBigEndian(std::vector<unsigned char>& out, uint32_t value)
+  {
+    out.push_back((unsigned char)(value >> 24));
+    out.push_back((unsigned char)(value >> 16));
+    out.push_back((unsigned char)(value >> 8));
+    out.push_back((unsigned char)(value));
+  }
+
+  static std::vector<unsigned char> GammaBytes(const Framebuffer& image)
+  {
+    std::vector<unsigned char> bytes(size_t(image.Width()) * image.Height() * 3);
+    const float* pixels = image.Data();
+
+    for (size_t p = 0; p < bytes.size(); p += 3)
+    {
+      ColorToBytes(Color(pixels[p], pixels[p + 1], pixels[p + 2]), &bytes[p]);
+    }
+
+    return bytes;
+  }
+
+  static std::vector<unsigned char> EncodePPM(const Framebuffer& image)
+  {
+    std::vector<unsigned char> out;
+    Append(out, "P6\n" + std::to_string(image.Width()) + ' ' + std::to_string(image.Height()) + "\n255\n");
+
+    auto bytes = GammaBytes(image);
+    out.insert(out.end(), bytes.begin(), bytes.end());
+    return out;
+  }
+
+  static std::vector<unsigned char> EncodePFM(const Framebuffer& image)
+  {
+    // A negative scale marks little-endian floats. Rows are stored from the bottom up
+    std::vector<unsigned char> out;
+    Append(out, "PF\n" + std::to_string(image.Width()) + ' ' + std::to_string(image.Height()) + "\n-1.0\n");
+
+    size_t rowBytes = size_t(image.Width()) * 3 * sizeof(float);
+    size_t header = out.size();
+    out.resize(header + rowBytes * image.Height());
+
+    for (int j = 0; j < image.Height(); j++)
+    {
+      const float* row = image.Data() + size_t(image.Height() - 1 - j) * image.Width() * 3;
+      unsigned char* dst = &out[header + rowBytes * j];
+
+      for (size_t k = 0; k < size_t(image.Width()) * 3; k++)
+      {
+        uint32_t bits;
+        std::memcpy(&bits, &row[k], sizeof(bits));
+        dst[4 * k + 0] = (unsigned char)(bits);
+        dst[4 * k + 1] = (unsigned char)(bits >> 8);
+        dst[4 * k + 2] = (unsigned char)(bits >> 16);
+        dst[4 * k + 3] = (unsigned char)(bits >> 24);
+      }
+    }
+
+    return out;
+  }
+
+  // PNG
+
+  static uint32_t Crc32(const unsigned char* data, size_t length, uint32_t crc = 0)
+  {
+    static const std::vector<uint32_t> table = []
+    {
+      std::vector<uint32_t> entries(256);
+      for (uint32_t n = 0; n < 256; n++)
+      {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+        {
+          c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        entries[n] = c;
+      }
+      return entries;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+    {
+      crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+  }
+
+  static void AppendChunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data)
+  {
+    AppendBigEndian(out, uint32_t(data.size()));
+    size_t typeStart = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    AppendBigEndian(out, Crc32(&out[typeStart], out.size() - typeStart));
+  }
+
+  static std::vector<unsigned char> EncodePNG(const Framebuffer& image)
+  {
+    int width = image.Width();
+    int height = image.Height();
+    auto bytes = GammaBytes(image);
+
+    // Filter every scanline with whichever of the Sub and Up filters leaves the smallest
+    // residuals, which is what makes rendered gradients compress well
+    size_t stride = size_t(width) * 3;
+    std::vector<unsigned char> filtered((stride + 1) * height);
+
+    for (int j = 0; j < height; j++)
+    {
+      const unsigned char* row = &bytes[stride * j];
+      const unsigned char* above = (j > 0) ? row - stride : nullptr;
+
+      long subCost = 0, upCost = 0;
+      for (size_t k = 0; k < stride; k++)
+      {
+        unsigned char sub = (unsigned char)(row[k] - (k >= 3 ? row[k - 3] : 0));
+        unsigned char up = (unsigned char)(row[k] - (above ? above[k] : 0));
+        subCost += (sub < 128) ? sub : 256 - sub;
+        upCost += (up < 128) ? up : 256 - up;
+      }
+
+      unsigned char* dst = &filtered[(stride + 1) * j];
+      bool useUp = upCost < subCost;
+      dst[0] = useUp ? 2 : 1;
+      for (size_t k = 0; k < stride; k++)
+      {
+        dst[k + 1] = useUp ? (unsigned char)(row[k] - (above ? above[k] : 0))
+                           : (unsigned char)(row[k] - (k >= 3 ? row[k - 3] : 0));
+      }
+    }
+
+    std::vector<unsigned char> header;
+    AppendBigEndian(header, uint32_t(width));
+    AppendBigEndian(header, uint32_t(height));
+    header.push_back(8);  // Bit depth
+    header.push_back(2);  // Color type: RGB
+    header.push_back(0);  // Compression: deflate
+    header.push_back(0);  // Filter method: adaptive
+    header.push_back(0);  // No interlacing
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    std::vector<unsigned char> out(signature, signature + 8);
+    AppendChunk(out, "IHDR", header);
+    AppendChunk(out, "IDAT", Zlib(filtered));
+    AppendChunk(out, "IEND", std::vector<unsigned char>());
+    return out;
+  }
+
+  class BitWriter
+  {
+  public:
+    std::vector<unsigned char>& out;
+    uint32_t buffer = 0;
+    int bitCount = 0;
+
+    explicit BitWriter(std::vector<unsigned char>& out) : out(out) {}
+
+    void Write(uint32_t bits, int count)
+    {
+      // Deflate packs fields starting from the least significant bit
+      buffer |= bits << bitCount;
+      bitCount += count;
+      while (bitCount >= 8)
+      {
+        out.push_back((unsigned char)buffer);
+        buffer >>= 8;
+        bitCount -= 8;
+      }
+    }
+
+    void WriteCode(uint32_t code, int length)
+    {
+      // Huffman codes are stored most significant bit first
+      uint32_t reversed = 0;
+      for (int i = 0; i < length; i++)
+      {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+      }
+      Write(reversed, length);
+    }
+
+    void Flush()
+    {
+      if (bitCount > 0)
+      {
+        out.push_back((unsigned char)buffer);
+      }
+      buffer = 0;
+      bitCount = 0;
+    }
+  };
+
+  static void WriteLiteral(BitWriter& bits, int symbol)
+  {
+    // Fixed Huffman code of a literal/length symbol (RFC 1951, 3.2.6)
+    if (symbol < 144)      bits.WriteCode(0x30 + symbol, 8);
+    else if (symbol < 256) bits.WriteCode(0x190 + (symbol - 144), 9);
+    else if (symbol < 280) bits.WriteCode(symbol - 256, 7);
+    else                   bits.WriteCode(0xc0 + (symbol - 280), 8);
+  }
+
+  static void WriteMatch(BitWriter& bits, int length, int distance)
+  {
+    static const int lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const int lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                         3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const int distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                          257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                          8193, 12289, 16385, 24577 };
+    static const int distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                           7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    int l = 28;
+    while (lengthBase[l] > length) l--;
+    WriteLiteral(bits, 257 + l);
+    bits.Write(uint32_t(length - lengthBase[l]), lengthExtra[l]);
+
+    int d = 29;
+    while (distanceBase[d] > distance) d--;
+    bits.WriteCode(uint32_t(d), 5);
+    bits.Write(uint32_t(distance - distanceBase[d]), distanceExtra[d]);
+  }
+
+  static std::vector<unsigned char> Zlib(const std::vector<unsigned char>& data)
+  {
+    // Single fixed-Huffman deflate block with greedy LZ77 matching against the most recent
+    // position of every 3-byte hash. Not as tight as zlib, but fast and dependency free
+
+    static const int windowSize = 32768;
+    static const int maxMatch = 258;
+    static const int hashBits = 15;
+
+    std::vector<unsigned char> out;
+    out.push_back(0x78);  // Deflate with a 32K window
+    out.push_back(0x01);  // Fastest compression level, header check bits
+
+    BitWriter bits(out);
+    bits.Write(1, 1);  // Final block
+    bits.Write(1, 2);  // Fixed Huffman codes
+
+    std::vector<int> head(size_t(1) << hashBits, -1);
+    size_t size = data.size();
+    size_t pos = 0;
+
+    while (pos < size)
+    {
+      int bestLength = 0;
+      int bestDistance = 0;
+
+      if (pos + 3 <= size)
+      {
+        uint32_t hash = ((uint32_t(data[pos]) << 16) | (uint32_t(data[pos + 1]) << 8) | data[pos + 2]) * 2654435761u;
+        hash >>= (32 - hashBits);
+
+        int candidate = head[hash];
+        head[hash] = int(pos);
+
+        if (candidate >= 0 && int(pos) - candidate <= windowSize)
+        {
+          size_t limit = std::min(size - pos, size_t(maxMatch));
+          size_t length = 0;
+          while (length < limit && data[candidate + length] == data[pos + length])
+          {
+            length++;
+          }
+
+          if (length >= 3)
+          {
+            bestLength = int(length);
+            bestDistance = int(pos) - candidate;
+          }
+        }
+      }
+
+      if (bestLength > 0)
+      {
+        WriteMatch(bits, bestLength, bestDistance);
+        pos += bestLength;
+      }
+      else
+      {
+        WriteLiteral(bits, data[pos]);
+        pos++;
+      }
+    }
+
+    WriteLiteral(bits, 256);  // End of block
+    bits.Flush();
+
+    // Adler-32 checksum of the uncompressed data
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+      a = (a + data[i]) % 65521;
+      b = (b + a) % 65521;
+    }
+    AppendBigEndian(out, (b << 16) | a);
+
+    return out;
+  }
+};
+
+inline bool WriteImage(const Framebuffer& image, std::ostream& out, ImageFormat format)
+{
+  auto encoded = ImageEncoder::Encode(image, format);
+  out.write(reinterpret_cast<const char*>(encoded.data()), std::streamsize(encoded.size()));
+  out.flush();
+  return bool(out);
+}
+
+inline bool WriteImage(const Framebuffer& image, const std::string& path, ImageFormat format)
+{
+  std::ofstream file(path, std::ios::binary);
+  if (!file)
+  {
+    return false;
+  }
+  return WriteImage(image, file, format);
+}
+
+inline bool WriteImage(const Framebuffer& image, const std::string& path)
+{
+  return WriteImage(image, path, ImageFormatFromPath(path));
+}
+
+class AsyncImageWriter
+{
+  // Encodes and writes images on a thread of its own, so a renderer can start on the next
+  // frame while the last one is written. One image is written at a time: a new write first
+  // waits for the one before it
+
+public:
+  AsyncImageWriter() {}
+  AsyncImageWriter(const AsyncImageWriter&) = delete;
+  AsyncImageWriter& operator=(const AsyncImageWriter&) = delete;
+
+  ~AsyncImageWriter() { Finish(); }
+
+  void Write(Framebuffer& image, const std::string& path, ImageFormat format)
+  {
+    // Takes the image's pixels, leaving image with the buffer of an earlier write to render
+    // into, so no frame is copied. Failures are reported by Finish
+    Wait();
+    std::swap(image, pending);
+    writer = std::thread([this, path, format]()
+    {
+      if (!WriteImage(pending, path, format))
+      {
+        failedPath = failedPath.empty() ? path : failedPath;
+      }
+    });
+  }
+
+  bool Finish(std::string* failed = nullptr)
+  {
+    // Waits for the last write. Returns false if any write failed, and names the first one
+    Wait();
+    if (failed)
+    {
+      *failed = failedPath;
+    }
+    return failedPath.empty();
+  }
+
+private:
+  std::thread writer;
+  Framebuffer pending;
+  std::string failedPath;
+
+  void Wait()
+  {
+    if (writer.joinable())
+    {
+      writer.join();
+    }
+  }
+};
+
+#endif // IMAGE_WRITER_H
\ No newline at end of file
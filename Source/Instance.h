@@ -0,0 +1,90 @@
+#pragma once
+
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "Hittable.h"
+#include "Transform.h"
+
+class Instance : public Hittable
+{
+  // A shared object placed in the scene with an affine transform. Rays are moved into object
+  // space to hit the object, and the hit is moved back out, so any number of instances share
+  // one copy of the object and its acceleration structure. Put instances in a BVH to get a
+  // two-level hierarchy: the BVH over the instances on top, each object's own below.
+  //
+  // Instances don't own their object, which must outlive them. A Scene keeps both in its
+  // arena, so an instance costs no reference count and no allocation of its own
+
+public:
+  static const MaterialId keepMaterial = -1;
+
+  Instance(const Hittable& object, const Transform& objectToWorld, MaterialId material = keepMaterial) :
+    object(&object), objectToWorld(objectToWorld), material(material)
+  {
+    // Instances of instances collapse into one instance of the innermost object, since a hit
+    // record only remembers one instanced object
+    auto inner = dynamic_cast<const Instance*>(&object);
+    if (inner)
+    {
+      this->object = inner->object;
+      this->objectToWorld = objectToWorld * inner->objectToWorld;
+      this->material = (material == keepMaterial) ? inner->material : material;
+    }
+
+    SetTransform(this->objectToWorld);
+  }
+
+  const Transform& ObjectToWorld() const { return objectToWorld; }
+
+  void SetTransform(const Transform& newObjectToWorld)
+  {
+    // Moves the instance. The transform maps from the innermost object, when the instance was
+    // made from another one. Whatever holds the instance must be refit before the next render,
+    // see BVH::Refit
+    objectToWorld = newObjectToWorld;
+    worldToObject = objectToWorld.Inverse();
+    bbox = objectToWorld.ApplyBox(object->BoundingBox());
+  }
+
+  bool Hit(const Ray& r, Interval rayT, HitRecord& rec) const override
+  {
+    if (!object->Hit(worldToObject.ApplyRay(r), rayT, rec))
+    {
+      return false;
+    }
+
+    rec.instanced = rec.object;
+    rec.object = this;
+    if (material != keepMaterial)
+    {
+      rec.material = material;
+    }
+
+    return true;
+  }
+
+  void CompleteHit(const Ray& r, HitRecord& rec) const override
+  {
+    // The object completes the hit in its own space. Normals go back out through the inverse
+    // transpose, which keeps which side the ray came from, and the point's error bound grows
+    // by the stretch of the transform plus the rounding of applying it
+    rec.instanced->CompleteHit(worldToObject.ApplyRay(r), rec);
+
+    rec.p = objectToWorld.ApplyPoint(rec.p);
+    rec.normal = Normalized(worldToObject.ApplyTransposed(rec.normal));
+    rec.pError = objectToWorld.MaxStretch() * rec.pError
+               + PointError(std::fabs(rec.p.X()) + std::fabs(rec.p.Y()) + std::fabs(rec.p.Z()));
+  }
+
+  AABB BoundingBox() const override { return bbox; }
+
+private:
+  const Hittable* object;
+  Transform objectToWorld;
+  Transform worldToObject;
+  MaterialId material;
+  AABB bbox;
+};
+
+#endif // INSTANCE_H
\ No newline at end of file
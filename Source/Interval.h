@@ -3,41 +3,57 @@
 #ifndef INTERVAL_H
 #define INTERVAL_H
 
-class Interval
+template <typename T>
+class IntervalT
 {
 public:
-    double min, max;
+    T min, max;
 
-    Interval() : min(+infinity), max(-infinity) {} // Default interval is empty
+    IntervalT() : min(+infinity), max(-infinity) {} // Default interval is empty
 
-    Interval(double min, double max) : min(min), max(max) {}
+    IntervalT(T min, T max) : min(min), max(max) {}
 
-    double Size() const
+    IntervalT(const IntervalT& a, const IntervalT& b)
+    {
+        // Create the interval tightly enclosing the two input intervals
+        min = a.min <= b.min ? a.min : b.min;
+        max = a.max >= b.max ? a.max : b.max;
+    }
+
+    T Size() const
     {
         return max - min;
     }
 
-    bool Contains(double x) const
+    bool Contains(T x) const
     {
         return min <= x && x <= max;
     }
 
-    bool Surrounds(double x) const
+    bool Surrounds(T x) const
     {
         return min < x && x < max;
     }
 
-    double Clamp(double x) const
+    T Clamp(T x) const
     {
         if (x < min) return min;
         if (x > max) return max;
         return x;
     }
 
-    static const Interval empty, universe;
+    IntervalT Expand(T delta) const
+    {
+        auto padding = delta / 2;
+        return IntervalT(min - padding, max + padding);
+    }
+
+    static const IntervalT empty, universe;
 };
 
-const Interval Interval::empty    = Interval(+infinity, -infinity);
-const Interval Interval::universe = Interval(-infinity, +infinity);
+template <typename T> const IntervalT<T> IntervalT<T>::empty    = IntervalT<T>(+infinity, -infinity);
+template <typename T> const IntervalT<T> IntervalT<T>::universe = IntervalT<T>(-infinity, +infinity);
+
+using Interval = IntervalT<Real>;
 
 #endif // INTERVAL_H
\ No newline at end of file
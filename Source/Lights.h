@@ -0,0 +1,146 @@
+#pragma once
+
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include <map>
+#include <utility>
+#include <vector>
+#include "Hittable.h"
+#include "Material.h"
+#include "Sampler.h"
+#include "SphereSoA.h"
+
+struct LightSample
+{
+  Vec3 direction;  // Unit direction from the shaded point toward the light
+  Real distance;   // Distance to the light's surface along direction
+  double pdf;      // Density of direction over solid angle, light choice included
+  int light;       // Index in the LightList
+};
+
+class LightList
+{
+  // Emissive spheres the integrator aims shadow rays at. Each light remembers the object and
+  // primitive the world reports when a ray hits it, so a path that finds a light on its own
+  // can tell which one it is and weigh the hit against the light's sampling density. The
+  // list must be built from the same world that is rendered
+
+public:
+  void Add(const Hittable* object, int primitive, const Point3& center, Real radius, MaterialId material)
+  {
+    if (radius <= 0)
+    {
+      return;
+    }
+
+    lookup[std::make_pair(object, primitive)] = int(lights.size());
+    lights.push_back(SphereLight{ center, radius, material });
+  }
+
+  void AddEmissiveSpheres(const SphereSoA& spheres, const MaterialTable& materials)
+  {
+    // Adds every sphere with an emissive material. Spheres are looked up by their index, so
+    // the SphereSoA must already be built
+    for (int i = 0; i < spheres.Size(); i++)
+    {
+      Point3 center;
+      Real radius;
+      MaterialId material;
+      spheres.Get(i, center, radius, material);
+
+      if (materials[material].Type() == MaterialType::DiffuseLight)
+      {
+        Add(&spheres, i, center, radius, material);
+      }
+    }
+  }
+
+  int Size() const { return int(lights.size()); }
+  bool Empty() const { return lights.empty(); }
+
+  MaterialId MaterialOf(int light) const { return lights[light].material; }
+
+  int Find(const HitRecord& rec) const
+  {
+    // Index of the light rec hit, or -1 when it is not in the list
+    auto found = lookup.find(std::make_pair(rec.object, rec.primitive));
+    return (found == lookup.end()) ? -1 : found->second;
+  }
+
+  bool Sample(const Point3& p, Sampler& sampler, LightSample& sample) const
+  {
+    // Picks a light uniformly, then a direction uniformly inside the cone the light's sphere
+    // fills as seen from p. Fails when p is inside the sphere, which sees all of it
+    int light = std::min(int(sampler.Get1D() * lights.size()), Size() - 1);
+    const SphereLight& sphere = lights[light];
+
+    double u1, u2;
+    sampler.Get2D(u1, u2);
+
+    Vec3 toCenter = sphere.center - p;
+    double distanceSquared = toCenter.LengthSquared();
+    double oneMinusCos = ConeOneMinusCos(distanceSquared, sphere.radius);
+    if (oneMinusCos <= 0)
+    {
+      return false;
+    }
+
+    // Uniform in the cone: cos(theta) is uniform between 1 and cos(thetaMax)
+    double a = u2 * oneMinusCos;
+    double cosTheta = 1 - a;
+    double sinTheta = std::sqrt(std::fmax(a * (2 - a), 0.0));
+    double phi = 2 * pi * u1;
+
+    Vec3 w = toCenter / std::sqrt(distanceSquared);
+    Vec3 helper = (std::fabs(w.X()) > 0.9) ? Vec3(0, 1, 0) : Vec3(1, 0, 0);
+    Vec3 u = Normalized(Cross(helper, w));
+    Vec3 v = Cross(w, u);
+    Vec3 direction = Real(sinTheta * std::cos(phi)) * u + Real(sinTheta * std::sin(phi)) * v + Real(cosTheta) * w;
+
+    // Near side of the sphere along direction. Directions at the rim of the cone may round
+    // past it, they graze the sphere
+    double h = Dot(direction, toCenter);
+    double c = distanceSquared - double(sphere.radius) * sphere.radius;
+    double discriminant = std::fmax(h * h - c, 0.0);
+
+    sample.direction = direction;
+    sample.distance = Real(c / (h + std::sqrt(discriminant)));
+    sample.pdf = 1 / (2 * pi * oneMinusCos * lights.size());
+    sample.light = light;
+    return true;
+  }
+
+  double Pdf(int light, const Point3& p) const
+  {
+    // Density Sample gives to any direction from p that hits the light
+    const SphereLight& sphere = lights[light];
+    double oneMinusCos = ConeOneMinusCos((sphere.center - p).LengthSquared(), sphere.radius);
+    return (oneMinusCos > 0) ? 1 / (2 * pi * oneMinusCos * lights.size()) : 0;
+  }
+
+private:
+  struct SphereLight
+  {
+    Point3 center;
+    Real radius;
+    MaterialId material;
+  };
+
+  std::vector<SphereLight> lights;
+  std::map<std::pair<const Hittable*, int>, int> lookup;
+
+  static double ConeOneMinusCos(double distanceSquared, double radius)
+  {
+    // 1 - cos(thetaMax) of the cone a sphere fills, as sin^2 / (1 + cos) so small, distant
+    // lights keep their precision. 0 when the point is inside the sphere
+    double sinSquared = radius * radius / distanceSquared;
+    if (!(sinSquared < 1))
+    {
+      return 0;
+    }
+    return sinSquared / (1 + std::sqrt(1 - sinSquared));
+  }
+};
+
+#endif // LIGHTS_H
\ No newline at end of file
@@ -1,77 +1,735 @@
 #include "Engine.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Animation.h"
+#include "BVH.h"
 #include "Camera.h"
+#include "Denoiser.h"
+#include "Distributed.h"
 #include "Hittable.h"
 #include "HittableList.h"
+#include "ImageWriter.h"
+#include "Instance.h"
+#include "Lights.h"
 #include "Material.h"
+#include "ObjFile.h"
+#include "Scene.h"
+#include "Scenes.h"
 #include "Sphere.h"
+#include "SphereSoA.h"
+#include "TriangleMesh.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
-int main()
+static bool ParseNumbers(int& arg, int argc, char* argv[], double* values, int count)
 {
-  HittableList world;
+  // Reads the count numbers following the option at argv[arg] and moves arg past them
+  if (arg + count >= argc)
+  {
+    return false;
+  }
+
+  for (int k = 0; k < count; k++)
+  {
+    char* end;
+    values[k] = std::strtod(argv[arg + 1 + k], &end);
+    if (*end != '\0')
+    {
+      return false;
+    }
+  }
 
-  auto groundMaterial = std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
-  world.Add(std::make_shared<Sphere>(Point3(0, -1000, 0), 1000, groundMaterial));
+  arg += count;
+  return true;
+}
 
-  for (int a = -11; a < 11; a++)
+static bool WriteMap(Framebuffer& map, const std::string& path, float scale, float offset)
+{
+  // Writes a buffer that isn't a color image. Float maps keep raw values, 8-bit formats get
+  // value * scale + offset, which should bring them into [0, 1]
+  ImageFormat format = ImageFormatFromPath(path);
+  if (format != ImageFormat::PFM)
   {
-    for (int b = -11; b < 11; b++)
+    float* values = map.Data();
+    for (size_t k = 0; k < size_t(map.Width()) * map.Height() * 3; k++)
     {
-      auto chooseMat = RandomDouble();
-      Point3 center(a + 0.9 * RandomDouble(), 0.2, b + 0.9 * RandomDouble());
+      values[k] = values[k] * scale + offset;
+    }
+  }
+
+  if (!WriteImage(map, path, format))
+  {
+    std::cerr << "Could not write " << path << '\n';
+    return false;
+  }
+  return true;
+}
+
+static std::string FramePath(const std::string& path, int frame, bool animate)
+{
+  // Path of one frame of an animation: the last run of # in path becomes the frame number,
+  // zero-padded to its length, or the number goes before the extension when there is none.
+  // Single renders keep path as it is
+  if (!animate)
+  {
+    return path;
+  }
+
+  std::string number = std::to_string(frame);
+  size_t last = path.rfind('#');
+  if (last == std::string::npos)
+  {
+    size_t dot = path.rfind('.');
+    size_t slash = path.find_last_of("/\\");
+    size_t insert = (dot == std::string::npos || (slash != std::string::npos && dot < slash)) ? path.size() : dot;
+    number.insert(0, (number.size() < 4) ? 4 - number.size() : 0, '0');
+    return path.substr(0, insert) + "_" + number + path.substr(insert);
+  }
+
+  size_t first = last;
+  while (first > 0 && path[first - 1] == '#')
+  {
+    first--;
+  }
+  size_t width = last - first + 1;
+  number.insert(0, (number.size() < width) ? width - number.size() : 0, '0');
+  return path.substr(0, first) + number + path.substr(last + 1);
+}
+
+static std::atomic<bool> stopRequested(false);
+
+static void StopRender(int signalNumber)
+{
+  // Lets a checkpointed render save its progress and return. A second signal ends the
+  // process the usual way
+  stopRequested = true;
+  std::signal(signalNumber, SIG_DFL);
+}
+
+struct MovingInstance
+{
+  InstanceHandle instance;
+  Transform rest;            // Transform the instance was placed with
+  AnimatedTransform motion;  // Applied on top of rest
+};
+
+int main(int argc, char* argv[])
+{
+  // Usage: Main [output path] [--format ppm|png|pfm] [--adaptive] [--sample-map path]
+  //             [--wavefront] [--sort-rays] [--stats path]
+  //             [--denoise] [--albedo-map path] [--normal-map path] [--depth-map path]
+  //             [--workers N] [--listen port] [--worker host:port] [--job-size N] [--sample-splits N]
+  //             [--frames first last] [--fps N] [--orbit degrees]
+  //             [--checkpoint path] [--checkpoint-interval seconds] [--pass-samples N]
+  //             [--time-budget seconds]
+  //             [--scene path] [--save-scene path] [--memory-budget MB] [--mesh path.obj]...
+  //             [--instances N] [--lamps N] [--sky S] [--no-light-sampling]
+  //             [--sampler independent|stratified|sobol|bluenoise]
+  //             [--width N] [--spp N] [--depth N] [--threads N] [--aspect R] [--vfov degrees]
+  //             [--look-from X Y Z] [--look-at X Y Z] [--up X Y Z]
+  //             [--defocus-angle degrees] [--focus-dist D]
+  // Without an output path the image is written to stdout as a binary PPM. --stats writes the
+  // render statistics as JSON, see RenderStats.h. Without --scene the built-in random spheres
+  // scene is rendered. Every --mesh adds an OBJ mesh with a grey diffuse material to the
+  // scene, or with --instances, N copies of it scattered over the ground that all share the
+  // mesh. --lamps adds N small lights to the built-in scene and --sky scales the brightness of
+  // the sky, 0 turns it off. --denoise filters the image guided by the first-hit albedo,
+  // normal and depth, which the map options write out, see Denoiser.h. --workers renders on
+  // N local worker processes and --listen takes workers from other hosts, which run with the
+  // same scene and camera options plus --worker, see Distributed.h. Jobs are tiles of
+  // --job-size pixels, their samples split in --sample-splits ranges. --frames renders an
+  // animation in one process: instances hop and spin, and --orbit turns the camera around its
+  // look-at point by the given degrees per second. Frame paths replace a run of # in every
+  // output path with the frame number, or add it before the extension. --checkpoint saves
+  // the progress of a render to path every --checkpoint-interval seconds and when SIGTERM or
+  // SIGINT stops it, and the same command run again resumes from there; the checkpoint is
+  // removed once the image is written. Renders take --pass-samples samples per pixel per
+  // pass, by default a sixteenth of them when checkpointing. --time-budget renders the best
+  // image that fits in the given seconds, taking at most --spp samples per pixel when given
+  // and as many as fit otherwise. Camera options override the settings stored in the scene
+  // file
+  std::string outputPath;
+  std::string sampleMapPath;
+  std::string albedoMapPath;
+  std::string normalMapPath;
+  std::string depthMapPath;
+  std::string statsPath;
+  std::string scenePath;
+  std::string saveScenePath;
+  std::vector<std::string> meshPaths;
+  double memoryBudgetMB = 0;
+  double instanceCount = 0;
+  double lampCount = 0;
+  double localWorkers = 0;
+  double workerDescriptor = -1;
+  double jobSize = 64;
+  double sampleSplits = 1;
+  double frameRange[2] = { 0, 0 };
+  double framesPerSecond = 24;
+  double orbitSpeed = 0;
+  std::string checkpointPath;
+  double checkpointInterval = 300;
+  double passSamples = 0;
+  double timeBudget = 0;
+  bool samplesGiven = false;
+  bool animate = false;
+  std::string listenPort;
+  std::string coordinatorAddress;
+  bool adaptive = false;
+  bool denoise = false;
+  bool wavefront = false;
+  bool sortRays = false;
+  bool formatGiven = false;
+  ImageFormat format = ImageFormat::PPM;
+  std::vector<std::function<void(Camera&)>> cameraOptions;
 
-      if ((center - Point3(4, 0.2, 0)).Length() > 0.9)
+  for (int arg = 1; arg < argc; arg++)
+  {
+    std::string option = argv[arg];
+    double v[3];
+    bool valid = true;
+
+    if (option == "--format" && arg + 1 < argc)
+    {
+      if (!ImageFormatFromName(argv[++arg], format))
       {
-        std::shared_ptr<Material> sphereMaterial;
+        std::cerr << "Unknown image format: " << argv[arg] << '\n';
+        return 1;
+      }
+      formatGiven = true;
+    }
+    else if (option == "--adaptive")
+    {
+      adaptive = true;
+    }
+    else if (option == "--wavefront")
+    {
+      wavefront = true;
+    }
+    else if (option == "--sort-rays")
+    {
+      sortRays = true;
+    }
+    else if (option == "--stats" && arg + 1 < argc)
+    {
+      statsPath = argv[++arg];
+    }
+    else if (option == "--sample-map" && arg + 1 < argc)
+    {
+      sampleMapPath = argv[++arg];
+    }
+    else if (option == "--denoise")
+    {
+      denoise = true;
+    }
+    else if (option == "--albedo-map" && arg + 1 < argc)
+    {
+      albedoMapPath = argv[++arg];
+    }
+    else if (option == "--normal-map" && arg + 1 < argc)
+    {
+      normalMapPath = argv[++arg];
+    }
+    else if (option == "--depth-map" && arg + 1 < argc)
+    {
+      depthMapPath = argv[++arg];
+    }
+    else if (option == "--workers")
+    {
+      valid = ParseNumbers(arg, argc, argv, &localWorkers, 1);
+    }
+    else if (option == "--listen" && arg + 1 < argc)
+    {
+      listenPort = argv[++arg];
+    }
+    else if (option == "--worker" && arg + 1 < argc)
+    {
+      coordinatorAddress = argv[++arg];
+    }
+    else if (option == "--worker-fd")
+    {
+      // Given by the coordinator to the local workers it starts
+      valid = ParseNumbers(arg, argc, argv, &workerDescriptor, 1);
+    }
+    else if (option == "--job-size")
+    {
+      valid = ParseNumbers(arg, argc, argv, &jobSize, 1);
+    }
+    else if (option == "--sample-splits")
+    {
+      valid = ParseNumbers(arg, argc, argv, &sampleSplits, 1);
+    }
+    else if (option == "--frames")
+    {
+      valid = animate = ParseNumbers(arg, argc, argv, frameRange, 2);
+    }
+    else if (option == "--fps")
+    {
+      valid = ParseNumbers(arg, argc, argv, &framesPerSecond, 1) && framesPerSecond > 0;
+    }
+    else if (option == "--orbit")
+    {
+      valid = ParseNumbers(arg, argc, argv, &orbitSpeed, 1);
+    }
+    else if (option == "--checkpoint" && arg + 1 < argc)
+    {
+      checkpointPath = argv[++arg];
+    }
+    else if (option == "--checkpoint-interval")
+    {
+      valid = ParseNumbers(arg, argc, argv, &checkpointInterval, 1);
+    }
+    else if (option == "--pass-samples")
+    {
+      valid = ParseNumbers(arg, argc, argv, &passSamples, 1);
+    }
+    else if (option == "--time-budget")
+    {
+      valid = ParseNumbers(arg, argc, argv, &timeBudget, 1) && timeBudget > 0;
+    }
+    else if (option == "--scene" && arg + 1 < argc)
+    {
+      scenePath = argv[++arg];
+    }
+    else if (option == "--save-scene" && arg + 1 < argc)
+    {
+      saveScenePath = argv[++arg];
+    }
+    else if (option == "--mesh" && arg + 1 < argc)
+    {
+      meshPaths.push_back(argv[++arg]);
+    }
+    else if (option == "--instances")
+    {
+      valid = ParseNumbers(arg, argc, argv, &instanceCount, 1);
+    }
+    else if (option == "--lamps")
+    {
+      valid = ParseNumbers(arg, argc, argv, &lampCount, 1);
+    }
+    else if (option == "--sky" && (valid = ParseNumbers(arg, argc, argv, v, 1)))
+    {
+      cameraOptions.push_back([=](Camera& cam) { cam.skyBrightness = v[0]; });
+    }
+    else if (option == "--sampler" && arg + 1 < argc)
+    {
+      SamplerType type;
+      if (!SamplerTypeFromName(argv[++arg], type))
+      {
+        std::cerr << "Unknown sampler: " << argv[arg] << '\n';
+        return 1;
+      }
+      cameraOptions.push_back([=](Camera& cam) { cam.samplerType = type; });
+    }
+    else if (option == "--no-light-sampling")
+    {
+      cameraOptions.push_back([](Camera& cam) { cam.sampleLights = false; });
+    }
+    else if (option == "--memory-budget")
+    {
+      valid = ParseNumbers(arg, argc, argv, &memoryBudgetMB, 1);
+    }
+    else if (option == "--width" && (valid = ParseNumbers(arg, argc, argv, v, 1)))
+    {
+      cameraOptions.push_back([=](Camera& cam) { cam.imageWidth = int(v[0]); });
+    }
+    else if (option == "--spp" && (valid = ParseNumbers(arg, argc, argv, v, 1)))
+    {
+      cameraOptions.push_back([=](Camera& cam) { cam.samplesPerPixel = int(v[0]); });
+      samplesGiven = true;
+    }
+    else if (option == "--depth" && (valid = ParseNumbers(arg, argc, argv, v, 1)))
+    {
+      cameraOptions.push_back([=](Camera& cam) { cam.maxDepth = int(v[0]); });
+    }
+    else if (option == "--threads" && (valid = ParseNumbers(arg, argc, argv, v, 1)))
+    {
+      cameraOptions.push_back([=](Camera& cam) { cam.threadCount = int(v[0]); });
+    }
+    else if (option == "--aspect" && (valid = ParseNumbers(arg, argc, argv, v, 1)))
+    {
+      cameraOptions.push_back([=](Camera& cam) { cam.aspectRatio = v[0]; });
+    }
+    else if (option == "--vfov" && (valid = ParseNumbers(arg, argc, argv, v, 1)))
+    {
+      cameraOptions.push_back([=](Camera& cam) { cam.vFov = v[0]; });
+    }
+    else if (option == "--look-from" && (valid = ParseNumbers(arg, argc, argv, v, 3)))
+    {
+      cameraOptions.push_back([=](Camera& cam) { cam.lookFrom = Point3(v[0], v[1], v[2]); });
+    }
+    else if (option == "--look-at" && (valid = ParseNumbers(arg, argc, argv, v, 3)))
+    {
+      cameraOptions.push_back([=](Camera& cam) { cam.lookAt = Point3(v[0], v[1], v[2]); });
+    }
+    else if (option == "--up" && (valid = ParseNumbers(arg, argc, argv, v, 3)))
+    {
+      cameraOptions.push_back([=](Camera& cam) { cam.vUp = Vec3(v[0], v[1], v[2]); });
+    }
+    else if (option == "--defocus-angle" && (valid = ParseNumbers(arg, argc, argv, v, 1)))
+    {
+      cameraOptions.push_back([=](Camera& cam) { cam.defocusAngle = v[0]; });
+    }
+    else if (option == "--focus-dist" && (valid = ParseNumbers(arg, argc, argv, v, 1)))
+    {
+      cameraOptions.push_back([=](Camera& cam) { cam.focusDist = v[0]; });
+    }
+    else if (valid && option.compare(0, 2, "--") != 0)
+    {
+      outputPath = option;
+    }
+    else
+    {
+      valid = false;
+    }
 
-        if (chooseMat < 0.8)
-        {
-          // Diffuse
-          auto albedo = Color::Random() * Color::Random();
-          sphereMaterial = std::make_shared<Lambertian>(albedo);
-          world.Add(std::make_shared<Sphere>(center, 0.2, sphereMaterial));
-        } 
-        else if (chooseMat < 0.95)
-        {
-          // Metal
-          auto albedo = Color::Random(0.5, 1);
-          auto fuzz = RandomDouble(0, 0.5);
-          sphereMaterial = std::make_shared<Metal>(albedo, fuzz);
-          world.Add(std::make_shared<Sphere>(center, 0.2, sphereMaterial));
-        }
-        else
+    if (!valid)
+    {
+      std::cerr << "Invalid option: " << option << '\n';
+      return 1;
+    }
+  }
+
+  bool worker = workerDescriptor >= 0 || !coordinatorAddress.empty();
+  bool distributed = !worker && (localWorkers > 0 || !listenPort.empty());
+  bool gatherFeatures = denoise || !albedoMapPath.empty() || !normalMapPath.empty() || !depthMapPath.empty();
+  if (distributed && (adaptive || gatherFeatures || !sampleMapPath.empty()))
+  {
+    std::cerr << "Adaptive sampling, denoising and maps need a local render\n";
+    return 1;
+  }
+  if (animate && !worker && (distributed || outputPath.empty()))
+  {
+    std::cerr << "Animations render locally and need an output path\n";
+    return 1;
+  }
+  if ((!checkpointPath.empty() || timeBudget > 0) && (animate || distributed || worker))
+  {
+    std::cerr << "Checkpoints and time budgets are for single local renders\n";
+    return 1;
+  }
+
+  Scene scene;
+  SphereSoA& world = scene.Spheres();
+  MaterialTable& materials = scene.Materials();
+  Camera cam;
+
+  if (scenePath.empty())
+  {
+    Rng rng;
+    RandomSpheresScene(materials, rng, [&](const Point3& center, Real radius, MaterialId material)
+    {
+      scene.AddSphere(center, radius, material);
+    });
+    RandomLamps(int(lampCount), materials, rng, [&](const Point3& center, Real radius, MaterialId material)
+    {
+      scene.AddSphere(center, radius, material);
+    });
+    RandomSpheresCamera(cam);
+  }
+  else
+  {
+    std::string error;
+    auto loadStart = std::chrono::steady_clock::now();
+
+    if (!SceneFile::Load(scenePath, world, materials, cam, size_t(memoryBudgetMB * 1024 * 1024), error))
+    {
+      std::cerr << "Could not load " << scenePath << ": " << error << '\n';
+      return 1;
+    }
+
+    std::clog << "Loaded " << world.Size() << " spheres in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count() << "s\n";
+  }
+
+  for (const auto& setOption : cameraOptions)
+  {
+    setOption(cam);
+  }
+
+  if (!saveScenePath.empty() && !worker)
+  {
+    std::string error;
+    if (!SceneFile::Save(saveScenePath, world, materials, cam, error))
+    {
+      std::cerr << "Could not save " << saveScenePath << ": " << error << '\n';
+      return 1;
+    }
+  }
+
+  // Meshes build their own BVH while loading. Instances of them get a BVH of their own on top,
+  // and everything sits beside the spheres, so the spheres are rendered on their own when
+  // there are no meshes
+  std::vector<MovingInstance> movingInstances;
+  if (!meshPaths.empty())
+  {
+    MaterialId meshMaterial = scene.AddMaterial(Lambertian(Color(0.6, 0.6, 0.6)));
+    Rng instanceRng(7);
+    Rng motionRng(11);
+
+    for (const std::string& meshPath : meshPaths)
+    {
+      MeshHandle mesh = scene.AddMesh(meshMaterial);
+      std::string error;
+      auto loadStart = std::chrono::steady_clock::now();
+
+      if (!ObjFile::Load(meshPath, scene[mesh], error))
+      {
+        std::cerr << "Could not load " << meshPath << ": " << error << '\n';
+        return 1;
+      }
+
+      std::clog << "Loaded " << scene[mesh].TriangleCount() << " triangles in "
+                << std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count() << "s, "
+                << scene[mesh].MemoryBytes() / (1024 * 1024) << " MB\n";
+
+      if (instanceCount > 0)
+      {
+        ScatterInstances(scene[mesh].BoundingBox(), int(instanceCount), materials, instanceRng, [&](const Transform& objectToWorld, MaterialId material)
         {
-          // Glass
-          sphereMaterial = std::make_shared<Dielectric>(1.5);
-          world.Add(std::make_shared<Sphere>(center, 0.2, sphereMaterial));
-        }
+          InstanceHandle instance = scene.AddInstance(mesh, objectToWorld, material);
+          if (animate)
+          {
+            movingInstances.push_back(MovingInstance{ instance, objectToWorld, HopAndSpin(scene[instance].BoundingBox(), motionRng) });
+          }
+        });
+      }
+      else
+      {
+        scene.PlaceMesh(mesh);
       }
     }
   }
 
-  auto material1 = std::make_shared<Dielectric>(1.5);
-  world.Add(std::make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
+  auto buildStart = std::chrono::steady_clock::now();
+  scene.Build();
+  if (scene.InstanceCount() > 0)
+  {
+    std::clog << "Placed " << scene.InstanceCount() << " instances (" << scene.ArenaBytes() / (1024 * 1024) << " MB), built their BVH in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count() << "s\n";
+  }
+  const Hittable& target = scene.World();
 
-  auto material2 = std::make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
-  world.Add(std::make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
+  LightList lights;
+  lights.AddEmissiveSpheres(world, materials);
+  if (!lights.Empty())
+  {
+    std::clog << "Sampling " << lights.Size() << " lights\n";
+  }
 
-  auto material3 = std::make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
-  world.Add(std::make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
+  cam.adaptiveSampling = adaptive;
+  cam.timeBudget = timeBudget;
+  if (timeBudget > 0 && !samplesGiven)
+  {
+    cam.samplesPerPixel = 1 << 16;
+  }
+  cam.passSamples = (passSamples > 0 || checkpointPath.empty()) ? int(passSamples) : std::max(cam.samplesPerPixel / 16, 1);
+  if (!checkpointPath.empty())
+  {
+    cam.checkpointPath = checkpointPath;
+    cam.checkpointSeconds = checkpointInterval;
+    cam.stop = &stopRequested;
+    std::signal(SIGTERM, StopRender);
+    std::signal(SIGINT, StopRender);
+  }
+  cam.integrator = wavefront ? Integrator::Wavefront : Integrator::Path;
+  cam.sortWavefrontRays = sortRays;
 
-  Camera cam;
+  if (worker)
+  {
+    std::string error;
+    int descriptor = (workerDescriptor >= 0) ? int(workerDescriptor) : ConnectToCoordinator(coordinatorAddress, error);
+    if (descriptor < 0 || !RunRenderWorker(descriptor, cam, target, materials, lights, error))
+    {
+      std::cerr << "Worker failed: " << error << '\n';
+      return 1;
+    }
+    return 0;
+  }
+
+  Framebuffer image;
+  Framebuffer sampleCounts;
+  FeatureBuffers features;
+  RenderStats distributedStats;
+  Denoiser denoiser;
+  denoiser.threadCount = cam.threadCount;
+  AsyncImageWriter frameWriter;
+  bool written = true;
+
+  // Without --frames this loop renders the one frame the camera is set to. Animations move the
+  // instances and the camera to each frame's time, refit the instance BVH around them and
+  // reuse the camera's threads and buffers
+  int firstFrame = animate ? int(frameRange[0]) : cam.frame;
+  int lastFrame = animate ? int(frameRange[1]) : cam.frame;
+  Point3 restLookFrom = cam.lookFrom;
+  AnimatedTransform orbit = Orbit(cam.lookAt, cam.vUp, orbitSpeed);
 
-  cam.aspectRatio      = 16.0 / 9.0;
-  cam.imageWidth       = 360;
-  cam.samplesPerPixel  = 10;
-  cam.maxDepth         = 30;
+  for (int frame = firstFrame; frame <= lastFrame; frame++)
+  {
+    auto updateStart = std::chrono::steady_clock::now();
+    if (animate)
+    {
+      double time = frame / framesPerSecond;
+      for (MovingInstance& moving : movingInstances)
+      {
+        scene[moving.instance].SetTransform(moving.motion.At(time) * moving.rest);
+      }
+      scene.Refit();
+
+      cam.lookFrom = orbit.At(time).ApplyPoint(restLookFrom);
+      cam.frame = frame;
+    }
+    double updateSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - updateStart).count();
+
+    if (distributed)
+    {
+      // Local workers get the same options as this process, and a share of the hardware threads
+      // unless the options name a thread count
+      int threadsPerWorker = std::max(int(std::thread::hardware_concurrency()) / std::max(int(localWorkers), 1), 1);
+      std::vector<std::string> workerArguments = { "--threads", std::to_string(threadsPerWorker) };
+      workerArguments.insert(workerArguments.end(), argv + 1, argv + argc);
+
+      RenderCoordinator coordinator;
+      coordinator.jobSize = int(jobSize);
+      coordinator.sampleSplits = int(sampleSplits);
+      std::string error;
+
+      if (!listenPort.empty() && !coordinator.Listen(listenPort, error))
+      {
+        std::cerr << error << '\n';
+        return 1;
+      }
+      if (!listenPort.empty())
+      {
+        std::clog << "Listening for workers on port " << listenPort << '\n';
+      }
+
+      if (!coordinator.StartLocalWorkers(int(localWorkers), argv[0], workerArguments, error) ||
+          !coordinator.Render(cam, cam.Fingerprint(target, materials, lights), image, distributedStats, error))
+      {
+        std::cerr << "Distributed render failed: " << error << '\n';
+        return 1;
+      }
+    }
+    else
+    {
+      cam.Render(target, materials, lights, image, sampleMapPath.empty() ? nullptr : &sampleCounts, gatherFeatures ? &features : nullptr);
+      if (cam.Stopped())
+      {
+        std::clog << "\nStopped, the same command resumes the render from " << checkpointPath << '\n';
+        return 1;
+      }
+    }
+
+    double denoiseSeconds = 0;
+    if (denoise)
+    {
+      auto denoiseStart = std::chrono::steady_clock::now();
+
+      Framebuffer denoised;
+      denoiser.Denoise(image, features, denoised);
+      std::swap(image, denoised);
+
+      denoiseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - denoiseStart).count();
+      std::clog << "Denoised in " << denoiseSeconds << "s\n";
+    }
+
+    // 8-bit maps show the fraction of the sample budget, normals moved from [-1, 1] and depth
+    // over the farthest depth
+    if (!sampleMapPath.empty() && !WriteMap(sampleCounts, FramePath(sampleMapPath, frame, animate), float(1.0 / cam.samplesPerPixel), 0))
+    {
+      return 1;
+    }
+
+    if (!albedoMapPath.empty() && !WriteMap(features.albedo, FramePath(albedoMapPath, frame, animate), 1, 0))
+    {
+      return 1;
+    }
+
+    if (!normalMapPath.empty() && !WriteMap(features.normal, FramePath(normalMapPath, frame, animate), 0.5f, 0.5f))
+    {
+      return 1;
+    }
+
+    if (!depthMapPath.empty())
+    {
+      const float* depths = features.depth.Data();
+      float farthest = *std::max_element(depths, depths + size_t(features.depth.Width()) * features.depth.Height() * 3);
+      if (!WriteMap(features.depth, FramePath(depthMapPath, frame, animate), (farthest > 0) ? 1 / farthest : 1, 0))
+      {
+        return 1;
+      }
+    }
 
-  cam.vFov     = 20;
-  cam.lookFrom = Point3(13,2,3);
-  cam.lookAt   = Point3(0,0,0);
-  cam.vUp      = Vec3(0,1,0);
+    auto outputStart = std::chrono::steady_clock::now();
+    RenderStats stats = distributed ? distributedStats : cam.Stats();
 
-  cam.defocusAngle = 0.6;
-  cam.focusDist    = 10.0;
+    if (animate)
+    {
+      // Written while the next frame renders
+      std::string framePath = FramePath(outputPath, frame, true);
+      frameWriter.Write(image, framePath, formatGiven ? format : ImageFormatFromPath(framePath));
+      std::clog << "Frame " << frame << ": " << stats.renderSeconds << "s render, "
+                << (stats.setupSeconds + stats.resolveSeconds + updateSeconds) * 1000 << "ms setup, scene update and resolve\n";
+    }
+    else if (outputPath.empty())
+    {
+#ifdef _WIN32
+      _setmode(_fileno(stdout), _O_BINARY);
+#endif
+      written = WriteImage(image, std::cout, format);
+    }
+    else
+    {
+      written = WriteImage(image, outputPath, formatGiven ? format : ImageFormatFromPath(outputPath));
+      if (!written)
+      {
+        std::cerr << "Could not write " << outputPath << '\n';
+      }
+    }
+
+    if (!statsPath.empty())
+    {
+      std::string frameStatsPath = FramePath(statsPath, frame, animate);
+      stats.setupSeconds += updateSeconds;
+      stats.denoiseSeconds = denoiseSeconds;
+      stats.outputSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - outputStart).count();
+
+      std::ofstream statsFile(frameStatsPath);
+      stats.WriteJson(statsFile);
+      if (!statsFile)
+      {
+        std::cerr << "Could not write " << frameStatsPath << '\n';
+        return 1;
+      }
+    }
+  }
+
+  std::string failedPath;
+  if (!frameWriter.Finish(&failedPath))
+  {
+    std::cerr << "Could not write " << failedPath << '\n';
+    written = false;
+  }
+
+  if (written && !checkpointPath.empty())
+  {
+    std::remove(checkpointPath.c_str());
+  }
 
-  cam.Render(world);
+  return written ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,145 @@
+#pragma once
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class MappedFile
+{
+  // Read-only memory mapping of a whole file. Loaders parse straight out of the page cache
+  // instead of copying the file into a buffer first, and hand pages they are done with back
+  // to the system with Release, so large files can be streamed in a bounded amount of memory
+
+public:
+  MappedFile() {}
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() { Close(); }
+
+  bool Open(const std::string& path)
+  {
+    Close();
+
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                       FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+      return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+      Close();
+      return false;
+    }
+    size = size_t(fileSize.QuadPart);
+
+    if (size > 0)
+    {
+      mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      data = mapping ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+      if (!data)
+      {
+        Close();
+        return false;
+      }
+    }
+#else
+    descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+    {
+      return false;
+    }
+
+    struct stat info;
+    if (fstat(descriptor, &info) != 0)
+    {
+      Close();
+      return false;
+    }
+    size = size_t(info.st_size);
+
+    if (size > 0)
+    {
+      void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+      if (mapped == MAP_FAILED)
+      {
+        Close();
+        return false;
+      }
+      data = static_cast<const char*>(mapped);
+      madvise(mapped, size, MADV_SEQUENTIAL);
+    }
+#endif
+
+    return true;
+  }
+
+  void Close()
+  {
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (data) munmap(const_cast<char*>(data), size);
+    if (descriptor >= 0) close(descriptor);
+    descriptor = -1;
+#endif
+    data = nullptr;
+    size = 0;
+  }
+
+  const char* Data() const { return data; }
+  size_t Size() const      { return size; }
+
+  void Release(size_t offset, size_t length)
+  {
+    // Tells the system the bytes in [offset, offset + length) won't be read again, so their
+    // pages can leave the process. Only whole pages inside the range are released
+#ifndef _WIN32
+    const size_t page = size_t(sysconf(_SC_PAGESIZE));
+    size_t first = (offset + page - 1) / page * page;
+    size_t last = (offset + length) / page * page;
+    if (data && first < last && last <= size)
+    {
+      madvise(const_cast<char*>(data) + first, last - first, MADV_DONTNEED);
+    }
+#else
+    (void)offset;
+    (void)length;
+#endif
+  }
+
+private:
+  const char* data = nullptr;
+  size_t size = 0;
+
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#else
+  int descriptor = -1;
+#endif
+};
+
+#endif // MAPPED_FILE_H
\ No newline at end of file
@@ -3,89 +3,103 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 
+#include <vector>
 #include "Hittable.h"
+#include "Sampler.h"
+
+enum class MaterialType
+{
+  Lambertian,
+  Metal,
+  Dielectric,
+  DiffuseLight
+};
 
 class Material
 {
+  // Materials are plain values tagged with their type, stored by value in a MaterialTable and
+  // referenced by index from hit records. Scatter dispatches with a switch on the tag instead
+  // of a virtual call, and copying a material id never touches a reference count
+
 public:
-  virtual ~Material() = default;
+  MaterialType Type() const { return type; }
+  const Color& Albedo() const { return albedo; }
+  const Color& Emission() const { return emission; }
+  double Fuzz() const { return fuzz; }
+  double RefractionIndex() const { return refractionIndex; }
 
-  virtual bool Scatter(
+  bool Scatter(
       const Ray& rIn,
       const HitRecord& rec,
       Color& attenuation,
-      Ray& scattered) const
+      Ray& scattered,
+      Sampler& sampler) const
   {
+    switch (type)
+    {
+      case MaterialType::Lambertian:   return ScatterLambertian(rIn, rec, attenuation, scattered, sampler);
+      case MaterialType::Metal:        return ScatterMetal(rIn, rec, attenuation, scattered, sampler);
+      case MaterialType::Dielectric:   return ScatterDielectric(rIn, rec, attenuation, scattered, sampler);
+      case MaterialType::DiffuseLight: return ScatterLight(rIn, rec, attenuation, scattered, sampler);
+    }
     return false;
   }
-};
 
-class Lambertian : public Material
-{
-public:
-  Lambertian(const Color& albedo) : albedo(albedo) {}
+  // Per-type scatter kernels. Integrators that already grouped their hits by material type
+  // call these directly and skip the switch
 
-  bool Scatter(
+  bool ScatterLambertian(
       const Ray& rIn,
       const HitRecord& rec,
       Color& attenuation,
-      Ray& scattered) const override
+      Ray& scattered,
+      Sampler& sampler) const
   {
-    auto scatterDirection = LambertianSphere(rec.normal);
-
-    // Catch degenerate scatter direction
-    if (scatterDirection.NearZero())
-    {
-      scatterDirection = rec.normal;
-    }
+    double u, v;
+    sampler.Get2D(u, v);
+    return ScatterLambertian(rec, SampleCosineHemisphere(rec.normal, u, v), attenuation, scattered);
+  }
 
-    scattered = Ray(rec.p, scatterDirection);
+  bool ScatterLambertian(
+      const HitRecord& rec,
+      const Vec3& direction,
+      Color& attenuation,
+      Ray& scattered) const
+  {
+    // Finishes a Lambertian scatter whose cosine-weighted direction was already sampled, one
+    // at a time above or for a whole bin with DirectionBatch::CosineHemisphere
+    scattered = rec.SpawnRay(direction);
     attenuation = albedo;
     return true;
   }
 
-private:
-  Color albedo;
-};
-
-class Metal : public Material
-{
-public:
-  Metal(const Color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
-
-  bool Scatter(
+  bool ScatterMetal(
       const Ray& rIn,
       const HitRecord& rec,
       Color& attenuation,
-      Ray& scattered) const override
+      Ray& scattered,
+      Sampler& sampler) const
   {
     Vec3 reflected = Reflect(rIn.Direction(), rec.normal);
 
     // In order for the fuzz sphere to make sense, it needs to be consistently scaled
     // compared to the reflection vector, which can vary in length arbitrarily
-    reflected = Normalized(reflected) + (fuzz * RandomNormalizedVector());
+    double u, v;
+    sampler.Get2D(u, v);
+    reflected = Normalized(reflected) + (fuzz * SampleUniformSphere(u, v));
 
-    scattered = Ray(rec.p, reflected);
+    scattered = rec.SpawnRay(reflected);
     attenuation = albedo;
-    
+
     return (Dot(scattered.Direction(), rec.normal) > 0);
   }
 
-private:
-  Color albedo;
-  double fuzz;
-};
-
-class Dielectric : public Material
-{
-public:
-  Dielectric(double refractionIndex) : refractionIndex(refractionIndex) {}
-
-  bool Scatter(
+  bool ScatterDielectric(
       const Ray& rIn,
       const HitRecord& rec,
       Color& attenuation,
-      Ray& scattered) const override
+      Ray& scattered,
+      Sampler& sampler) const
   {
     attenuation = Color(1.0, 1.0, 1.0);
     double ri = rec.frontFace ? (1.0 / refractionIndex) : refractionIndex;
@@ -97,7 +111,7 @@ public:
     bool cannotRefract = ri * sinTheta > 1.0;
     Vec3 direction;
 
-    if (cannotRefract || Reflectance(cosTheta, ri) > RandomDouble())
+    if (cannotRefract || Reflectance(cosTheta, ri) > sampler.Get1D())
     {
       direction = Reflect(normalizedDirection, rec.normal);
     }
@@ -106,15 +120,43 @@ public:
       direction = Refract(normalizedDirection, rec.normal, ri);
     }
 
-    scattered = Ray(rec.p, direction);
+    scattered = rec.SpawnRay(direction);
     return true;
   }
 
+  bool ScatterLight(
+      const Ray& rIn,
+      const HitRecord& rec,
+      Color& attenuation,
+      Ray& scattered,
+      Sampler& sampler) const
+  {
+    // Lights only emit, the path ends on them
+    return false;
+  }
+
+  static double LambertianPdf(const Vec3& normal, const Vec3& direction)
+  {
+    // Density over solid angle of the directions ScatterLambertian picks
+    return CosineHemispherePdf(Dot(normal, Normalized(direction)));
+  }
+
+protected:
+  Material(MaterialType type, const Color& albedo, double fuzz, double refractionIndex, const Color& emission = Color(0, 0, 0)) :
+    type(type), albedo(albedo), fuzz(fuzz), refractionIndex(refractionIndex), emission(emission)
+  {}
+
 private:
+  MaterialType type;
+  Color albedo;
+  double fuzz;
+
   // Refractive index in vacuum or air, or the ratio of the material's refractive index over
   // the refractive index of the enclosing media
   double refractionIndex;
 
+  Color emission;  // Radiance leaving the surface, on both sides
+
   static double Reflectance(double cosine, double refractionIndex)
   {
     // Use Schlick's approximation for reflectance
@@ -124,4 +166,64 @@ private:
   }
 };
 
+// The concrete materials only pick the tag and parameters, so they can be stored by value as
+// a Material without slicing anything away
+
+class Lambertian : public Material
+{
+public:
+  Lambertian(const Color& albedo) : Material(MaterialType::Lambertian, albedo, 0, 1) {}
+};
+
+class Metal : public Material
+{
+public:
+  Metal(const Color& albedo, double fuzz) : Material(MaterialType::Metal, albedo, fuzz < 1 ? fuzz : 1, 1) {}
+};
+
+class Dielectric : public Material
+{
+public:
+  Dielectric(double refractionIndex) : Material(MaterialType::Dielectric, Color(1, 1, 1), 0, refractionIndex) {}
+};
+
+class DiffuseLight : public Material
+{
+public:
+  DiffuseLight(const Color& emission) : Material(MaterialType::DiffuseLight, Color(0, 0, 0), 0, 1, emission) {}
+};
+
+class MaterialTable
+{
+  // Scene-owned storage for every material, indexed by MaterialId
+
+public:
+  MaterialId Add(const Material& material)
+  {
+    materials.push_back(material);
+    return MaterialId(materials.size() - 1);
+  }
+
+  const Material& operator[](MaterialId id) const { return materials[id]; }
+
+  int Size() const { return int(materials.size()); }
+
+  bool SingleType(MaterialType& type) const
+  {
+    // True when the table holds materials of one type only, which is then type
+    for (const Material& material : materials)
+    {
+      if (material.Type() != materials[0].Type())
+      {
+        return false;
+      }
+    }
+    type = materials.empty() ? MaterialType::Lambertian : materials[0].Type();
+    return !materials.empty();
+  }
+
+private:
+  std::vector<Material> materials;
+};
+
 #endif // MATERIAL_H
\ No newline at end of file
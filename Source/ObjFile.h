@@ -0,0 +1,383 @@
+#pragma once
+
+#ifndef OBJ_FILE_H
+#define OBJ_FILE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "TriangleMesh.h"
+
+class ObjFile
+{
+  // Loads the geometry of Wavefront OBJ files into a TriangleMesh. Only vertex positions and
+  // faces are read; polygons are split into triangle fans, and texture coordinates, normals,
+  // groups and materials are skipped. The mapped file is cut into chunks at line breaks and
+  // the chunks are parsed in parallel, then copied into the mesh buffers at their offsets
+
+public:
+  static bool Load(const std::string& path, TriangleMesh& mesh, std::string& error, int threadCount = 0)
+  {
+    // Replaces the geometry of mesh with the file's and builds its BVH
+    MappedFile file;
+    if (!file.Open(path))
+    {
+      error = "cannot open " + path;
+      return false;
+    }
+
+    ThreadPool pool(threadCount);
+    std::vector<Chunk> chunks(SplitChunks(file, 4 * pool.Size()));
+
+    pool.ParallelFor(int(chunks.size()), [&](int task, int)
+    {
+      Chunk& chunk = chunks[task];
+      Parse(chunk);
+      file.Release(size_t(chunk.begin - file.Data()), size_t(chunk.end - chunk.begin));
+    });
+
+    // Chunks only know their own counts, so vertex and index offsets come from a prefix sum
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    int lineCount = 0;
+    for (Chunk& chunk : chunks)
+    {
+      if (!chunk.error.empty())
+      {
+        error = "line " + std::to_string(lineCount + chunk.errorLine) + ": " + chunk.error;
+        return false;
+      }
+
+      chunk.vertexBase = vertexCount;
+      chunk.indexBase = indexCount;
+      vertexCount += chunk.vertices.size();
+      indexCount += chunk.indices.size();
+      lineCount += chunk.lines;
+    }
+
+    if (vertexCount > size_t(UINT32_MAX) || indexCount / 3 > size_t(INT32_MAX))
+    {
+      error = "too many vertices or triangles";
+      return false;
+    }
+
+    std::vector<TriangleMesh::Vertex>& vertices = mesh.Vertices();
+    std::vector<uint32_t>& indices = mesh.Indices();
+    std::vector<TriangleMesh::Vertex>().swap(vertices);
+    std::vector<uint32_t>().swap(indices);
+    vertices.resize(vertexCount);
+    indices.resize(indexCount);
+
+    pool.ParallelFor(int(chunks.size()), [&](int task, int)
+    {
+      Chunk& chunk = chunks[task];
+      std::copy(chunk.vertices.begin(), chunk.vertices.end(), vertices.begin() + chunk.vertexBase);
+
+      // Relative indices were stored against the chunk's own vertex count, and unsigned
+      // wraparound makes adding the base correct even for ones reaching into earlier chunks
+      for (size_t position : chunk.relative)
+      {
+        chunk.indices[position] += uint32_t(chunk.vertexBase);
+      }
+
+      for (size_t k = 0; k < chunk.indices.size(); k++)
+      {
+        if (chunk.indices[k] >= vertexCount)
+        {
+          chunk.badIndex = true;
+        }
+        indices[chunk.indexBase + k] = chunk.indices[k];
+      }
+
+      std::vector<TriangleMesh::Vertex>().swap(chunk.vertices);
+      std::vector<uint32_t>().swap(chunk.indices);
+    });
+
+    for (const Chunk& chunk : chunks)
+    {
+      if (chunk.badIndex)
+      {
+        error = "face refers to a missing vertex";
+        return false;
+      }
+    }
+
+    mesh.Build();
+    return true;
+  }
+
+private:
+  struct Chunk
+  {
+    const char* begin;
+    const char* end;
+
+    std::vector<TriangleMesh::Vertex> vertices;
+    std::vector<uint32_t> indices;   // Zero-based, relative ones against the chunk's vertices
+    std::vector<size_t> relative;    // Entries of indices that came from negative OBJ indices
+
+    int lines = 0;
+    std::string error;
+    int errorLine = 0;
+    bool badIndex = false;
+
+    size_t vertexBase = 0;
+    size_t indexBase = 0;
+  };
+
+  static std::vector<Chunk> SplitChunks(const MappedFile& file, int chunkCount)
+  {
+    // Cuts the file into chunkCount pieces of about the same size, each ending at a line break
+    const char* data = file.Data();
+    const char* end = data + file.Size();
+    std::vector<Chunk> chunks;
+
+    const char* begin = data;
+    for (int c = 1; c <= chunkCount && begin < end; c++)
+    {
+      const char* cut = (c == chunkCount) ? end : data + file.Size() * size_t(c) / size_t(chunkCount);
+      cut = std::max(cut, begin);
+
+      const char* lineEnd = static_cast<const char*>(std::memchr(cut, '\n', size_t(end - cut)));
+      cut = lineEnd ? lineEnd + 1 : end;
+
+      Chunk chunk;
+      chunk.begin = begin;
+      chunk.end = cut;
+      chunks.push_back(std::move(chunk));
+      begin = cut;
+    }
+
+    return chunks;
+  }
+
+  static void Parse(Chunk& chunk)
+  {
+    const char* p = chunk.begin;
+    const char* end = chunk.end;
+    std::vector<int64_t> polygon;
+
+    while (p < end)
+    {
+      chunk.lines++;
+      SkipSpaces(p, end);
+
+      if (p + 1 < end && p[0] == 'v' && IsSpace(p[1]))
+      {
+        p++;
+        float xyz[3];
+        for (int k = 0; k < 3; k++)
+        {
+          if (!ParseFloat(p, end, xyz[k]))
+          {
+            Fail(chunk, "cannot parse vertex");
+            return;
+          }
+        }
+        chunk.vertices.push_back(TriangleMesh::Vertex(xyz[0], xyz[1], xyz[2]));
+      }
+      else if (p + 1 < end && p[0] == 'f' && IsSpace(p[1]))
+      {
+        p++;
+        polygon.clear();
+
+        int64_t index;
+        while (ParseIndex(p, end, index))
+        {
+          if (index == 0)
+          {
+            Fail(chunk, "face index 0");
+            return;
+          }
+          polygon.push_back(index);
+        }
+
+        if (polygon.size() < 3)
+        {
+          Fail(chunk, "face with fewer than 3 vertices");
+          return;
+        }
+
+        for (size_t k = 1; k + 1 < polygon.size(); k++)
+        {
+          AddIndex(chunk, polygon[0]);
+          AddIndex(chunk, polygon[k]);
+          AddIndex(chunk, polygon[k + 1]);
+        }
+      }
+
+      // Anything else, and whatever follows the data on the line, is skipped
+      const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+      p = lineEnd ? lineEnd + 1 : end;
+    }
+  }
+
+  static void AddIndex(Chunk& chunk, int64_t index)
+  {
+    // OBJ indices count from 1, negative ones count back from the last vertex read
+    if (index > 0)
+    {
+      chunk.indices.push_back(uint32_t(index - 1));
+    }
+    else
+    {
+      chunk.relative.push_back(chunk.indices.size());
+      chunk.indices.push_back(uint32_t(int64_t(chunk.vertices.size()) + index));
+    }
+  }
+
+  static void Fail(Chunk& chunk, const char* message)
+  {
+    chunk.error = message;
+    chunk.errorLine = chunk.lines;
+  }
+
+  static bool IsSpace(char c)
+  {
+    return c == ' ' || c == '\t' || c == '\r';
+  }
+
+  static void SkipSpaces(const char*& p, const char* end)
+  {
+    while (p < end && IsSpace(*p))
+    {
+      p++;
+    }
+  }
+
+  static bool ParseIndex(const char*& p, const char* end, int64_t& index)
+  {
+    // Reads the vertex index of one face corner, skipping its texture and normal indices
+    SkipSpaces(p, end);
+
+    bool negative = (p < end && *p == '-');
+    const char* digits = negative ? p + 1 : p;
+    if (digits >= end || *digits < '0' || *digits > '9')
+    {
+      return false;
+    }
+
+    int64_t value = 0;
+    for (p = digits; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+      value = value * 10 + (*p - '0');
+      if (value > int64_t(UINT32_MAX))
+      {
+        return false;
+      }
+    }
+
+    while (p < end && !IsSpace(*p) && *p != '\n')
+    {
+      p++;
+    }
+
+    index = negative ? -value : value;
+    return true;
+  }
+
+  static bool ParseFloat(const char*& p, const char* end, float& value)
+  {
+    // Plain decimal numbers are converted with one exact multiply or divide when the digits
+    // and exponent are small enough, which covers the numbers exporters write. Anything else
+    // goes through strtod
+    static const double powers[] =
+    {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    SkipSpaces(p, end);
+    const char* start = p;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+      negative = (*p == '-');
+      p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digitCount = 0;
+    int exponent = 0;
+    bool anyDigits = false;
+
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+      mantissa = mantissa * 10 + uint64_t(*p - '0');
+      digitCount += (mantissa > 0) ? 1 : 0;
+      anyDigits = true;
+    }
+
+    if (p < end && *p == '.')
+    {
+      for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+      {
+        mantissa = mantissa * 10 + uint64_t(*p - '0');
+        digitCount += (mantissa > 0) ? 1 : 0;
+        exponent--;
+        anyDigits = true;
+      }
+    }
+
+    if (anyDigits && p < end && (*p == 'e' || *p == 'E'))
+    {
+      const char* exponentStart = p;
+      p++;
+      bool exponentNegative = false;
+      if (p < end && (*p == '-' || *p == '+'))
+      {
+        exponentNegative = (*p == '-');
+        p++;
+      }
+
+      if (p < end && *p >= '0' && *p <= '9')
+      {
+        int e = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+        {
+          e = std::min(e * 10 + (*p - '0'), 10000);
+        }
+        exponent += exponentNegative ? -e : e;
+      }
+      else
+      {
+        p = exponentStart;
+      }
+    }
+
+    bool delimited = (p >= end || IsSpace(*p) || *p == '\n');
+    if (anyDigits && delimited && digitCount <= 15 && exponent >= -22 && exponent <= 22)
+    {
+      double result = double(mantissa);
+      result = (exponent < 0) ? result / powers[-exponent] : result * powers[exponent];
+      value = float(negative ? -result : result);
+      return true;
+    }
+
+    // Slow path, over a terminated copy of the token since the mapping has no terminator
+    p = start;
+    while (p < end && !IsSpace(*p) && *p != '\n')
+    {
+      p++;
+    }
+
+    std::string token(start, p);
+    char* tokenEnd;
+    double result = std::strtod(token.c_str(), &tokenEnd);
+    if (token.empty() || *tokenEnd != '\0')
+    {
+      return false;
+    }
+
+    value = float(result);
+    return true;
+  }
+};
+
+#endif // OBJ_FILE_H
\ No newline at end of file
@@ -5,24 +5,46 @@
 
 #include "Vec3.h"
 
-class Ray
+template <typename T>
+class RayT
 {
 public:
-  Ray() {}
+  RayT() {}
 
-  Ray(const Point3& origin, const Vec3& direction) : orig(origin), dir(direction) {}
+  RayT(const Vec3T<T>& origin, const Vec3T<T>& direction) : orig(origin), dir(direction) {}
 
-  const Point3& Origin() const  { return orig; }
-  const Vec3& Direction() const { return dir; }
+  const Vec3T<T>& Origin() const    { return orig; }
+  const Vec3T<T>& Direction() const { return dir; }
 
-  Point3 At(double t) const
+  Vec3T<T> At(T t) const
   {
     return orig + t*dir;
   }
 
 private:
-  Point3 orig;
-  Vec3 dir;
+  Vec3T<T> orig;
+  Vec3T<T> dir;
 };
 
+using Ray = RayT<Real>;
+
+template <typename T>
+inline T PointError(T magnitude)
+{
+  // Conservative bound on the rounding error of a surface point computed from values of the
+  // given magnitude, such as the absolute sum of a sphere's center and its radius
+  return 32 * std::numeric_limits<T>::epsilon() * magnitude;
+}
+
+template <typename T>
+inline Vec3T<T> OffsetRayOrigin(const Vec3T<T>& p, T pError, const Vec3T<T>& normal, const Vec3T<T>& direction)
+{
+  // Moves the origin of a ray leaving a surface at p by pError along the unit normal, to the
+  // side the ray leaves through, so the ray cannot hit the surface it starts on again. The
+  // offset follows the precision of p instead of being a fixed minimum t, so it holds at any
+  // scene scale and in float as well as double
+  T offset = (Dot(direction, normal) < 0) ? -pError : pError;
+  return p + offset * normal;
+}
+
 #endif // RAY_H
\ No newline at end of file
@@ -0,0 +1,205 @@
+#pragma once
+
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <algorithm>
+#include <iostream>
+
+// Hot-path counters only exist in builds configured with ENGINE_ENABLE_STATS. Everywhere else
+// ENGINE_STAT compiles to nothing, so instrumented code costs nothing in normal builds
+
+#if ENGINE_ENABLE_STATS
+#define ENGINE_STAT(statement) do { statement; } while (0)
+#else
+#define ENGINE_STAT(statement) do {} while (0)
+#endif
+
+class RenderStats
+{
+  // Counters and phase timers of one render. Every render worker counts into its own
+  // RenderStats, bound to its thread, and the camera merges them once the render is done
+
+public:
+  static const int materialTypeCount = 4;  // Entries of MaterialType
+  static const int pathLengthBins = 65;    // Paths of 64 or more rays share the last bin
+
+  // Rays
+  long long cameraRays = 0;
+  long long secondaryRays = 0;
+  long long escapedRays = 0;     // Rays that left the scene and picked up the background
+  long long shadowRays = 0;      // Rays aimed at a light from a diffuse hit
+
+  // Intersection work
+  long long nodeTests = 0;       // BVH node boxes tested
+  long long primitiveTests = 0;  // Ray-primitive tests
+
+  // Shading
+  long long hits[materialTypeCount] = {};      // Closest hits on each material type
+  long long absorbed[materialTypeCount] = {};  // Scatters that returned no ray, such as Metal
+                                               // fuzz that points below the surface
+
+  // Path termination
+  long long pathLengths[pathLengthBins] = {};  // Paths by number of rays traced
+  long long maxDepthTerminations = 0;
+  long long rouletteTerminations = 0;
+
+  // Timers, in seconds. They cost a clock read per tile at most, so they are always on
+  double setupSeconds = 0;
+  double renderSeconds = 0;
+  double resolveSeconds = 0;
+  double denoiseSeconds = 0;
+  double outputSeconds = 0;
+  double budgetSeconds = 0;    // Time budget of the render, 0 when it had none
+  long long tiles = 0;
+  double tileSeconds = 0;      // Sum over every tile
+  double maxTileSeconds = 0;
+
+  static bool CountersEnabled()
+  {
+#if ENGINE_ENABLE_STATS
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  static RenderStats& Thread()
+  {
+    // Stats the calling thread counts into. Threads that were never bound, such as the main
+    // thread of a benchmark, count into a private instance nobody reads
+    RenderStats* bound = ThreadSlot();
+    return bound ? *bound : Unbound();
+  }
+
+  static void Bind(RenderStats* stats)
+  {
+    // Makes stats the target of the calling thread's counters, or restores the private
+    // instance when stats is null
+    ThreadSlot() = stats;
+  }
+
+  void AddPath(int rays)
+  {
+    pathLengths[std::min(rays, pathLengthBins - 1)]++;
+  }
+
+  void AddTile(double seconds)
+  {
+    tiles++;
+    tileSeconds += seconds;
+    maxTileSeconds = std::max(maxTileSeconds, seconds);
+  }
+
+  void Merge(const RenderStats& other)
+  {
+    // Adds the counters of one worker. Phase timers belong to the render as a whole and are
+    // left alone
+
+    cameraRays += other.cameraRays;
+    secondaryRays += other.secondaryRays;
+    escapedRays += other.escapedRays;
+    shadowRays += other.shadowRays;
+    nodeTests += other.nodeTests;
+    primitiveTests += other.primitiveTests;
+
+    for (int type = 0; type < materialTypeCount; type++)
+    {
+      hits[type] += other.hits[type];
+      absorbed[type] += other.absorbed[type];
+    }
+
+    for (int bin = 0; bin < pathLengthBins; bin++)
+    {
+      pathLengths[bin] += other.pathLengths[bin];
+    }
+
+    maxDepthTerminations += other.maxDepthTerminations;
+    rouletteTerminations += other.rouletteTerminations;
+
+    tiles += other.tiles;
+    tileSeconds += other.tileSeconds;
+    maxTileSeconds = std::max(maxTileSeconds, other.maxTileSeconds);
+  }
+
+  void WriteJson(std::ostream& out) const
+  {
+    static const char* materialNames[materialTypeCount] = { "lambertian", "metal", "dielectric", "light" };
+
+    long long rays = cameraRays + secondaryRays;
+    double perRay = (rays > 0) ? 1.0 / rays : 0.0;
+
+    out << "{\n";
+    out << "  \"countersEnabled\": " << (CountersEnabled() ? "true" : "false") << ",\n";
+
+    out << "  \"seconds\": { "
+        << "\"setup\": " << setupSeconds
+        << ", \"render\": " << renderSeconds
+        << ", \"resolve\": " << resolveSeconds
+        << ", \"denoise\": " << denoiseSeconds
+        << ", \"output\": " << outputSeconds;
+    if (budgetSeconds > 0)
+    {
+      // Time past the budget, negative when the render finished early
+      out << ", \"budget\": " << budgetSeconds
+          << ", \"overBudget\": " << setupSeconds + renderSeconds + resolveSeconds - budgetSeconds;
+    }
+    out << " },\n";
+
+    out << "  \"tiles\": { "
+        << "\"count\": " << tiles
+        << ", \"meanSeconds\": " << ((tiles > 0) ? tileSeconds / tiles : 0.0)
+        << ", \"maxSeconds\": " << maxTileSeconds << " },\n";
+
+    out << "  \"rays\": { "
+        << "\"camera\": " << cameraRays
+        << ", \"secondary\": " << secondaryRays
+        << ", \"escaped\": " << escapedRays
+        << ", \"shadow\": " << shadowRays
+        << ", \"nodeTestsPerRay\": " << nodeTests * perRay
+        << ", \"primitiveTestsPerRay\": " << primitiveTests * perRay << " },\n";
+
+    out << "  \"materials\": {";
+    for (int type = 0; type < materialTypeCount; type++)
+    {
+      out << (type > 0 ? ", " : " ") << '"' << materialNames[type] << "\": { "
+          << "\"hits\": " << hits[type] << ", \"absorbed\": " << absorbed[type] << " }";
+    }
+    out << " },\n";
+
+    out << "  \"terminations\": { "
+        << "\"maxDepth\": " << maxDepthTerminations
+        << ", \"roulette\": " << rouletteTerminations << " },\n";
+
+    // Trailing empty bins are left out
+    int lastBin = pathLengthBins - 1;
+    while (lastBin > 0 && pathLengths[lastBin] == 0)
+    {
+      lastBin--;
+    }
+
+    out << "  \"pathLengths\": [";
+    for (int bin = 0; bin <= lastBin; bin++)
+    {
+      out << (bin > 0 ? ", " : "") << pathLengths[bin];
+    }
+    out << "]\n";
+
+    out << "}\n";
+  }
+
+private:
+  static RenderStats& Unbound()
+  {
+    thread_local RenderStats unbound;
+    return unbound;
+  }
+
+  static RenderStats*& ThreadSlot()
+  {
+    thread_local RenderStats* slot = nullptr;
+    return slot;
+  }
+};
+
+#endif // RENDER_STATS_H
\ No newline at end of file
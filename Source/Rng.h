@@ -0,0 +1,69 @@
+#pragma once
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+class Rng
+{
+  // PCG32 random number generator (XSH-RR output over a 64-bit LCG). It only holds 16 bytes
+  // of state, so every sample path can own one on the stack instead of sharing a generator
+  // between threads
+
+public:
+  Rng() : Rng(0) {}
+
+  explicit Rng(uint64_t seed, uint64_t stream = 0)
+  {
+    state = 0;
+    increment = (stream << 1) | 1;
+    NextUInt();
+    state += seed;
+    NextUInt();
+  }
+
+  static Rng ForSample(uint64_t pixel, uint64_t sample, uint64_t frame)
+  {
+    // Seeds a generator from the pixel, sample and frame indices alone, so a sample draws the
+    // same numbers no matter which thread renders it or in which order
+
+    uint64_t seed = MixBits(pixel);
+    seed = MixBits(seed ^ (sample + 0x9e3779b97f4a7c15ULL));
+    seed = MixBits(seed ^ (frame + 0x632be59bd9b4e019ULL));
+    return Rng(seed);
+  }
+
+  uint32_t NextUInt()
+  {
+    uint64_t oldState = state;
+    state = oldState * 6364136223846793005ULL + increment;
+
+    uint32_t xorShifted = uint32_t(((oldState >> 18) ^ oldState) >> 27);
+    uint32_t rotation = uint32_t(oldState >> 59);
+    return (xorShifted >> rotation) | (xorShifted << ((32 - rotation) & 31));
+  }
+
+  double NextDouble()
+  {
+    // Returns a random real in [0,1) with 32 bits of resolution
+    return NextUInt() * 2.3283064365386963e-10; // 2^-32
+  }
+
+  static uint64_t MixBits(uint64_t v)
+  {
+    // SplitMix64 finalizer, spreads nearby indices over the whole seed space
+    v ^= v >> 31;
+    v *= 0x7fb5d329728ea185ULL;
+    v ^= v >> 27;
+    v *= 0x81dadef4bc2dd44dULL;
+    v ^= v >> 33;
+    return v;
+  }
+
+private:
+  uint64_t state;
+  uint64_t increment;
+};
+
+#endif // RNG_H
\ No newline at end of file
@@ -0,0 +1,258 @@
+#pragma once
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+#include <string>
+#include "BlueNoise.h"
+#include "Engine.h"
+
+enum class SamplerType
+{
+  Independent,  // Uniform random numbers, every draw independent of the others
+  Stratified,   // Each dimension split into one stratum per pixel sample, jittered inside it
+  Sobol,        // Owen-scrambled Sobol points, shuffled and scrambled per pixel
+  BlueNoise     // Sobol points shared by every pixel, shifted per pixel by a blue noise mask
+};
+
+inline bool SamplerTypeFromName(const std::string& name, SamplerType& type)
+{
+  if (name == "independent") { type = SamplerType::Independent; return true; }
+  if (name == "stratified")  { type = SamplerType::Stratified;  return true; }
+  if (name == "sobol")       { type = SamplerType::Sobol;       return true; }
+  if (name == "bluenoise")   { type = SamplerType::BlueNoise;   return true; }
+  return false;
+}
+
+class Sampler
+{
+  // Source of the random numbers of one camera sample. A path asks for its numbers in a fixed
+  // layout of dimensions: the pixel jitter, the lens position, then one block per bounce.
+  // The low-discrepancy types make the samples of a pixel cover each dimension, or pair of
+  // dimensions, more evenly than independent numbers would, which lowers the error at equal
+  // sample counts. Pairs come from the first two Sobol dimensions with their own scramble
+  // per pair (padding), so any number of bounces stays well distributed.
+  //
+  // Like Rng, a sampler is a small value owned by its path and seeded only from the pixel,
+  // sample and frame indices, so images don't depend on threads or schedules
+
+public:
+  static const int cameraDimensions = 4;   // Pixel jitter, then lens position
+  static const int bounceDimensions = 8;   // Room for the light, scatter and roulette numbers of a bounce
+
+  Sampler() : Sampler(SamplerType::Independent, 0, 0, 0, 0, 1, 0) {}
+
+  Sampler(SamplerType type, int x, int y, uint64_t pixelIndex, int sampleIndex, int sampleCount, int frame) :
+    type(type),
+    rng(Rng::ForSample(pixelIndex, uint64_t(sampleIndex), uint64_t(frame))),
+    x(x),
+    y(y),
+    dimension(0)
+  {
+    // Blue noise samplers share their sequence between pixels, only the frame changes it
+    uint64_t pixelMix = (type == SamplerType::BlueNoise) ? 0 : Rng::MixBits(pixelIndex);
+    seed = uint32_t(Rng::MixBits(pixelMix ^ (uint64_t(frame) + 0x632be59bd9b4e019ULL)));
+
+    if (type == SamplerType::Stratified)
+    {
+      // Samples past the count start another round of strata, with other permutations. Pairs
+      // use the smallest square grid with a cell for every sample
+      count = uint32_t(sampleCount > 0 ? sampleCount : 1);
+      stratum = uint32_t(sampleIndex) % count;
+      seed = Hash(seed ^ (uint32_t(sampleIndex) / count));
+
+      gridSize = uint32_t(std::sqrt(double(count)));
+      gridSize += (gridSize * gridSize < count) ? 1 : 0;
+    }
+    else
+    {
+      // Sobol points are produced with their bits reversed, where the index is too
+      reversedIndex = ReverseBits(uint32_t(sampleIndex));
+    }
+  }
+
+  void StartBounce(int bounce)
+  {
+    // Moves to the block of dimensions of a bounce, however many the last one used
+    dimension = cameraDimensions + bounce * bounceDimensions;
+  }
+
+  double Get1D()
+  {
+    uint32_t d = dimension++;
+
+    if (type == SamplerType::Independent)
+    {
+      return rng.NextDouble();
+    }
+
+    if (type == SamplerType::Stratified)
+    {
+      uint32_t s = Permute(stratum, count, DimensionSeed(d));
+      return (s + rng.NextDouble()) / count;
+    }
+
+    // The first Sobol dimension is the bit reversal of the index, so the reversed point is
+    // the index itself
+    uint32_t dimensionSeed = DimensionSeed(d);
+    uint32_t index = ShuffledIndex(dimensionSeed);
+    return ToUnit(ReverseBits(LaineKarras(index, Hash(dimensionSeed ^ 1))) + Shift(d, 0));
+  }
+
+  void Get2D(double& u, double& v)
+  {
+    uint32_t d = dimension;
+    dimension += 2;
+
+    if (type == SamplerType::Independent)
+    {
+      u = rng.NextDouble();
+      v = rng.NextDouble();
+      return;
+    }
+
+    if (type == SamplerType::Stratified)
+    {
+      // One cell of the grid per sample. Sample counts that aren't squares leave some cells
+      // empty, but no two samples share one
+      uint32_t cell = Permute(stratum, gridSize * gridSize, DimensionSeed(d));
+      uint32_t row = cell / gridSize;
+      u = (cell - row * gridSize + rng.NextDouble()) / gridSize;
+      v = (row + rng.NextDouble()) / gridSize;
+      return;
+    }
+
+    uint32_t dimensionSeed = DimensionSeed(d);
+    uint32_t index = ShuffledIndex(dimensionSeed);
+    u = ToUnit(ReverseBits(LaineKarras(index, Hash(dimensionSeed ^ 1))) + Shift(d, 0));
+    v = ToUnit(ReverseBits(LaineKarras(SobolSecondReversed(index), Hash(dimensionSeed ^ 2))) + Shift(d, 1));
+  }
+
+private:
+  SamplerType type;
+  Rng rng;             // Independent numbers, and the jitter of stratified samples
+  int x, y;            // Pixel, for the blue noise mask
+  uint32_t seed;
+  uint32_t dimension;  // Next dimension handed out
+
+  uint32_t reversedIndex = 0;  // Sobol and blue noise: sample index with its bits reversed
+  uint32_t count = 1;          // Stratified: strata per dimension
+  uint32_t stratum = 0;        // Stratified: stratum of this sample before permuting
+  uint32_t gridSize = 1;       // Stratified: cells per side of the grid of pairs
+
+  uint32_t DimensionSeed(uint32_t d) const
+  {
+    return Hash(seed ^ (d * 0x9e3779b9u));
+  }
+
+  uint32_t ShuffledIndex(uint32_t dimensionSeed) const
+  {
+    // Owen scrambling the index shuffles the sequence differently for every pair, so the
+    // pairs of a sample don't line up, while keeping every power-of-two prefix a block of it
+    return ReverseBits(LaineKarras(reversedIndex, dimensionSeed));
+  }
+
+  uint32_t Shift(uint32_t d, uint32_t axis) const
+  {
+    // Blue noise samplers move the shared points of each dimension by the mask, read at an
+    // offset of its own so the dimensions don't move together. Other types don't shift
+    if (type != SamplerType::BlueNoise)
+    {
+      return 0;
+    }
+    uint32_t offset = Hash((d << 1 | axis) + 0x7f4a7c15u);
+    return BlueNoise::Value(x + int(offset & 0xffff), y + int(offset >> 16));
+  }
+
+  static double ToUnit(uint32_t value)
+  {
+    return value * 2.3283064365386963e-10; // 2^-32
+  }
+
+  static uint32_t Hash(uint32_t v)
+  {
+    // Chris Wellons' lowbias32 integer hash
+    v ^= v >> 16;
+    v *= 0x7feb352du;
+    v ^= v >> 15;
+    v *= 0x846ca68bu;
+    v ^= v >> 16;
+    return v;
+  }
+
+  static uint32_t ReverseBits(uint32_t v)
+  {
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+    v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+    return (v >> 16) | (v << 16);
+  }
+
+  static uint32_t LaineKarras(uint32_t v, uint32_t seed)
+  {
+    // Owen scramble of a bit-reversed value, with the hash of Burley's "Practical Hash-based
+    // Owen Scrambling": each bit only flips depending on the bits below it, which are the
+    // leading bits of the point, so points that shared an elementary interval still do
+    v += seed;
+    v ^= v * 0x6c50b47cu;
+    v ^= v * 0xb82f1e52u;
+    v ^= v * 0xc7afe638u;
+    v ^= v * 0x8d22f6e6u;
+    return v;
+  }
+
+  static uint32_t SobolSecondReversed(uint32_t index)
+  {
+    // Second Sobol dimension with its bits reversed. Its generator matrix is Pascal's
+    // triangle mod 2, so bit t of the result is the parity of the index bits whose position
+    // contains every bit of t, a superset sum done one bit of t at a time
+    uint32_t v = index;
+    v ^= (v >> 1) & 0x55555555u;
+    v ^= (v >> 2) & 0x33333333u;
+    v ^= (v >> 4) & 0x0f0f0f0fu;
+    v ^= (v >> 8) & 0x00ff00ffu;
+    v ^= (v >> 16) & 0x0000ffffu;
+    return v;
+  }
+
+  static uint32_t Permute(uint32_t i, uint32_t length, uint32_t seed)
+  {
+    // Element i of a random permutation of [0, length), from Kensler's "Correlated
+    // Multi-Jittered Sampling": a hash that is a bijection on the next power of two, cycled
+    // until it lands inside the range
+    uint32_t mask = length - 1;
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    mask |= mask >> 16;
+
+    do
+    {
+      i ^= seed;
+      i *= 0xe170893du;
+      i ^= seed >> 16;
+      i ^= (i & mask) >> 4;
+      i ^= seed >> 8;
+      i *= 0x0929eb3fu;
+      i ^= seed >> 23;
+      i ^= (i & mask) >> 1;
+      i *= 1 | seed >> 27;
+      i *= 0x6935fa69u;
+      i ^= (i & mask) >> 11;
+      i *= 0x74dcb303u;
+      i ^= (i & mask) >> 2;
+      i *= 0x9e501cc3u;
+      i ^= (i & mask) >> 2;
+      i *= 0xc860a3dfu;
+      i &= mask;
+      i ^= i >> 5;
+    } while (i >= length);
+
+    return (i + seed) % length;
+  }
+};
+
+#endif // SAMPLER_H
\ No newline at end of file
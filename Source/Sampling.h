@@ -0,0 +1,648 @@
+#pragma once
+
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "Simd.h"
+
+// Closed-form mappings from uniform pairs in the unit square to points and directions. Every
+// pair maps to exactly one result, with no rejection loop, so low-discrepancy pairs keep their
+// spread, every draw is used and there is no data-dependent branch to mispredict.
+//
+// Angles go through SinCosTurns, a polynomial with its quadrant picked by selects, so the
+// batched SIMD kernels of DirectionBatch can run the same operations lane by lane and return
+// the same bits as these scalar functions. Paths that sample one direction at a time and
+// paths that sample a whole wave at once then render the same image
+
+inline void SinCosTurns(double t, double& s, double& c)
+{
+  // Sine and cosine of the angle of t turns, for t in [-1/8, 1]. The angle is reduced to
+  // [-pi/4, pi/4] around the nearest quarter turn, where Cephes' polynomials are accurate to
+  // a few units in the last place, and rotated back by swapping and negating
+  double q = double(int(4 * t + 0.5));
+  double a = (t - q * 0.25) * (2 * pi);
+  double z = a * a;
+
+  double ps = 1.58962301576546568060e-10;
+  ps = ps * z + -2.50507477628578072866e-8;
+  ps = ps * z + 2.75573136213857245213e-6;
+  ps = ps * z + -1.98412698295895385996e-4;
+  ps = ps * z + 8.33333333332211858878e-3;
+  ps = ps * z + -1.66666666666666307295e-1;
+  double sinA = a + a * z * ps;
+
+  double pc = -1.13585365213876817300e-11;
+  pc = pc * z + 2.08757008419747316778e-9;
+  pc = pc * z + -2.75573141792967388112e-7;
+  pc = pc * z + 2.48015872888517045348e-5;
+  pc = pc * z + -1.38888888888730564116e-3;
+  pc = pc * z + 4.16666666666665929218e-2;
+  double cosA = 1 - 0.5 * z + z * z * pc;
+
+  bool swap = (q == 1 || q == 3);
+  s = swap ? cosA : sinA;
+  c = swap ? sinA : cosA;
+  s = (q == 2 || q == 3) ? -s : s;
+  c = (q == 1 || q == 2) ? -c : c;
+}
+
+inline void ConcentricDisk(double u, double v, double& x, double& y)
+{
+  // Uniform point on the unit disk, by Shirley and Chiu's concentric mapping, which keeps
+  // neighboring points of the square neighbors on the disk. The center maps to the origin
+  double a = 2 * u - 1;
+  double b = 2 * v - 1;
+  bool wide = std::fabs(a) > std::fabs(b);
+  double r = wide ? a : b;
+  double ratio = (wide ? b : a) / (r == 0 ? 1 : r) * 0.125;
+
+  double s, c;
+  SinCosTurns(wide ? ratio : 0.25 - ratio, s, c);
+  x = r * c;
+  y = r * s;
+}
+
+inline void UniformSphere(double u, double v, double& x, double& y, double& z)
+{
+  // Uniform point on the unit sphere: z uniform in [-1, 1], the angle around z uniform
+  z = 1 - 2 * u;
+  double r = std::sqrt(std::fmax(0.0, 1 - z * z));
+
+  double s, c;
+  SinCosTurns(v, s, c);
+  x = r * c;
+  y = r * s;
+}
+
+inline void CosineHemisphere(double nx, double ny, double nz, double u, double v, double& x, double& y, double& z)
+{
+  // Cosine-weighted direction about the unit normal n. A uniform disk point is lifted onto
+  // the hemisphere (Malley's method), then taken to the frame of n with the branchless basis
+  // of Duff et al., "Building an Orthonormal Basis, Revisited"
+  double dx, dy;
+  ConcentricDisk(u, v, dx, dy);
+  double dz = std::sqrt(std::fmax(0.0, 1 - dx * dx - dy * dy));
+
+  double sign = (nz >= 0) ? 1.0 : -1.0;
+  double a = -1 / (sign + nz);
+  double b = nx * ny * a;
+  double tx = 1 + sign * nx * nx * a, ty = sign * b, tz = -sign * nx;
+  double bx = b, by = sign + ny * ny * a, bz = -ny;
+
+  x = dx * tx + dy * bx + dz * nx;
+  y = dx * ty + dy * by + dz * ny;
+  z = dx * tz + dy * bz + dz * nz;
+}
+
+// Vec3 forms
+
+inline Vec3 SampleConcentricDisk(double u, double v)
+{
+  // Uniform point on the unit disk in the xy plane
+  double x, y;
+  ConcentricDisk(u, v, x, y);
+  return Vec3(Real(x), Real(y), 0);
+}
+
+inline Vec3 SampleUniformSphere(double u, double v)
+{
+  // Uniform point on the unit sphere
+  double x, y, z;
+  UniformSphere(u, v, x, y, z);
+  return Vec3(Real(x), Real(y), Real(z));
+}
+
+inline double UniformSpherePdf()
+{
+  return 1 / (4 * pi);
+}
+
+inline Vec3 SampleCosineHemisphere(const Vec3& normal, double u, double v)
+{
+  // Unit direction on the side of normal, with density CosineHemispherePdf over solid angle
+  double x, y, z;
+  CosineHemisphere(normal.X(), normal.Y(), normal.Z(), u, v, x, y, z);
+  return Vec3(Real(x), Real(y), Real(z));
+}
+
+inline double CosineHemispherePdf(double cosTheta)
+{
+  // Density over solid angle of a direction at cosTheta to the normal
+  return std::fmax(cosTheta, 0.0) / pi;
+}
+
+// Directions from a random number generator, two draws each
+
+inline Vec3 RandomNormalized2DVector(Rng& rng)
+{
+  // Uniform point inside the unit disk in the xy plane
+  double u = RandomDouble(rng);
+  double v = RandomDouble(rng);
+  return SampleConcentricDisk(u, v);
+}
+
+inline Vec3 RandomNormalizedVector(Rng& rng)
+{
+  double u = RandomDouble(rng);
+  double v = RandomDouble(rng);
+  return SampleUniformSphere(u, v);
+}
+
+inline Vec3 RandomOnHemisphere(const Vec3& normal, Rng& rng)
+{
+  Vec3 onUnitSphere = RandomNormalizedVector(rng);
+
+  if (Dot(onUnitSphere, normal) > 0.0) // In the same hemisphere as the normal
+  {
+    return onUnitSphere;
+  }
+  else
+  {
+    return -onUnitSphere;
+  }
+}
+
+inline Vec3 LambertianSphere(const Vec3& normal, Rng& rng)
+{
+  // Cosine-weighted direction about the unit normal
+  double u = RandomDouble(rng);
+  double v = RandomDouble(rng);
+  return SampleCosineHemisphere(normal, u, v);
+}
+
+class DirectionBatch
+{
+  // Structure-of-arrays buffers for sampling many directions at once. Fill u and v (and the
+  // normals, for the hemisphere) with count entries, run a kernel, and read the results from
+  // x, y and z. SIMD kernels take as many lanes as the CPU has, and every result has the bits
+  // of the scalar function of the same name
+
+public:
+  std::vector<double> u, v;                       // Uniform pairs in
+  std::vector<double> normalX, normalY, normalZ;  // Unit normals in, for CosineHemisphere
+  std::vector<double> x, y, z;                    // Points or directions out
+
+  void Resize(size_t count)
+  {
+    u.resize(count);
+    v.resize(count);
+    normalX.resize(count);
+    normalY.resize(count);
+    normalZ.resize(count);
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+  }
+
+  void SetNormal(size_t i, const Vec3& normal)
+  {
+    normalX[i] = normal.X();
+    normalY[i] = normal.Y();
+    normalZ[i] = normal.Z();
+  }
+
+  Vec3 Result(size_t i) const
+  {
+    return Vec3(Real(x[i]), Real(y[i]), Real(z[i]));
+  }
+
+  void ConcentricDisk(int count)
+  {
+    // Disk points in x and y, z untouched
+    static const BatchKernel kernel = SelectKernel(&DiskScalar, &DiskSSE2, &DiskAVX2, &DiskAVX512);
+    kernel(*this, count);
+  }
+
+  void UniformSphere(int count)
+  {
+    static const BatchKernel kernel = SelectKernel(&SphereScalar, &SphereSSE2, &SphereAVX2, &SphereAVX512);
+    kernel(*this, count);
+  }
+
+  void CosineHemisphere(int count)
+  {
+    static const BatchKernel kernel = SelectKernel(&HemisphereScalar, &HemisphereSSE2, &HemisphereAVX2, &HemisphereAVX512);
+    kernel(*this, count);
+  }
+
+private:
+  typedef void (*BatchKernel)(DirectionBatch& batch, int count);
+
+  static BatchKernel SelectKernel(BatchKernel scalar, BatchKernel sse2, BatchKernel avx2, BatchKernel avx512)
+  {
+#if ENGINE_SIMD_X86
+    switch (ActiveSimdLevel())
+    {
+      case SimdLevel::AVX512: return avx512;
+      case SimdLevel::AVX2:   return avx2;
+      case SimdLevel::SSE2:   return sse2;
+      default:                break;
+    }
+#endif
+    return scalar;
+  }
+
+  // Scalar kernels, which also finish the entries past the last full vector of the SIMD ones
+
+  static void DiskScalar(DirectionBatch& b, int count)
+  {
+    DiskTail(b, 0, count);
+  }
+
+  static void SphereScalar(DirectionBatch& b, int count)
+  {
+    SphereTail(b, 0, count);
+  }
+
+  static void HemisphereScalar(DirectionBatch& b, int count)
+  {
+    HemisphereTail(b, 0, count);
+  }
+
+  static void DiskTail(DirectionBatch& b, int i, int count)
+  {
+    for (; i < count; i++)
+    {
+      ::ConcentricDisk(b.u[i], b.v[i], b.x[i], b.y[i]);
+    }
+  }
+
+  static void SphereTail(DirectionBatch& b, int i, int count)
+  {
+    for (; i < count; i++)
+    {
+      ::UniformSphere(b.u[i], b.v[i], b.x[i], b.y[i], b.z[i]);
+    }
+  }
+
+  static void HemisphereTail(DirectionBatch& b, int i, int count)
+  {
+    for (; i < count; i++)
+    {
+      ::CosineHemisphere(b.normalX[i], b.normalY[i], b.normalZ[i], b.u[i], b.v[i], b.x[i], b.y[i], b.z[i]);
+    }
+  }
+
+  // SIMD kernels, one entry per lane. Each step is the operation of the scalar code, in the
+  // same order, and selects stand in for its conditionals
+
+#if ENGINE_SIMD_X86
+  ENGINE_TARGET_SSE2
+  static __m128d SelectSSE2(__m128d mask, __m128d a, __m128d b)
+  {
+    // a where mask is set, b elsewhere
+    return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+  }
+
+  ENGINE_TARGET_SSE2
+  static void SinCosTurnsSSE2(__m128d t, __m128d& s, __m128d& c)
+  {
+    __m128d q = _mm_cvtepi32_pd(_mm_cvttpd_epi32(_mm_add_pd(_mm_mul_pd(_mm_set1_pd(4), t), _mm_set1_pd(0.5))));
+    __m128d a = _mm_mul_pd(_mm_sub_pd(t, _mm_mul_pd(q, _mm_set1_pd(0.25))), _mm_set1_pd(2 * pi));
+    __m128d z = _mm_mul_pd(a, a);
+
+    __m128d ps = _mm_set1_pd(1.58962301576546568060e-10);
+    ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(-2.50507477628578072866e-8));
+    ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(2.75573136213857245213e-6));
+    ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(-1.98412698295895385996e-4));
+    ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(8.33333333332211858878e-3));
+    ps = _mm_add_pd(_mm_mul_pd(ps, z), _mm_set1_pd(-1.66666666666666307295e-1));
+    __m128d sinA = _mm_add_pd(a, _mm_mul_pd(_mm_mul_pd(a, z), ps));
+
+    __m128d pc = _mm_set1_pd(-1.13585365213876817300e-11);
+    pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(2.08757008419747316778e-9));
+    pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(-2.75573141792967388112e-7));
+    pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(2.48015872888517045348e-5));
+    pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(-1.38888888888730564116e-3));
+    pc = _mm_add_pd(_mm_mul_pd(pc, z), _mm_set1_pd(4.16666666666665929218e-2));
+    __m128d cosA = _mm_add_pd(_mm_sub_pd(_mm_set1_pd(1), _mm_mul_pd(_mm_set1_pd(0.5), z)), _mm_mul_pd(_mm_mul_pd(z, z), pc));
+
+    __m128d q1 = _mm_cmpeq_pd(q, _mm_set1_pd(1));
+    __m128d q2 = _mm_cmpeq_pd(q, _mm_set1_pd(2));
+    __m128d q3 = _mm_cmpeq_pd(q, _mm_set1_pd(3));
+    __m128d swap = _mm_or_pd(q1, q3);
+    __m128d signBit = _mm_set1_pd(-0.0);
+    s = _mm_xor_pd(SelectSSE2(swap, cosA, sinA), _mm_and_pd(_mm_or_pd(q2, q3), signBit));
+    c = _mm_xor_pd(SelectSSE2(swap, sinA, cosA), _mm_and_pd(_mm_or_pd(q1, q2), signBit));
+  }
+
+  ENGINE_TARGET_SSE2
+  static void ConcentricDiskSSE2(__m128d u, __m128d v, __m128d& x, __m128d& y)
+  {
+    __m128d one = _mm_set1_pd(1);
+    __m128d signBit = _mm_set1_pd(-0.0);
+    __m128d a = _mm_sub_pd(_mm_mul_pd(_mm_set1_pd(2), u), one);
+    __m128d b = _mm_sub_pd(_mm_mul_pd(_mm_set1_pd(2), v), one);
+    __m128d wide = _mm_cmpgt_pd(_mm_andnot_pd(signBit, a), _mm_andnot_pd(signBit, b));
+    __m128d r = SelectSSE2(wide, a, b);
+    __m128d denominator = SelectSSE2(_mm_cmpeq_pd(r, _mm_setzero_pd()), one, r);
+    __m128d ratio = _mm_mul_pd(_mm_div_pd(SelectSSE2(wide, b, a), denominator), _mm_set1_pd(0.125));
+
+    __m128d s, c;
+    SinCosTurnsSSE2(SelectSSE2(wide, ratio, _mm_sub_pd(_mm_set1_pd(0.25), ratio)), s, c);
+    x = _mm_mul_pd(r, c);
+    y = _mm_mul_pd(r, s);
+  }
+
+  ENGINE_TARGET_SSE2
+  static void DiskSSE2(DirectionBatch& b, int count)
+  {
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+      __m128d x, y;
+      ConcentricDiskSSE2(_mm_loadu_pd(&b.u[i]), _mm_loadu_pd(&b.v[i]), x, y);
+      _mm_storeu_pd(&b.x[i], x);
+      _mm_storeu_pd(&b.y[i], y);
+    }
+    DiskTail(b, i, count);
+  }
+
+  ENGINE_TARGET_SSE2
+  static void SphereSSE2(DirectionBatch& b, int count)
+  {
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+      __m128d z = _mm_sub_pd(_mm_set1_pd(1), _mm_mul_pd(_mm_set1_pd(2), _mm_loadu_pd(&b.u[i])));
+      __m128d r = _mm_sqrt_pd(_mm_max_pd(_mm_setzero_pd(), _mm_sub_pd(_mm_set1_pd(1), _mm_mul_pd(z, z))));
+
+      __m128d s, c;
+      SinCosTurnsSSE2(_mm_loadu_pd(&b.v[i]), s, c);
+      _mm_storeu_pd(&b.x[i], _mm_mul_pd(r, c));
+      _mm_storeu_pd(&b.y[i], _mm_mul_pd(r, s));
+      _mm_storeu_pd(&b.z[i], z);
+    }
+    SphereTail(b, i, count);
+  }
+
+  ENGINE_TARGET_SSE2
+  static void HemisphereSSE2(DirectionBatch& b, int count)
+  {
+    const __m128d one = _mm_set1_pd(1);
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+      __m128d dx, dy;
+      ConcentricDiskSSE2(_mm_loadu_pd(&b.u[i]), _mm_loadu_pd(&b.v[i]), dx, dy);
+      __m128d dz = _mm_sqrt_pd(_mm_max_pd(_mm_setzero_pd(), _mm_sub_pd(_mm_sub_pd(one, _mm_mul_pd(dx, dx)), _mm_mul_pd(dy, dy))));
+
+      __m128d nx = _mm_loadu_pd(&b.normalX[i]), ny = _mm_loadu_pd(&b.normalY[i]), nz = _mm_loadu_pd(&b.normalZ[i]);
+      __m128d sign = SelectSSE2(_mm_cmpge_pd(nz, _mm_setzero_pd()), one, _mm_set1_pd(-1));
+      __m128d a = _mm_div_pd(_mm_set1_pd(-1), _mm_add_pd(sign, nz));
+      __m128d bb = _mm_mul_pd(_mm_mul_pd(nx, ny), a);
+      __m128d tx = _mm_add_pd(one, _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(sign, nx), nx), a));
+      __m128d ty = _mm_mul_pd(sign, bb);
+      __m128d tz = _mm_mul_pd(_mm_xor_pd(sign, _mm_set1_pd(-0.0)), nx);
+      __m128d by = _mm_add_pd(sign, _mm_mul_pd(_mm_mul_pd(ny, ny), a));
+      __m128d bz = _mm_xor_pd(ny, _mm_set1_pd(-0.0));
+
+      _mm_storeu_pd(&b.x[i], _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, tx), _mm_mul_pd(dy, bb)), _mm_mul_pd(dz, nx)));
+      _mm_storeu_pd(&b.y[i], _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, ty), _mm_mul_pd(dy, by)), _mm_mul_pd(dz, ny)));
+      _mm_storeu_pd(&b.z[i], _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, tz), _mm_mul_pd(dy, bz)), _mm_mul_pd(dz, nz)));
+    }
+    HemisphereTail(b, i, count);
+  }
+
+  ENGINE_TARGET_AVX2
+  static void SinCosTurnsAVX2(__m256d t, __m256d& s, __m256d& c)
+  {
+    __m256d q = _mm256_cvtepi32_pd(_mm256_cvttpd_epi32(_mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(4), t), _mm256_set1_pd(0.5))));
+    __m256d a = _mm256_mul_pd(_mm256_sub_pd(t, _mm256_mul_pd(q, _mm256_set1_pd(0.25))), _mm256_set1_pd(2 * pi));
+    __m256d z = _mm256_mul_pd(a, a);
+
+    __m256d ps = _mm256_set1_pd(1.58962301576546568060e-10);
+    ps = _mm256_add_pd(_mm256_mul_pd(ps, z), _mm256_set1_pd(-2.50507477628578072866e-8));
+    ps = _mm256_add_pd(_mm256_mul_pd(ps, z), _mm256_set1_pd(2.75573136213857245213e-6));
+    ps = _mm256_add_pd(_mm256_mul_pd(ps, z), _mm256_set1_pd(-1.98412698295895385996e-4));
+    ps = _mm256_add_pd(_mm256_mul_pd(ps, z), _mm256_set1_pd(8.33333333332211858878e-3));
+    ps = _mm256_add_pd(_mm256_mul_pd(ps, z), _mm256_set1_pd(-1.66666666666666307295e-1));
+    __m256d sinA = _mm256_add_pd(a, _mm256_mul_pd(_mm256_mul_pd(a, z), ps));
+
+    __m256d pc = _mm256_set1_pd(-1.13585365213876817300e-11);
+    pc = _mm256_add_pd(_mm256_mul_pd(pc, z), _mm256_set1_pd(2.08757008419747316778e-9));
+    pc = _mm256_add_pd(_mm256_mul_pd(pc, z), _mm256_set1_pd(-2.75573141792967388112e-7));
+    pc = _mm256_add_pd(_mm256_mul_pd(pc, z), _mm256_set1_pd(2.48015872888517045348e-5));
+    pc = _mm256_add_pd(_mm256_mul_pd(pc, z), _mm256_set1_pd(-1.38888888888730564116e-3));
+    pc = _mm256_add_pd(_mm256_mul_pd(pc, z), _mm256_set1_pd(4.16666666666665929218e-2));
+    __m256d cosA = _mm256_add_pd(_mm256_sub_pd(_mm256_set1_pd(1), _mm256_mul_pd(_mm256_set1_pd(0.5), z)), _mm256_mul_pd(_mm256_mul_pd(z, z), pc));
+
+    __m256d q1 = _mm256_cmp_pd(q, _mm256_set1_pd(1), _CMP_EQ_OQ);
+    __m256d q2 = _mm256_cmp_pd(q, _mm256_set1_pd(2), _CMP_EQ_OQ);
+    __m256d q3 = _mm256_cmp_pd(q, _mm256_set1_pd(3), _CMP_EQ_OQ);
+    __m256d swap = _mm256_or_pd(q1, q3);
+    __m256d signBit = _mm256_set1_pd(-0.0);
+    s = _mm256_xor_pd(_mm256_blendv_pd(sinA, cosA, swap), _mm256_and_pd(_mm256_or_pd(q2, q3), signBit));
+    c = _mm256_xor_pd(_mm256_blendv_pd(cosA, sinA, swap), _mm256_and_pd(_mm256_or_pd(q1, q2), signBit));
+  }
+
+  ENGINE_TARGET_AVX2
+  static void ConcentricDiskAVX2(__m256d u, __m256d v, __m256d& x, __m256d& y)
+  {
+    __m256d one = _mm256_set1_pd(1);
+    __m256d signBit = _mm256_set1_pd(-0.0);
+    __m256d a = _mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(2), u), one);
+    __m256d b = _mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(2), v), one);
+    __m256d wide = _mm256_cmp_pd(_mm256_andnot_pd(signBit, a), _mm256_andnot_pd(signBit, b), _CMP_GT_OQ);
+    __m256d r = _mm256_blendv_pd(b, a, wide);
+    __m256d denominator = _mm256_blendv_pd(r, one, _mm256_cmp_pd(r, _mm256_setzero_pd(), _CMP_EQ_OQ));
+    __m256d ratio = _mm256_mul_pd(_mm256_div_pd(_mm256_blendv_pd(a, b, wide), denominator), _mm256_set1_pd(0.125));
+
+    __m256d s, c;
+    SinCosTurnsAVX2(_mm256_blendv_pd(_mm256_sub_pd(_mm256_set1_pd(0.25), ratio), ratio, wide), s, c);
+    x = _mm256_mul_pd(r, c);
+    y = _mm256_mul_pd(r, s);
+  }
+
+  ENGINE_TARGET_AVX2
+  static void DiskAVX2(DirectionBatch& b, int count)
+  {
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+      __m256d x, y;
+      ConcentricDiskAVX2(_mm256_loadu_pd(&b.u[i]), _mm256_loadu_pd(&b.v[i]), x, y);
+      _mm256_storeu_pd(&b.x[i], x);
+      _mm256_storeu_pd(&b.y[i], y);
+    }
+    DiskTail(b, i, count);
+  }
+
+  ENGINE_TARGET_AVX2
+  static void SphereAVX2(DirectionBatch& b, int count)
+  {
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+      __m256d z = _mm256_sub_pd(_mm256_set1_pd(1), _mm256_mul_pd(_mm256_set1_pd(2), _mm256_loadu_pd(&b.u[i])));
+      __m256d r = _mm256_sqrt_pd(_mm256_max_pd(_mm256_setzero_pd(), _mm256_sub_pd(_mm256_set1_pd(1), _mm256_mul_pd(z, z))));
+
+      __m256d s, c;
+      SinCosTurnsAVX2(_mm256_loadu_pd(&b.v[i]), s, c);
+      _mm256_storeu_pd(&b.x[i], _mm256_mul_pd(r, c));
+      _mm256_storeu_pd(&b.y[i], _mm256_mul_pd(r, s));
+      _mm256_storeu_pd(&b.z[i], z);
+    }
+    SphereTail(b, i, count);
+  }
+
+  ENGINE_TARGET_AVX2
+  static void HemisphereAVX2(DirectionBatch& b, int count)
+  {
+    const __m256d one = _mm256_set1_pd(1);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+      __m256d dx, dy;
+      ConcentricDiskAVX2(_mm256_loadu_pd(&b.u[i]), _mm256_loadu_pd(&b.v[i]), dx, dy);
+      __m256d dz = _mm256_sqrt_pd(_mm256_max_pd(_mm256_setzero_pd(), _mm256_sub_pd(_mm256_sub_pd(one, _mm256_mul_pd(dx, dx)), _mm256_mul_pd(dy, dy))));
+
+      __m256d nx = _mm256_loadu_pd(&b.normalX[i]), ny = _mm256_loadu_pd(&b.normalY[i]), nz = _mm256_loadu_pd(&b.normalZ[i]);
+      __m256d sign = _mm256_blendv_pd(_mm256_set1_pd(-1), one, _mm256_cmp_pd(nz, _mm256_setzero_pd(), _CMP_GE_OQ));
+      __m256d a = _mm256_div_pd(_mm256_set1_pd(-1), _mm256_add_pd(sign, nz));
+      __m256d bb = _mm256_mul_pd(_mm256_mul_pd(nx, ny), a);
+      __m256d tx = _mm256_add_pd(one, _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(sign, nx), nx), a));
+      __m256d ty = _mm256_mul_pd(sign, bb);
+      __m256d tz = _mm256_mul_pd(_mm256_xor_pd(sign, _mm256_set1_pd(-0.0)), nx);
+      __m256d by = _mm256_add_pd(sign, _mm256_mul_pd(_mm256_mul_pd(ny, ny), a));
+      __m256d bz = _mm256_xor_pd(ny, _mm256_set1_pd(-0.0));
+
+      _mm256_storeu_pd(&b.x[i], _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, tx), _mm256_mul_pd(dy, bb)), _mm256_mul_pd(dz, nx)));
+      _mm256_storeu_pd(&b.y[i], _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, ty), _mm256_mul_pd(dy, by)), _mm256_mul_pd(dz, ny)));
+      _mm256_storeu_pd(&b.z[i], _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, tz), _mm256_mul_pd(dy, bz)), _mm256_mul_pd(dz, nz)));
+    }
+    HemisphereTail(b, i, count);
+  }
+
+  ENGINE_TARGET_AVX512
+  static __m512d NegateAVX512(__m512d x, __mmask8 mask)
+  {
+    // -x in the lanes of mask, by flipping the sign bit as the scalar negation does
+    __m512i bits = _mm512_castpd_si512(x);
+    return _mm512_castsi512_pd(_mm512_mask_xor_epi64(bits, mask, bits, _mm512_set1_epi64(int64_t(0x8000000000000000ULL))));
+  }
+
+  ENGINE_TARGET_AVX512
+  static void SinCosTurnsAVX512(__m512d t, __m512d& s, __m512d& c)
+  {
+    __m512d q = _mm512_cvtepi32_pd(_mm512_cvttpd_epi32(_mm512_add_pd(_mm512_mul_pd(_mm512_set1_pd(4), t), _mm512_set1_pd(0.5))));
+    __m512d a = _mm512_mul_pd(_mm512_sub_pd(t, _mm512_mul_pd(q, _mm512_set1_pd(0.25))), _mm512_set1_pd(2 * pi));
+    __m512d z = _mm512_mul_pd(a, a);
+
+    __m512d ps = _mm512_set1_pd(1.58962301576546568060e-10);
+    ps = _mm512_add_pd(_mm512_mul_pd(ps, z), _mm512_set1_pd(-2.50507477628578072866e-8));
+    ps = _mm512_add_pd(_mm512_mul_pd(ps, z), _mm512_set1_pd(2.75573136213857245213e-6));
+    ps = _mm512_add_pd(_mm512_mul_pd(ps, z), _mm512_set1_pd(-1.98412698295895385996e-4));
+    ps = _mm512_add_pd(_mm512_mul_pd(ps, z), _mm512_set1_pd(8.33333333332211858878e-3));
+    ps = _mm512_add_pd(_mm512_mul_pd(ps, z), _mm512_set1_pd(-1.66666666666666307295e-1));
+    __m512d sinA = _mm512_add_pd(a, _mm512_mul_pd(_mm512_mul_pd(a, z), ps));
+
+    __m512d pc = _mm512_set1_pd(-1.13585365213876817300e-11);
+    pc = _mm512_add_pd(_mm512_mul_pd(pc, z), _mm512_set1_pd(2.08757008419747316778e-9));
+    pc = _mm512_add_pd(_mm512_mul_pd(pc, z), _mm512_set1_pd(-2.75573141792967388112e-7));
+    pc = _mm512_add_pd(_mm512_mul_pd(pc, z), _mm512_set1_pd(2.48015872888517045348e-5));
+    pc = _mm512_add_pd(_mm512_mul_pd(pc, z), _mm512_set1_pd(-1.38888888888730564116e-3));
+    pc = _mm512_add_pd(_mm512_mul_pd(pc, z), _mm512_set1_pd(4.16666666666665929218e-2));
+    __m512d cosA = _mm512_add_pd(_mm512_sub_pd(_mm512_set1_pd(1), _mm512_mul_pd(_mm512_set1_pd(0.5), z)), _mm512_mul_pd(_mm512_mul_pd(z, z), pc));
+
+    __mmask8 q1 = _mm512_cmp_pd_mask(q, _mm512_set1_pd(1), _CMP_EQ_OQ);
+    __mmask8 q2 = _mm512_cmp_pd_mask(q, _mm512_set1_pd(2), _CMP_EQ_OQ);
+    __mmask8 q3 = _mm512_cmp_pd_mask(q, _mm512_set1_pd(3), _CMP_EQ_OQ);
+    __mmask8 swap = q1 | q3;
+    s = NegateAVX512(_mm512_mask_blend_pd(swap, sinA, cosA), __mmask8(q2 | q3));
+    c = NegateAVX512(_mm512_mask_blend_pd(swap, cosA, sinA), __mmask8(q1 | q2));
+  }
+
+  ENGINE_TARGET_AVX512
+  static void ConcentricDiskAVX512(__m512d u, __m512d v, __m512d& x, __m512d& y)
+  {
+    __m512d one = _mm512_set1_pd(1);
+    __m512d a = _mm512_sub_pd(_mm512_mul_pd(_mm512_set1_pd(2), u), one);
+    __m512d b = _mm512_sub_pd(_mm512_mul_pd(_mm512_set1_pd(2), v), one);
+    __mmask8 wide = _mm512_cmp_pd_mask(_mm512_abs_pd(a), _mm512_abs_pd(b), _CMP_GT_OQ);
+    __m512d r = _mm512_mask_blend_pd(wide, b, a);
+    __m512d denominator = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(r, _mm512_setzero_pd(), _CMP_EQ_OQ), r, one);
+    __m512d ratio = _mm512_mul_pd(_mm512_div_pd(_mm512_mask_blend_pd(wide, a, b), denominator), _mm512_set1_pd(0.125));
+
+    __m512d s, c;
+    SinCosTurnsAVX512(_mm512_mask_blend_pd(wide, _mm512_sub_pd(_mm512_set1_pd(0.25), ratio), ratio), s, c);
+    x = _mm512_mul_pd(r, c);
+    y = _mm512_mul_pd(r, s);
+  }
+
+  ENGINE_TARGET_AVX512
+  static void DiskAVX512(DirectionBatch& b, int count)
+  {
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+      __m512d x, y;
+      ConcentricDiskAVX512(_mm512_loadu_pd(&b.u[i]), _mm512_loadu_pd(&b.v[i]), x, y);
+      _mm512_storeu_pd(&b.x[i], x);
+      _mm512_storeu_pd(&b.y[i], y);
+    }
+    DiskTail(b, i, count);
+  }
+
+  ENGINE_TARGET_AVX512
+  static void SphereAVX512(DirectionBatch& b, int count)
+  {
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+      __m512d z = _mm512_sub_pd(_mm512_set1_pd(1), _mm512_mul_pd(_mm512_set1_pd(2), _mm512_loadu_pd(&b.u[i])));
+      __m512d r = _mm512_sqrt_pd(_mm512_max_pd(_mm512_setzero_pd(), _mm512_sub_pd(_mm512_set1_pd(1), _mm512_mul_pd(z, z))));
+
+      __m512d s, c;
+      SinCosTurnsAVX512(_mm512_loadu_pd(&b.v[i]), s, c);
+      _mm512_storeu_pd(&b.x[i], _mm512_mul_pd(r, c));
+      _mm512_storeu_pd(&b.y[i], _mm512_mul_pd(r, s));
+      _mm512_storeu_pd(&b.z[i], z);
+    }
+    SphereTail(b, i, count);
+  }
+
+  ENGINE_TARGET_AVX512
+  static void HemisphereAVX512(DirectionBatch& b, int count)
+  {
+    const __m512d one = _mm512_set1_pd(1);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+      __m512d dx, dy;
+      ConcentricDiskAVX512(_mm512_loadu_pd(&b.u[i]), _mm512_loadu_pd(&b.v[i]), dx, dy);
+      __m512d dz = _mm512_sqrt_pd(_mm512_max_pd(_mm512_setzero_pd(), _mm512_sub_pd(_mm512_sub_pd(one, _mm512_mul_pd(dx, dx)), _mm512_mul_pd(dy, dy))));
+
+      __m512d nx = _mm512_loadu_pd(&b.normalX[i]), ny = _mm512_loadu_pd(&b.normalY[i]), nz = _mm512_loadu_pd(&b.normalZ[i]);
+      __m512d sign = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(nz, _mm512_setzero_pd(), _CMP_GE_OQ), _mm512_set1_pd(-1), one);
+      __m512d a = _mm512_div_pd(_mm512_set1_pd(-1), _mm512_add_pd(sign, nz));
+      __m512d bb = _mm512_mul_pd(_mm512_mul_pd(nx, ny), a);
+      __m512d tx = _mm512_add_pd(one, _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(sign, nx), nx), a));
+      __m512d ty = _mm512_mul_pd(sign, bb);
+      __m512d tz = _mm512_mul_pd(NegateAVX512(sign, 0xff), nx);
+      __m512d by = _mm512_add_pd(sign, _mm512_mul_pd(_mm512_mul_pd(ny, ny), a));
+      __m512d bz = NegateAVX512(ny, 0xff);
+
+      _mm512_storeu_pd(&b.x[i], _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, tx), _mm512_mul_pd(dy, bb)), _mm512_mul_pd(dz, nx)));
+      _mm512_storeu_pd(&b.y[i], _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, ty), _mm512_mul_pd(dy, by)), _mm512_mul_pd(dz, ny)));
+      _mm512_storeu_pd(&b.z[i], _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, tz), _mm512_mul_pd(dy, bz)), _mm512_mul_pd(dz, nz)));
+    }
+    HemisphereTail(b, i, count);
+  }
+#else
+  static void DiskSSE2(DirectionBatch& b, int count)         { DiskScalar(b, count); }
+  static void DiskAVX2(DirectionBatch& b, int count)         { DiskScalar(b, count); }
+  static void DiskAVX512(DirectionBatch& b, int count)       { DiskScalar(b, count); }
+  static void SphereSSE2(DirectionBatch& b, int count)       { SphereScalar(b, count); }
+  static void SphereAVX2(DirectionBatch& b, int count)       { SphereScalar(b, count); }
+  static void SphereAVX512(DirectionBatch& b, int count)     { SphereScalar(b, count); }
+  static void HemisphereSSE2(DirectionBatch& b, int count)   { HemisphereScalar(b, count); }
+  static void HemisphereAVX2(DirectionBatch& b, int count)   { HemisphereScalar(b, count); }
+  static void HemisphereAVX512(DirectionBatch& b, int count) { HemisphereScalar(b, count); }
+#endif
+};
+
+#endif // SAMPLING_H
\ No newline at end of file
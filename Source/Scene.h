@@ -0,0 +1,769 @@
+#pragma once
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Arena.h"
+#include "BVH.h"
+#include "Camera.h"
+#include "Instance.h"
+#include "MappedFile.h"
+#include "Material.h"
+#include "SphereSoA.h"
+#include "TriangleMesh.h"
+
+using MeshHandle = Handle<TriangleMesh>;
+using InstanceHandle = Handle<Instance>;
+
+class Scene : public Hittable
+{
+  // Everything a render reads: materials, spheres, triangle meshes and placed instances of
+  // them. Materials and spheres keep their flat arrays (MaterialTable, SphereSoA), meshes and
+  // instances live in pools of their own type in one arena. A scene of millions of instances
+  // makes no allocation per object and touches no reference counts, its objects sit next to
+  // each other, and all of them are freed at once with the scene. Meshes and instances are
+  // referred to by handles, which stay valid as the scene grows.
+  //
+  // Add everything, call Build, then render World(). Instances moved afterwards need a Refit
+  // instead of another Build
+
+public:
+  Scene() : meshes(arena), instances(arena) {}
+
+  MaterialId AddMaterial(const Material& material) { return materials.Add(material); }
+
+  void AddSphere(const Point3& center, Real radius, MaterialId material) { spheres.Add(center, radius, material); }
+
+  MeshHandle AddMesh(MaterialId material)
+  {
+    // An empty mesh to fill and build, such as with ObjFile::Load. It only shows up in the
+    // render through instances of it, or once placed where it was modeled with PlaceMesh
+    return meshes.Add(material);
+  }
+
+  void PlaceMesh(MeshHandle mesh) { placedMeshes.push_back(mesh); }
+
+  InstanceHandle AddInstance(MeshHandle mesh, const Transform& objectToWorld, MaterialId material = Instance::keepMaterial)
+  {
+    // The mesh must be built already, the instance takes its bounds from it
+    return instances.Add(meshes[mesh], objectToWorld, material);
+  }
+
+  TriangleMesh& operator[](MeshHandle mesh) { return meshes[mesh]; }
+  Instance& operator[](InstanceHandle instance) { return instances[instance]; }
+
+  SphereSoA& Spheres() { return spheres; }
+  const SphereSoA& Spheres() const { return spheres; }
+  MaterialTable& Materials() { return materials; }
+  const MaterialTable& Materials() const { return materials; }
+
+  int MeshCount() const     { return meshes.Size(); }
+  int InstanceCount() const { return instances.Size(); }
+
+  void Build()
+  {
+    // Builds the sphere BVH and one BVH over every instance, and collects what World() hits
+    spheres.Build();
+
+    std::vector<const Hittable*> placed;
+    placed.reserve(size_t(instances.Size()));
+    for (int i = 0; i < instances.Size(); i++)
+    {
+      placed.push_back(&instances.At(i));
+    }
+    instanceBVH.reset(placed.empty() ? nullptr : new BVH(placed));
+
+    roots.clear();
+    if (spheres.Size() > 0)
+    {
+      roots.push_back(&spheres);
+    }
+    for (MeshHandle mesh : placedMeshes)
+    {
+      roots.push_back(&meshes[mesh]);
+    }
+    if (instanceBVH)
+    {
+      roots.push_back(instanceBVH.get());
+    }
+    UpdateBounds();
+  }
+
+  void Refit()
+  {
+    // Updates the bounds after instances were moved with Instance::SetTransform
+    if (instanceBVH)
+    {
+      instanceBVH->Refit();
+    }
+    UpdateBounds();
+  }
+
+  const Hittable& World() const
+  {
+    // What to render: the only object there is, or the scene hitting all of them in turn
+    return (roots.size() == 1) ? *roots[0] : *this;
+  }
+
+  bool Hit(const Ray& r, Interval rayT, HitRecord& rec) const override
+  {
+    bool hitAnything = false;
+    for (const Hittable* root : roots)
+    {
+      if (root->Hit(r, rayT, rec))
+      {
+        hitAnything = true;
+        rayT.max = rec.t;
+      }
+    }
+    return hitAnything;
+  }
+
+  AABB BoundingBox() const override { return bbox; }
+
+  size_t ArenaBytes() const { return arena.BytesReserved(); }
+
+private:
+  // The arena is declared first so it outlives the pools, which destroy their objects
+  MonotonicArena arena;
+  ArenaPool<TriangleMesh> meshes;
+  ArenaPool<Instance> instances;
+  SphereSoA spheres;
+  MaterialTable materials;
+
+  std::vector<MeshHandle> placedMeshes;
+  std::unique_ptr<BVH> instanceBVH;
+  std::vector<const Hittable*> roots;  // Top level, in the order they were added
+  AABB bbox;
+
+  void UpdateBounds()
+  {
+    bbox = AABB();
+    for (const Hittable* root : roots)
+    {
+      bbox = AABB(bbox, root->BoundingBox());
+    }
+  }
+};
+
+// Scene files describe materials, spheres and camera settings, in one of two forms
+//
+// Text (.scene), one statement per line, '#' starts a comment:
+//
+//   camera lookFrom 13 2 3           Any of aspectRatio, imageWidth, samplesPerPixel, maxDepth,
+//   camera vFov 20                   vFov, lookFrom, lookAt, vUp, defocusAngle, focusDist
+//   material ground lambertian 0.5 0.5 0.5
+//   material steel metal 0.7 0.6 0.5 0.1     Albedo, then fuzz
+//   material glass dielectric 1.5            Refraction index
+//   material lamp light 8 8 8                Emitted radiance
+//   sphere 0 -1000 0 1000 ground             Center, radius, material name
+//
+// Binary (.sceneb), little endian and laid out so it can be mapped and copied array by array:
+// a SceneFileHeader, the SceneFileMaterial table, then the sphere center x, y and z, radius
+// and material id arrays, each sphereCount entries of 4 bytes
+
+struct SceneFileHeader
+{
+  char     magic[8];         // "RTSCENE" and a zero byte
+  uint32_t version;
+  uint32_t materialCount;
+  uint64_t sphereCount;
+  int32_t  imageWidth;       // Render settings, 0 keeps the camera's value
+  int32_t  samplesPerPixel;
+  int32_t  maxDepth;
+  int32_t  hasCamera;        // Nonzero when the view below is set
+  double   aspectRatio;
+  double   vFov;
+  double   lookFrom[3];
+  double   lookAt[3];
+  double   vUp[3];
+  double   defocusAngle;
+  double   focusDist;
+};
+
+struct SceneFileMaterial
+{
+  uint32_t type;             // MaterialType
+  float    albedo[3];         // Emitted radiance for lights
+  float    fuzz;
+  float    refractionIndex;
+};
+
+class SceneFile
+{
+  // Loads and saves scene files. Spheres stream straight into a SphereSoA: the binary loader
+  // copies runs of the mapped arrays and releases their pages as it goes, so loading needs
+  // little more memory than the spheres themselves, and neither form allocates per sphere.
+  // Loaders refuse scenes whose spheres and BVH would not fit in memoryBudget bytes, 0 means
+  // no limit
+
+public:
+  static const uint32_t version = 1;
+  static const size_t chunkSpheres = 1 << 20;  // Spheres copied per step of a binary load
+
+  static bool IsBinaryPath(const std::string& path)
+  {
+    auto dot = path.find_last_of('.');
+    return dot != std::string::npos && path.substr(dot) == ".sceneb";
+  }
+
+  static bool Load(
+      const std::string& path,
+      SphereSoA& spheres,
+      MaterialTable& materials,
+      Camera& cam,
+      size_t memoryBudget,
+      std::string& error)
+  {
+    MappedFile file;
+    if (!file.Open(path))
+    {
+      error = "cannot open " + path;
+      return false;
+    }
+
+    // Binary files are recognized by their magic, whatever their name
+    if (file.Size() >= sizeof(SceneFileHeader) && std::memcmp(file.Data(), Magic(), 8) == 0)
+    {
+      return LoadBinary(file, spheres, materials, cam, memoryBudget, error);
+    }
+
+    return LoadText(file, spheres, materials, cam, memoryBudget, error);
+  }
+
+  static bool Save(
+      const std::string& path,
+      const SphereSoA& spheres,
+      const MaterialTable& materials,
+      const Camera& cam,
+      std::string& error)
+  {
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+    {
+      error = "cannot create " + path;
+      return false;
+    }
+
+    if (IsBinaryPath(path))
+    {
+      SaveBinary(out, spheres, materials, cam);
+    }
+    else
+    {
+      SaveText(out, spheres, materials, cam);
+    }
+
+    if (!out)
+    {
+      error = "cannot write " + path;
+      return false;
+    }
+    return true;
+  }
+
+private:
+  static const char* Magic() { return "RTSCENE"; }
+
+  static bool OverBudget(size_t sphereCount, size_t memoryBudget, std::string& error)
+  {
+    size_t needed = SphereSoA::EstimateBytes(sphereCount);
+    if (memoryBudget > 0 && needed > memoryBudget)
+    {
+      error = std::to_string(sphereCount) + " spheres need about " + std::to_string(needed >> 20)
+            + " MB, over the memory budget of " + std::to_string(memoryBudget >> 20) + " MB";
+      return true;
+    }
+    return false;
+  }
+
+  static bool LoadBinary(
+      MappedFile& file,
+      SphereSoA& spheres,
+      MaterialTable& materials,
+      Camera& cam,
+      size_t memoryBudget,
+      std::string& error)
+  {
+    SceneFileHeader header;
+    std::memcpy(&header, file.Data(), sizeof(header));
+
+    if (header.version != version)
+    {
+      error = "unsupported scene file version " + std::to_string(header.version);
+      return false;
+    }
+
+    uint64_t n = header.sphereCount;
+    uint64_t expectedSize = sizeof(SceneFileHeader)
+                          + uint64_t(header.materialCount) * sizeof(SceneFileMaterial)
+                          + n * 5 * sizeof(uint32_t);
+    if (file.Size() != expectedSize || n > uint64_t(std::numeric_limits<int>::max()))
+    {
+      error = "scene file is truncated or corrupt";
+      return false;
+    }
+
+    if (OverBudget(spheres.Size() + size_t(n), memoryBudget, error))
+    {
+      return false;
+    }
+
+    if (header.imageWidth > 0)      cam.imageWidth = header.imageWidth;
+    if (header.samplesPerPixel > 0) cam.samplesPerPixel = header.samplesPerPixel;
+    if (header.maxDepth > 0)        cam.maxDepth = header.maxDepth;
+    if (header.hasCamera)
+    {
+      cam.aspectRatio  = header.aspectRatio;
+      cam.vFov         = header.vFov;
+      cam.lookFrom     = Point3(header.lookFrom[0], header.lookFrom[1], header.lookFrom[2]);
+      cam.lookAt       = Point3(header.lookAt[0], header.lookAt[1], header.lookAt[2]);
+      cam.vUp          = Vec3(header.vUp[0], header.vUp[1], header.vUp[2]);
+      cam.defocusAngle = header.defocusAngle;
+      cam.focusDist    = header.focusDist;
+    }
+
+    // Ids in the file index this file's materials, which may land after existing ones
+    MaterialId firstMaterial = materials.Size();
+    const char* cursor = file.Data() + sizeof(SceneFileHeader);
+    for (uint32_t m = 0; m < header.materialCount; m++, cursor += sizeof(SceneFileMaterial))
+    {
+      SceneFileMaterial material;
+      std::memcpy(&material, cursor, sizeof(material));
+      Color albedo(material.albedo[0], material.albedo[1], material.albedo[2]);
+
+      switch (MaterialType(material.type))
+      {
+        case MaterialType::Lambertian:   materials.Add(Lambertian(albedo)); break;
+        case MaterialType::Metal:        materials.Add(Metal(albedo, material.fuzz)); break;
+        case MaterialType::Dielectric:   materials.Add(Dielectric(material.refractionIndex)); break;
+        case MaterialType::DiffuseLight: materials.Add(DiffuseLight(albedo)); break;
+        default:
+          error = "unknown material type " + std::to_string(material.type);
+          return false;
+      }
+    }
+
+    size_t arrayBytes = size_t(n) * sizeof(uint32_t);
+    size_t arrayOffset[5];
+    for (int a = 0; a < 5; a++)
+    {
+      arrayOffset[a] = size_t(cursor - file.Data()) + a * arrayBytes;
+    }
+    const float* x = reinterpret_cast<const float*>(file.Data() + arrayOffset[0]);
+    const float* y = reinterpret_cast<const float*>(file.Data() + arrayOffset[1]);
+    const float* z = reinterpret_cast<const float*>(file.Data() + arrayOffset[2]);
+    const float* radius = reinterpret_cast<const float*>(file.Data() + arrayOffset[3]);
+    const uint32_t* ids = reinterpret_cast<const uint32_t*>(file.Data() + arrayOffset[4]);
+
+    spheres.Reserve(spheres.Size() + size_t(n));
+    std::vector<uint32_t> chunkIds;
+
+    for (size_t first = 0; first < n; first += chunkSpheres)
+    {
+      size_t count = std::min(size_t(n) - first, size_t(chunkSpheres));
+
+      chunkIds.assign(ids + first, ids + first + count);
+      for (uint32_t& id : chunkIds)
+      {
+        if (id >= header.materialCount)
+        {
+          error = "sphere " + std::to_string(first + (&id - chunkIds.data())) + " uses a missing material";
+          return false;
+        }
+        id += uint32_t(firstMaterial);
+      }
+
+      spheres.Append(x + first, y + first, z + first, radius + first, chunkIds.data(), count);
+
+      for (int a = 0; a < 5; a++)
+      {
+        file.Release(arrayOffset[a] + first * sizeof(uint32_t), count * sizeof(uint32_t));
+      }
+    }
+
+    return true;
+  }
+
+  static bool LoadText(
+      MappedFile& file,
+      SphereSoA& spheres,
+      MaterialTable& materials,
+      Camera& cam,
+      size_t memoryBudget,
+      std::string& error)
+  {
+    std::unordered_map<std::string, MaterialId> materialNames;
+
+    // The spheres are counted first, so the budget is checked before parsing and the arrays
+    // are sized once, as the binary loader does. Growing them as they fill would hold the old
+    // and new arrays at once on every reallocation
+    size_t sphereCount = size_t(spheres.Size());
+    size_t total = sphereCount + CountSpheres(file);
+    if (OverBudget(total, memoryBudget, error))
+    {
+      return false;
+    }
+    spheres.Reserve(total);
+
+    // Spheres are collected a chunk at a time, in the same float form the binary loader reads
+    std::vector<float> x, y, z, radius;
+    std::vector<uint32_t> ids;
+
+    const char* cursor = file.Data();
+    const char* end = cursor + file.Size();
+    size_t released = 0;  // Bytes of the file before this are parsed and their pages released
+
+    auto flush = [&]()
+    {
+      spheres.Append(x.data(), y.data(), z.data(), radius.data(), ids.data(), x.size());
+      x.clear();
+      y.clear();
+      z.clear();
+      radius.clear();
+      ids.clear();
+
+      size_t parsed = std::min(size_t(cursor - file.Data()), file.Size());
+      file.Release(released, parsed - released);
+      released = parsed;
+    };
+
+    std::string line;
+    int lineNumber = 0;
+
+    while (cursor < end)
+    {
+      const char* lineEnd = static_cast<const char*>(std::memchr(cursor, '\n', size_t(end - cursor)));
+      if (!lineEnd)
+      {
+        lineEnd = end;
+      }
+
+      // The line is copied so number parsing always stops at a terminating zero
+      line.assign(cursor, lineEnd);
+      cursor = lineEnd + 1;
+      lineNumber++;
+
+      size_t comment = line.find('#');
+      if (comment != std::string::npos)
+      {
+        line.resize(comment);
+      }
+
+      const char* p = line.c_str();
+      std::string keyword = NextWord(p);
+      if (keyword.empty())
+      {
+        continue;
+      }
+
+      bool ok = true;
+      if (keyword == "sphere")
+      {
+        float values[4];
+        std::string name;
+        ok = NextNumbers(p, values, 4) && !(name = NextWord(p)).empty();
+
+        auto found = materialNames.find(name);
+        if (ok && found == materialNames.end())
+        {
+          error = "line " + std::to_string(lineNumber) + ": unknown material " + name;
+          return false;
+        }
+
+        if (ok)
+        {
+          x.push_back(values[0]);
+          y.push_back(values[1]);
+          z.push_back(values[2]);
+          radius.push_back(values[3]);
+          ids.push_back(uint32_t(found->second));
+
+          if (++sphereCount % chunkSpheres == 0)
+          {
+            flush();
+          }
+        }
+      }
+      else if (keyword == "material")
+      {
+        std::string name = NextWord(p);
+        std::string type = NextWord(p);
+        float values[4];
+
+        if (type == "lambertian" && NextNumbers(p, values, 3))
+        {
+          materialNames[name] = materials.Add(Lambertian(Color(values[0], values[1], values[2])));
+        }
+        else if (type == "metal" && NextNumbers(p, values, 4))
+        {
+          materialNames[name] = materials.Add(Metal(Color(values[0], values[1], values[2]), values[3]));
+        }
+        else if (type == "dielectric" && NextNumbers(p, values, 1))
+        {
+          materialNames[name] = materials.Add(Dielectric(values[0]));
+        }
+        else if (type == "light" && NextNumbers(p, values, 3))
+        {
+          materialNames[name] = materials.Add(DiffuseLight(Color(values[0], values[1], values[2])));
+        }
+        else
+        {
+          ok = false;
+        }
+      }
+      else if (keyword == "camera")
+      {
+        ok = SetCameraField(cam, NextWord(p), p);
+      }
+      else
+      {
+        ok = false;
+      }
+
+      if (!ok)
+      {
+        error = "line " + std::to_string(lineNumber) + ": cannot parse '" + line + "'";
+        return false;
+      }
+    }
+
+    flush();
+
+    return true;
+  }
+
+  static size_t CountSpheres(MappedFile& file)
+  {
+    // Counts the lines whose first word is sphere. Lines that merely start with it fail the
+    // parse, so the count is exact for every file that loads. Pages are released behind the
+    // scan, the parse reads them back from the page cache
+    const size_t releaseBytes = size_t(64) << 20;
+    size_t count = 0;
+    size_t released = 0;
+
+    const char* begin = file.Data();
+    const char* cursor = begin;
+    const char* end = begin + file.Size();
+    while (cursor < end)
+    {
+      while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r'))
+      {
+        cursor++;
+      }
+      if (end - cursor >= 6 && std::memcmp(cursor, "sphere", 6) == 0)
+      {
+        count++;
+      }
+
+      const char* lineEnd = static_cast<const char*>(std::memchr(cursor, '\n', size_t(end - cursor)));
+      cursor = lineEnd ? lineEnd + 1 : end;
+
+      if (size_t(cursor - begin) - released >= releaseBytes || cursor == end)
+      {
+        file.Release(released, size_t(cursor - begin) - released);
+        released = size_t(cursor - begin);
+      }
+    }
+
+    return count;
+  }
+
+  static bool SetCameraField(Camera& cam, const std::string& field, const char*& p)
+  {
+    double v[3];
+
+    if (field == "aspectRatio")          { if (!NextNumbers(p, v, 1)) return false; cam.aspectRatio = v[0]; }
+    else if (field == "imageWidth")      { if (!NextNumbers(p, v, 1)) return false; cam.imageWidth = int(v[0]); }
+    else if (field == "samplesPerPixel") { if (!NextNumbers(p, v, 1)) return false; cam.samplesPerPixel = int(v[0]); }
+    else if (field == "maxDepth")        { if (!NextNumbers(p, v, 1)) return false; cam.maxDepth = int(v[0]); }
+    else if (field == "vFov")            { if (!NextNumbers(p, v, 1)) return false; cam.vFov = v[0]; }
+    else if (field == "lookFrom")        { if (!NextNumbers(p, v, 3)) return false; cam.lookFrom = Point3(v[0], v[1], v[2]); }
+    else if (field == "lookAt")          { if (!NextNumbers(p, v, 3)) return false; cam.lookAt = Point3(v[0], v[1], v[2]); }
+    else if (field == "vUp")             { if (!NextNumbers(p, v, 3)) return false; cam.vUp = Vec3(v[0], v[1], v[2]); }
+    else if (field == "defocusAngle")    { if (!NextNumbers(p, v, 1)) return false; cam.defocusAngle = v[0]; }
+    else if (field == "focusDist")       { if (!NextNumbers(p, v, 1)) return false; cam.focusDist = v[0]; }
+    else
+    {
+      return false;
+    }
+
+    return true;
+  }
+
+  static std::string NextWord(const char*& p)
+  {
+    while (*p == ' ' || *p == '\t' || *p == '\r')
+    {
+      p++;
+    }
+
+    const char* start = p;
+    while (*p && *p != ' ' && *p != '\t' && *p != '\r')
+    {
+      p++;
+    }
+    return std::string(start, p);
+  }
+
+  static bool NextNumbers(const char*& p, double* values, int count)
+  {
+    for (int k = 0; k < count; k++)
+    {
+      char* numberEnd;
+      values[k] = std::strtod(p, &numberEnd);
+      if (numberEnd == p)
+      {
+        return false;
+      }
+      p = numberEnd;
+    }
+    return true;
+  }
+
+  static bool NextNumbers(const char*& p, float* values, int count)
+  {
+    // Spheres and materials are parsed straight to float, the precision they are stored in
+    for (int k = 0; k < count; k++)
+    {
+      char* numberEnd;
+      values[k] = std::strtof(p, &numberEnd);
+      if (numberEnd == p)
+      {
+        return false;
+      }
+      p = numberEnd;
+    }
+    return true;
+  }
+
+  static void SaveBinary(std::ostream& out, const SphereSoA& spheres, const MaterialTable& materials, const Camera& cam)
+  {
+    SceneFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, Magic(), 8);
+    header.version         = version;
+    header.materialCount   = uint32_t(materials.Size());
+    header.sphereCount     = uint64_t(spheres.Size());
+    header.imageWidth      = cam.imageWidth;
+    header.samplesPerPixel = cam.samplesPerPixel;
+    header.maxDepth        = cam.maxDepth;
+    header.hasCamera       = 1;
+    header.aspectRatio     = cam.aspectRatio;
+    header.vFov            = cam.vFov;
+    header.defocusAngle    = cam.defocusAngle;
+    header.focusDist       = cam.focusDist;
+    for (int k = 0; k < 3; k++)
+    {
+      header.lookFrom[k] = cam.lookFrom[k];
+      header.lookAt[k]   = cam.lookAt[k];
+      header.vUp[k]      = cam.vUp[k];
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (MaterialId id = 0; id < materials.Size(); id++)
+    {
+      const Material& m = materials[id];
+      SceneFileMaterial material;
+      const Color& albedo = (m.Type() == MaterialType::DiffuseLight) ? m.Emission() : m.Albedo();
+      material.type = uint32_t(m.Type());
+      material.albedo[0] = float(albedo.X());
+      material.albedo[1] = float(albedo.Y());
+      material.albedo[2] = float(albedo.Z());
+      material.fuzz = float(m.Fuzz());
+      material.refractionIndex = float(m.RefractionIndex());
+      out.write(reinterpret_cast<const char*>(&material), sizeof(material));
+    }
+
+    // One array at a time, through a chunk-sized buffer
+    std::vector<uint32_t> buffer;
+    for (int a = 0; a < 5; a++)
+    {
+      for (int first = 0; first < spheres.Size(); first += int(chunkSpheres))
+      {
+        int count = std::min(spheres.Size() - first, int(chunkSpheres));
+        buffer.resize(size_t(count));
+
+        for (int i = 0; i < count; i++)
+        {
+          Point3 center;
+          Real radius;
+          MaterialId id;
+          spheres.Get(first + i, center, radius, id);
+
+          float value = (a < 3) ? float(center[a]) : float(radius);
+          if (a == 4)
+          {
+            buffer[i] = uint32_t(id);
+          }
+          else
+          {
+            std::memcpy(&buffer[i], &value, sizeof(value));
+          }
+        }
+        out.write(reinterpret_cast<const char*>(buffer.data()), std::streamsize(count * sizeof(uint32_t)));
+      }
+    }
+  }
+
+  static Vec3T<float> FloatVector(const Vec3& v)
+  {
+    // Materials and spheres are loaded in single precision
+    return Vec3T<float>(v);
+  }
+
+  static void SaveText(std::ostream& out, const SphereSoA& spheres, const MaterialTable& materials, const Camera& cam)
+  {
+    // Camera values are doubles and need 17 digits to read back exactly, the float values
+    // below only 9
+    out.precision(17);
+
+    out << "# Ray tracing engine scene\n";
+    out << "camera imageWidth " << cam.imageWidth << '\n';
+    out << "camera samplesPerPixel " << cam.samplesPerPixel << '\n';
+    out << "camera maxDepth " << cam.maxDepth << '\n';
+    out << "camera aspectRatio " << cam.aspectRatio << '\n';
+    out << "camera vFov " << cam.vFov << '\n';
+    out << "camera lookFrom " << cam.lookFrom << '\n';
+    out << "camera lookAt " << cam.lookAt << '\n';
+    out << "camera vUp " << cam.vUp << '\n';
+    out << "camera defocusAngle " << cam.defocusAngle << '\n';
+    out << "camera focusDist " << cam.focusDist << '\n';
+
+    out.precision(9);
+
+    for (MaterialId id = 0; id < materials.Size(); id++)
+    {
+      const Material& m = materials[id];
+      out << "material m" << id << ' ';
+      switch (m.Type())
+      {
+        case MaterialType::Lambertian:   out << "lambertian " << FloatVector(m.Albedo()) << '\n'; break;
+        case MaterialType::Metal:        out << "metal " << FloatVector(m.Albedo()) << ' ' << float(m.Fuzz()) << '\n'; break;
+        case MaterialType::Dielectric:   out << "dielectric " << float(m.RefractionIndex()) << '\n'; break;
+        case MaterialType::DiffuseLight: out << "light " << FloatVector(m.Emission()) << '\n'; break;
+      }
+    }
+
+    for (int i = 0; i < spheres.Size(); i++)
+    {
+      Point3 center;
+      Real radius;
+      MaterialId id;
+      spheres.Get(i, center, radius, id);
+      out << "sphere " << FloatVector(center) << ' ' << float(radius) << " m" << id << '\n';
+    }
+  }
+};
+
+#endif // SCENE_H
\ No newline at end of file
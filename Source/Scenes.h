@@ -0,0 +1,167 @@
+#pragma once
+
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "Animation.h"
+#include "Camera.h"
+#include "Material.h"
+#include "Transform.h"
+
+// Built-in scenes shared by Main and Bench. Scenes only create materials and hand every
+// sphere to addSphere(center, radius, materialId), or every instance to
+// addInstance(objectToWorld, materialId), so the caller picks the geometry container
+
+template <typename AddSphere>
+void RandomSpheresScene(MaterialTable& materials, Rng& rng, AddSphere addSphere)
+{
+  // The final scene of Ray Tracing in One Weekend: a ground sphere, a grid of small random
+  // spheres and three large ones
+
+  auto groundMaterial = materials.Add(Lambertian(Color(0.5, 0.5, 0.5)));
+  addSphere(Point3(0, -1000, 0), 1000, groundMaterial);
+
+  for (int a = -11; a < 11; a++)
+  {
+    for (int b = -11; b < 11; b++)
+    {
+      auto chooseMat = RandomDouble(rng);
+      Point3 center(a + 0.9 * RandomDouble(rng), 0.2, b + 0.9 * RandomDouble(rng));
+
+      if ((center - Point3(4, 0.2, 0)).Length() > 0.9)
+      {
+        MaterialId sphereMaterial;
+
+        if (chooseMat < 0.8)
+        {
+          // Diffuse
+          auto albedo = Color::Random(rng) * Color::Random(rng);
+          sphereMaterial = materials.Add(Lambertian(albedo));
+          addSphere(center, 0.2, sphereMaterial);
+        } 
+        else if (chooseMat < 0.95)
+        {
+          // Metal
+          auto albedo = Color::Random(0.5, 1, rng);
+          auto fuzz = RandomDouble(0, 0.5, rng);
+          sphereMaterial = materials.Add(Metal(albedo, fuzz));
+          addSphere(center, 0.2, sphereMaterial);
+        }
+        else
+        {
+          // Glass
+          sphereMaterial = materials.Add(Dielectric(1.5));
+          addSphere(center, 0.2, sphereMaterial);
+        }
+      }
+    }
+  }
+
+  auto material1 = materials.Add(Dielectric(1.5));
+  addSphere(Point3(0, 1, 0), 1.0, material1);
+
+  auto material2 = materials.Add(Lambertian(Color(0.4, 0.2, 0.1)));
+  addSphere(Point3(-4, 1, 0), 1.0, material2);
+
+  auto material3 = materials.Add(Metal(Color(0.7, 0.6, 0.5), 0.0));
+  addSphere(Point3(4, 1, 0), 1.0, material3);
+}
+
+inline void RandomSpheresCamera(Camera& cam)
+{
+  cam.aspectRatio      = 16.0 / 9.0;
+  cam.imageWidth       = 360;
+  cam.samplesPerPixel  = 10;
+  cam.maxDepth         = 30;
+
+  cam.vFov     = 20;
+  cam.lookFrom = Point3(13,2,3);
+  cam.lookAt   = Point3(0,0,0);
+  cam.vUp      = Vec3(0,1,0);
+
+  cam.defocusAngle = 0.6;
+  cam.focusDist    = 10.0;
+}
+
+template <typename AddSphere>
+void RandomLamps(int count, MaterialTable& materials, Rng& rng, AddSphere addSphere)
+{
+  // Small, bright lamps floating between the spheres of the random spheres scene, for
+  // lighting it at night. Lamps keep clear of the three large spheres
+
+  const Point3 largeSpheres[3] = { Point3(0, 1, 0), Point3(-4, 1, 0), Point3(4, 1, 0) };
+
+  for (int i = 0; i < count; )
+  {
+    Point3 center(RandomDouble(-6, 6, rng), RandomDouble(0.6, 1.6, rng), RandomDouble(-6, 6, rng));
+
+    bool clear = true;
+    for (const Point3& large : largeSpheres)
+    {
+      clear = clear && (center - large).Length() > 1.3;
+    }
+
+    if (clear)
+    {
+      auto lampMaterial = materials.Add(DiffuseLight(Color::Random(0.5, 1, rng) * 60));
+      addSphere(center, 0.1, lampMaterial);
+      i++;
+    }
+  }
+}
+
+template <typename AddInstance>
+void ScatterInstances(const AABB& objectBox, int count, MaterialTable& materials, Rng& rng, AddInstance addInstance)
+{
+  // Scatters count copies of an object with bounds objectBox over the ground of the random
+  // spheres scene. Each copy stands on the ground, is turned about the vertical and scaled
+  // to between 0.2 and 0.5 units, and takes one of a few shared diffuse materials
+
+  const int paletteSize = 8;
+  MaterialId palette[paletteSize];
+  for (int k = 0; k < paletteSize; k++)
+  {
+    palette[k] = materials.Add(Lambertian(Color::Random(rng) * Color::Random(rng)));
+  }
+
+  double extent = std::fmax(objectBox.x.Size(), std::fmax(objectBox.y.Size(), objectBox.z.Size()));
+  if (objectBox.IsEmpty() || extent <= 0)
+  {
+    return;
+  }
+
+  // Point of the object that lands on the ground: the middle of the bottom of its box
+  Point3 base(0.5 * (objectBox.x.min + objectBox.x.max), objectBox.y.min, 0.5 * (objectBox.z.min + objectBox.z.max));
+
+  for (int i = 0; i < count; i++)
+  {
+    Point3 position(RandomDouble(-11, 11, rng), 0, RandomDouble(-11, 11, rng));
+    Transform objectToWorld = Transform::Translate(position)
+                            * Transform::Rotate(RandomDouble(0, 360, rng), Vec3(0, 1, 0))
+                            * Transform::Scale(Real(RandomDouble(0.2, 0.5, rng) / extent))
+                            * Transform::Translate(-base);
+    addInstance(objectToWorld, palette[int(RandomDouble(rng) * paletteSize)]);
+  }
+}
+
+inline AnimatedTransform HopAndSpin(const AABB& box, Rng& rng)
+{
+  // Motion for an object scattered by ScatterInstances, with world bounds box: once a second
+  // it hops up half its height while it spins a full turn about the vertical, from a random
+  // phase and in a random direction
+  AnimatedTransform motion;
+  motion.pivot = Point3(0.5 * (box.x.min + box.x.max), box.y.min, 0.5 * (box.z.min + box.z.max));
+  motion.loop = true;
+
+  double phase = RandomDouble(rng);
+  double turn = (RandomDouble(rng) < 0.5) ? 90 : -90;
+  double height = 0.5 * box.y.Size();
+  for (int k = 0; k <= 4; k++)
+  {
+    double s = k / 4.0;
+    motion.AddKey(phase + s, Vec3(0, Real(4 * height * s * (1 - s)), 0), Vec3(0, 1, 0), turn * k);
+  }
+  return motion;
+}
+
+#endif // SCENES_H
\ No newline at end of file
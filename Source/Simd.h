@@ -0,0 +1,116 @@
+#pragma once
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstdlib>
+#include <cstring>
+
+// Runtime SIMD dispatch. Kernels for wider instruction sets are compiled with per-function
+// target attributes, so the executable still runs on any x86-64 CPU (or any other
+// architecture, through the scalar fallbacks) and picks the widest kernel the CPU supports
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+  #define ENGINE_SIMD_X86 1
+  #include <immintrin.h>
+  #if defined(_MSC_VER) && !defined(__clang__)
+    #include <intrin.h>
+  #endif
+#else
+  #define ENGINE_SIMD_X86 0
+#endif
+
+#if ENGINE_SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+  #define ENGINE_TARGET_SSE2   __attribute__((target("sse2")))
+  #define ENGINE_TARGET_AVX2   __attribute__((target("avx2")))
+  #define ENGINE_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+  #define ENGINE_TARGET_SSE2
+  #define ENGINE_TARGET_AVX2
+  #define ENGINE_TARGET_AVX512
+#endif
+
+enum class SimdLevel
+{
+  Scalar,
+  SSE2,
+  AVX2,
+  AVX512
+};
+
+inline const char* SimdLevelName(SimdLevel level)
+{
+  switch (level)
+  {
+    case SimdLevel::SSE2:   return "sse2";
+    case SimdLevel::AVX2:   return "avx2";
+    case SimdLevel::AVX512: return "avx512";
+    default:                return "scalar";
+  }
+}
+
+inline SimdLevel DetectSimdLevel()
+{
+  // Returns the widest instruction set supported by both the CPU and the operating system
+
+#if ENGINE_SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return SimdLevel::AVX512;
+  if (__builtin_cpu_supports("avx2"))    return SimdLevel::AVX2;
+  if (__builtin_cpu_supports("sse2"))    return SimdLevel::SSE2;
+  return SimdLevel::Scalar;
+#elif ENGINE_SIMD_X86 && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  int maxLeaf = info[0];
+
+  __cpuid(info, 1);
+  bool sse2 = (info[3] & (1 << 26)) != 0;
+  bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+  bool osSavesZmm = osSavesYmm && (_xgetbv(0) & 0xe6) == 0xe6;
+
+  bool avx2 = false;
+  bool avx512 = false;
+  if (maxLeaf >= 7)
+  {
+    __cpuidex(info, 7, 0);
+    avx2 = osSavesYmm && (info[1] & (1 << 5)) != 0;
+    avx512 = osSavesZmm && (info[1] & (1 << 16)) != 0;
+  }
+
+  if (avx512) return SimdLevel::AVX512;
+  if (avx2)   return SimdLevel::AVX2;
+  if (sse2)   return SimdLevel::SSE2;
+  return SimdLevel::Scalar;
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+
+inline SimdLevel ActiveSimdLevel()
+{
+  // The detected level, optionally lowered through the ENGINE_SIMD environment variable
+  // (scalar, sse2, avx2 or avx512) to compare kernels on the same machine
+
+  static const SimdLevel level = []
+  {
+    SimdLevel detected = DetectSimdLevel();
+    const char* requested = std::getenv("ENGINE_SIMD");
+    if (requested == nullptr)
+    {
+      return detected;
+    }
+
+    SimdLevel wanted = detected;
+    if (std::strcmp(requested, "scalar") == 0) wanted = SimdLevel::Scalar;
+    if (std::strcmp(requested, "sse2") == 0)   wanted = SimdLevel::SSE2;
+    if (std::strcmp(requested, "avx2") == 0)   wanted = SimdLevel::AVX2;
+    if (std::strcmp(requested, "avx512") == 0) wanted = SimdLevel::AVX512;
+
+    return (wanted < detected) ? wanted : detected;
+  }();
+
+  return level;
+}
+
+#endif // SIMD_H
\ No newline at end of file
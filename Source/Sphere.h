@@ -9,12 +9,17 @@
 class Sphere : public Hittable
 {
 public:
-  Sphere(const Point3& center, double radius, std::shared_ptr<Material> material) :
+  Sphere(const Point3& center, Real radius, MaterialId material) :
     center(center), radius(std::fmax(0, radius)), material(material)
-  {}
+  {
+    auto rvec = Vec3(this->radius, this->radius, this->radius);
+    bbox = AABB(center - rvec, center + rvec);
+  }
 
   bool Hit(const Ray& r, Interval rayT, HitRecord& rec) const override
   {
+    ENGINE_STAT(RenderStats::Thread().primitiveTests++);
+
     Vec3 oc = center - r.Origin();
     auto a = r.Direction().LengthSquared();
     auto h = Dot(r.Direction(), oc);
@@ -43,18 +48,30 @@ public:
     }
 
     rec.t = root;
-    rec.p = r.At(rec.t);
-    Vec3 outwardNormal = (rec.p - center) / radius;
-    rec.SetFaceNormal(r, outwardNormal);
+    rec.object = this;
+    rec.primitive = 0;
     rec.material = material;
 
     return true;
   }
 
+  void CompleteHit(const Ray& r, HitRecord& rec) const override
+  {
+    // Project the point back onto the sphere, so its error only depends on the sphere and
+    // not on how far the ray travelled
+    Vec3 outwardNormal = Normalized(r.At(rec.t) - center);
+    rec.p = center + radius * outwardNormal;
+    rec.pError = PointError(std::fabs(center.X()) + std::fabs(center.Y()) + std::fabs(center.Z()) + radius);
+    rec.SetFaceNormal(r, outwardNormal);
+  }
+
+  AABB BoundingBox() const override { return bbox; }
+
 private:
   Point3 center;
-  double radius;
-  std::shared_ptr<Material> material;
+  Real radius;
+  MaterialId material;
+  AABB bbox;
 };
 
 #endif // SPHERE_H
\ No newline at end of file
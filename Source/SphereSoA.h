@@ -0,0 +1,660 @@
+#pragma once
+
+#ifndef SPHERE_SOA_H
+#define SPHERE_SOA_H
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "BVH.h"
+#include "Hittable.h"
+#include "Simd.h"
+
+class SphereSoA : public Hittable
+{
+  // A group of spheres stored as a structure of arrays. One ray is tested against a whole
+  // run of spheres at once with the widest SIMD kernel the CPU supports. Every lane repeats
+  // the exact operations of Sphere::Hit in Real precision, so hits are bit-identical to it.
+  // Float builds get twice as many lanes per vector
+
+public:
+  static const int lanePadding = 64 / sizeof(Real);  // Widest kernel, in Reals
+
+  SphereSoA()
+  {
+    // The arrays always end in a run of NaN spheres, so kernels can load whole vectors past
+    // the last sphere. Lanes past the end of a range are masked out before picking a hit
+    for (int i = 0; i < lanePadding; i++)
+    {
+      PushPadding();
+    }
+  }
+
+  void Add(const Point3& center, Real radius, MaterialId materialId)
+  {
+    centerX[count] = center.X();
+    centerY[count] = center.Y();
+    centerZ[count] = center.Z();
+    radii[count] = std::fmax(Real(0), radius);
+    materialIds[count] = materialId;
+    count++;
+    PushPadding();
+
+    auto rvec = Vec3(radii[count - 1], radii[count - 1], radii[count - 1]);
+    bbox = AABB(bbox, AABB(center - rvec, center + rvec));
+    built = false;
+  }
+
+  void Append(const float* x, const float* y, const float* z, const float* radius, const uint32_t* ids, size_t n)
+  {
+    // Bulk Add for loaders: converts a run of spheres stored as float arrays straight into the
+    // SoA storage. Material ids must already be valid
+
+    size_t first = size_t(count);
+    Resize(first + n);
+
+    Real minX = Real(bbox.x.min), minY = Real(bbox.y.min), minZ = Real(bbox.z.min);
+    Real maxX = Real(bbox.x.max), maxY = Real(bbox.y.max), maxZ = Real(bbox.z.max);
+
+    for (size_t i = 0; i < n; i++)
+    {
+      Real r = std::fmax(Real(0), Real(radius[i]));
+      centerX[first + i] = Real(x[i]);
+      centerY[first + i] = Real(y[i]);
+      centerZ[first + i] = Real(z[i]);
+      radii[first + i] = r;
+      materialIds[first + i] = MaterialId(ids[i]);
+
+      minX = std::fmin(minX, Real(x[i]) - r);
+      minY = std::fmin(minY, Real(y[i]) - r);
+      minZ = std::fmin(minZ, Real(z[i]) - r);
+      maxX = std::fmax(maxX, Real(x[i]) + r);
+      maxY = std::fmax(maxY, Real(y[i]) + r);
+      maxZ = std::fmax(maxZ, Real(z[i]) + r);
+    }
+
+    if (n > 0)
+    {
+      bbox = AABB(Point3(minX, minY, minZ), Point3(maxX, maxY, maxZ));
+    }
+    built = false;
+  }
+
+  void Reserve(size_t sphereCount)
+  {
+    // Reserves room for sphereCount spheres in total, so streaming them in never reallocates
+    centerX.reserve(sphereCount + lanePadding);
+    centerY.reserve(sphereCount + lanePadding);
+    centerZ.reserve(sphereCount + lanePadding);
+    radii.reserve(sphereCount + lanePadding);
+    materialIds.reserve(sphereCount + lanePadding);
+  }
+
+  int Size() const { return count; }
+
+  void Get(int index, Point3& center, Real& radius, MaterialId& materialId) const
+  {
+    center = Point3(centerX[index], centerY[index], centerZ[index]);
+    radius = radii[index];
+    materialId = materialIds[index];
+  }
+
+  static size_t EstimateBytes(size_t sphereCount)
+  {
+    // Peak memory of holding sphereCount spheres and building their BVH: the arrays, plus the
+    // box copies and order the tree builds with, plus the nodes. The SAH build may split down
+    // to single spheres, so nodes are counted for that worst case
+    size_t storage = 4 * sizeof(Real) + sizeof(MaterialId);
+    size_t build = BVHTree::BuildBytesPerPrimitive();
+    size_t nodes = 2 * sizeof(BVHNode);
+    return sphereCount * (storage + build + nodes);
+  }
+
+  void Build(int maxLeafSize = 8)
+  {
+    // Builds a BVH whose leaves are runs of spheres and reorders the arrays to match, so a
+    // leaf is a contiguous range the kernels can stream through
+
+    tree.Build(count, [&](int i)
+    {
+      auto rvec = Vec3(radii[i], radii[i], radii[i]);
+      auto center = Point3(centerX[i], centerY[i], centerZ[i]);
+      return AABB(center - rvec, center + rvec);
+    }, maxLeafSize);
+
+    Permute(centerX, tree.order);
+    Permute(centerY, tree.order);
+    Permute(centerZ, tree.order);
+    Permute(radii, tree.order);
+    Permute(materialIds, tree.order);
+
+    std::vector<int>().swap(tree.order);
+    built = true;
+  }
+
+  bool Hit(const Ray& r, Interval rayT, HitRecord& rec) const override
+  {
+    int closest = -1;
+    Real closestT = rayT.max;
+
+    if (built)
+    {
+      tree.Traverse(r, rayT, [&](int first, int leafCount, Interval& t)
+      {
+        int index = HitRange(r, first, leafCount, t);
+        if (index < 0)
+        {
+          return false;
+        }
+
+        closest = index;
+        closestT = t.max;
+        return true;
+      });
+    }
+    else
+    {
+      closest = HitRange(r, 0, count, rayT);
+      closestT = rayT.max;
+    }
+
+    if (closest < 0)
+    {
+      return false;
+    }
+
+    rec.t = closestT;
+    rec.object = this;
+    rec.primitive = closest;
+    rec.material = materialIds[closest];
+
+    return true;
+  }
+
+  void CompleteHit(const Ray& r, HitRecord& rec) const override
+  {
+    Point3 center(centerX[rec.primitive], centerY[rec.primitive], centerZ[rec.primitive]);
+    Real radius = radii[rec.primitive];
+
+    // Same projection and error bound as Sphere::CompleteHit
+    Vec3 outwardNormal = Normalized(r.At(rec.t) - center);
+    rec.p = center + radius * outwardNormal;
+    rec.pError = PointError(std::fabs(center.X()) + std::fabs(center.Y()) + std::fabs(center.Z()) + radius);
+    rec.SetFaceNormal(r, outwardNormal);
+  }
+
+  AABB BoundingBox() const override { return bbox; }
+
+  int HitRange(const Ray& r, int first, int rangeCount, Interval& rayT) const
+  {
+    // Returns the closest sphere in [first, first + rangeCount) hit inside rayT, or -1, and
+    // shrinks rayT.max to its root
+
+    static const HitRangeKernel kernel = SelectKernel();
+    ENGINE_STAT(RenderStats::Thread().primitiveTests += rangeCount);
+    return kernel(*this, r, first, rangeCount, rayT);
+  }
+
+private:
+  typedef int (*HitRangeKernel)(const SphereSoA&, const Ray&, int, int, Interval&);
+
+  std::vector<Real> centerX, centerY, centerZ, radii;
+  std::vector<MaterialId> materialIds;
+  int count = 0;
+
+  BVHTree tree;
+  bool built = false;
+  AABB bbox;
+
+  void Resize(size_t sphereCount)
+  {
+    // Resizes the arrays to sphereCount spheres followed by the NaN padding
+    const Real nan = std::numeric_limits<Real>::quiet_NaN();
+    centerX.resize(sphereCount);
+    centerY.resize(sphereCount);
+    centerZ.resize(sphereCount);
+    radii.resize(sphereCount);
+    materialIds.resize(sphereCount);
+
+    centerX.resize(sphereCount + lanePadding, nan);
+    centerY.resize(sphereCount + lanePadding, nan);
+    centerZ.resize(sphereCount + lanePadding, nan);
+    radii.resize(sphereCount + lanePadding, nan);
+    materialIds.resize(sphereCount + lanePadding, 0);
+    count = int(sphereCount);
+  }
+
+  void PushPadding()
+  {
+    const Real nan = std::numeric_limits<Real>::quiet_NaN();
+    centerX.push_back(nan);
+    centerY.push_back(nan);
+    centerZ.push_back(nan);
+    radii.push_back(nan);
+    materialIds.push_back(0);
+  }
+
+  template <typename T>
+  void Permute(std::vector<T>& values, const std::vector<int>& order)
+  {
+    std::vector<T> permuted(values);
+    for (int i = 0; i < count; i++)
+    {
+      permuted[i] = values[order[i]];
+    }
+    values.swap(permuted);
+  }
+
+  static HitRangeKernel SelectKernel()
+  {
+#if ENGINE_SIMD_X86
+    switch (ActiveSimdLevel())
+    {
+      case SimdLevel::AVX512: return &HitRangeAVX512;
+      case SimdLevel::AVX2:   return &HitRangeAVX2;
+      case SimdLevel::SSE2:   return &HitRangeSSE2;
+      default:                break;
+    }
+#endif
+    return &HitRangeScalar;
+  }
+
+  static int HitRangeScalar(const SphereSoA& s, const Ray& r, int first, int rangeCount, Interval& rayT)
+  {
+    const Vec3& dir = r.Direction();
+    const Point3& orig = r.Origin();
+    auto a = dir.LengthSquared();
+    int closest = -1;
+
+    for (int i = first; i < first + rangeCount; i++)
+    {
+      auto ocX = s.centerX[i] - orig.X();
+      auto ocY = s.centerY[i] - orig.Y();
+      auto ocZ = s.centerZ[i] - orig.Z();
+      auto h = dir.X() * ocX + dir.Y() * ocY + dir.Z() * ocZ;
+      auto c = (ocX * ocX + ocY * ocY + ocZ * ocZ) - s.radii[i] * s.radii[i];
+
+      auto discriminant = h * h - a * c;
+      if (discriminant < 0)
+      {
+        continue;
+      }
+
+      auto sqrtd = std::sqrt(discriminant);
+      auto root = (h - sqrtd) / a;
+      if (!rayT.Surrounds(root))
+      {
+        root = (h + sqrtd) / a;
+        if (!rayT.Surrounds(root))
+        {
+          continue;
+        }
+      }
+
+      rayT.max = root;
+      closest = i;
+    }
+
+    return closest;
+  }
+
+  static int LaneMask(int remaining, int lanes)
+  {
+    // Lanes of the last vector that still fall inside the requested range
+    return (remaining >= lanes) ? (1 << lanes) - 1 : (1 << remaining) - 1;
+  }
+
+  static int PickClosest(const Real* roots, int mask, int base, int lanes, Interval& rayT)
+  {
+    // Scans the lanes that hit in order, so ties go to the lower index like the scalar loop
+    int closest = -1;
+    for (int lane = 0; lane < lanes; lane++)
+    {
+      if ((mask & (1 << lane)) && roots[lane] < rayT.max)
+      {
+        rayT.max = roots[lane];
+        closest = base + lane;
+      }
+    }
+    return closest;
+  }
+
+#if ENGINE_SIMD_X86 && ENGINE_USE_FLOAT
+  ENGINE_TARGET_SSE2
+  static int HitRangeSSE2(const SphereSoA& s, const Ray& r, int first, int rangeCount, Interval& rayT)
+  {
+    const Vec3& dir = r.Direction();
+    const Point3& orig = r.Origin();
+
+    const __m128 dirX = _mm_set1_ps(dir.X()), dirY = _mm_set1_ps(dir.Y()), dirZ = _mm_set1_ps(dir.Z());
+    const __m128 origX = _mm_set1_ps(orig.X()), origY = _mm_set1_ps(orig.Y()), origZ = _mm_set1_ps(orig.Z());
+    const __m128 a = _mm_set1_ps(dir.LengthSquared());
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 tMin = _mm_set1_ps(rayT.min);
+
+    alignas(16) float roots[4];
+    int closest = -1;
+
+    for (int i = first; i < first + rangeCount; i += 4)
+    {
+      __m128 ocX = _mm_sub_ps(_mm_loadu_ps(&s.centerX[i]), origX);
+      __m128 ocY = _mm_sub_ps(_mm_loadu_ps(&s.centerY[i]), origY);
+      __m128 ocZ = _mm_sub_ps(_mm_loadu_ps(&s.centerZ[i]), origZ);
+      __m128 radius = _mm_loadu_ps(&s.radii[i]);
+
+      __m128 h = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dirX, ocX), _mm_mul_ps(dirY, ocY)), _mm_mul_ps(dirZ, ocZ));
+      __m128 ocLenSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocX, ocX), _mm_mul_ps(ocY, ocY)), _mm_mul_ps(ocZ, ocZ));
+      __m128 c = _mm_sub_ps(ocLenSq, _mm_mul_ps(radius, radius));
+      __m128 discriminant = _mm_sub_ps(_mm_mul_ps(h, h), _mm_mul_ps(a, c));
+
+      __m128 valid = _mm_cmpge_ps(discriminant, zero);
+      if (_mm_movemask_ps(valid) == 0)
+      {
+        continue;
+      }
+
+      __m128 tMax = _mm_set1_ps(rayT.max);
+      __m128 sqrtd = _mm_sqrt_ps(discriminant);
+      __m128 nearRoot = _mm_div_ps(_mm_sub_ps(h, sqrtd), a);
+      __m128 farRoot = _mm_div_ps(_mm_add_ps(h, sqrtd), a);
+
+      __m128 nearOk = _mm_and_ps(valid, _mm_and_ps(_mm_cmplt_ps(tMin, nearRoot), _mm_cmplt_ps(nearRoot, tMax)));
+      __m128 farOk = _mm_and_ps(valid, _mm_and_ps(_mm_cmplt_ps(tMin, farRoot), _mm_cmplt_ps(farRoot, tMax)));
+
+      int mask = _mm_movemask_ps(_mm_or_ps(nearOk, farOk)) & LaneMask(first + rangeCount - i, 4);
+      if (mask == 0)
+      {
+        continue;
+      }
+
+      _mm_store_ps(roots, _mm_or_ps(_mm_and_ps(nearOk, nearRoot), _mm_andnot_ps(nearOk, farRoot)));
+      int index = PickClosest(roots, mask, i, 4, rayT);
+      closest = (index >= 0) ? index : closest;
+    }
+
+    return closest;
+  }
+
+  ENGINE_TARGET_AVX2
+  static int HitRangeAVX2(const SphereSoA& s, const Ray& r, int first, int rangeCount, Interval& rayT)
+  {
+    const Vec3& dir = r.Direction();
+    const Point3& orig = r.Origin();
+
+    const __m256 dirX = _mm256_set1_ps(dir.X()), dirY = _mm256_set1_ps(dir.Y()), dirZ = _mm256_set1_ps(dir.Z());
+    const __m256 origX = _mm256_set1_ps(orig.X()), origY = _mm256_set1_ps(orig.Y()), origZ = _mm256_set1_ps(orig.Z());
+    const __m256 a = _mm256_set1_ps(dir.LengthSquared());
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 tMin = _mm256_set1_ps(rayT.min);
+
+    alignas(32) float roots[8];
+    int closest = -1;
+
+    for (int i = first; i < first + rangeCount; i += 8)
+    {
+      __m256 ocX = _mm256_sub_ps(_mm256_loadu_ps(&s.centerX[i]), origX);
+      __m256 ocY = _mm256_sub_ps(_mm256_loadu_ps(&s.centerY[i]), origY);
+      __m256 ocZ = _mm256_sub_ps(_mm256_loadu_ps(&s.centerZ[i]), origZ);
+      __m256 radius = _mm256_loadu_ps(&s.radii[i]);
+
+      __m256 h = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dirX, ocX), _mm256_mul_ps(dirY, ocY)), _mm256_mul_ps(dirZ, ocZ));
+      __m256 ocLenSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocX, ocX), _mm256_mul_ps(ocY, ocY)), _mm256_mul_ps(ocZ, ocZ));
+      __m256 c = _mm256_sub_ps(ocLenSq, _mm256_mul_ps(radius, radius));
+      __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(h, h), _mm256_mul_ps(a, c));
+
+      __m256 valid = _mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ);
+      if (_mm256_movemask_ps(valid) == 0)
+      {
+        continue;
+      }
+
+      __m256 tMax = _mm256_set1_ps(rayT.max);
+      __m256 sqrtd = _mm256_sqrt_ps(discriminant);
+      __m256 nearRoot = _mm256_div_ps(_mm256_sub_ps(h, sqrtd), a);
+      __m256 farRoot = _mm256_div_ps(_mm256_add_ps(h, sqrtd), a);
+
+      __m256 nearOk = _mm256_and_ps(valid,
+        _mm256_and_ps(_mm256_cmp_ps(tMin, nearRoot, _CMP_LT_OQ), _mm256_cmp_ps(nearRoot, tMax, _CMP_LT_OQ)));
+      __m256 farOk = _mm256_and_ps(valid,
+        _mm256_and_ps(_mm256_cmp_ps(tMin, farRoot, _CMP_LT_OQ), _mm256_cmp_ps(farRoot, tMax, _CMP_LT_OQ)));
+
+      int mask = _mm256_movemask_ps(_mm256_or_ps(nearOk, farOk)) & LaneMask(first + rangeCount - i, 8);
+      if (mask == 0)
+      {
+        continue;
+      }
+
+      _mm256_store_ps(roots, _mm256_blendv_ps(farRoot, nearRoot, nearOk));
+      int index = PickClosest(roots, mask, i, 8, rayT);
+      closest = (index >= 0) ? index : closest;
+    }
+
+    return closest;
+  }
+
+  ENGINE_TARGET_AVX512
+  static int HitRangeAVX512(const SphereSoA& s, const Ray& r, int first, int rangeCount, Interval& rayT)
+  {
+    const Vec3& dir = r.Direction();
+    const Point3& orig = r.Origin();
+
+    const __m512 dirX = _mm512_set1_ps(dir.X()), dirY = _mm512_set1_ps(dir.Y()), dirZ = _mm512_set1_ps(dir.Z());
+    const __m512 origX = _mm512_set1_ps(orig.X()), origY = _mm512_set1_ps(orig.Y()), origZ = _mm512_set1_ps(orig.Z());
+    const __m512 a = _mm512_set1_ps(dir.LengthSquared());
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 tMin = _mm512_set1_ps(rayT.min);
+
+    alignas(64) float roots[16];
+    int closest = -1;
+
+    for (int i = first; i < first + rangeCount; i += 16)
+    {
+      __m512 ocX = _mm512_sub_ps(_mm512_loadu_ps(&s.centerX[i]), origX);
+      __m512 ocY = _mm512_sub_ps(_mm512_loadu_ps(&s.centerY[i]), origY);
+      __m512 ocZ = _mm512_sub_ps(_mm512_loadu_ps(&s.centerZ[i]), origZ);
+      __m512 radius = _mm512_loadu_ps(&s.radii[i]);
+
+      __m512 h = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dirX, ocX), _mm512_mul_ps(dirY, ocY)), _mm512_mul_ps(dirZ, ocZ));
+      __m512 ocLenSq = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ocX, ocX), _mm512_mul_ps(ocY, ocY)), _mm512_mul_ps(ocZ, ocZ));
+      __m512 c = _mm512_sub_ps(ocLenSq, _mm512_mul_ps(radius, radius));
+      __m512 discriminant = _mm512_sub_ps(_mm512_mul_ps(h, h), _mm512_mul_ps(a, c));
+
+      __mmask16 valid = _mm512_cmp_ps_mask(discriminant, zero, _CMP_GE_OQ);
+      if (valid == 0)
+      {
+        continue;
+      }
+
+      __m512 tMax = _mm512_set1_ps(rayT.max);
+      __m512 sqrtd = _mm512_sqrt_ps(discriminant);
+      __m512 nearRoot = _mm512_div_ps(_mm512_sub_ps(h, sqrtd), a);
+      __m512 farRoot = _mm512_div_ps(_mm512_add_ps(h, sqrtd), a);
+
+      __mmask16 nearOk = valid & _mm512_cmp_ps_mask(tMin, nearRoot, _CMP_LT_OQ) & _mm512_cmp_ps_mask(nearRoot, tMax, _CMP_LT_OQ);
+      __mmask16 farOk = valid & _mm512_cmp_ps_mask(tMin, farRoot, _CMP_LT_OQ) & _mm512_cmp_ps_mask(farRoot, tMax, _CMP_LT_OQ);
+
+      int mask = int(nearOk | farOk) & LaneMask(first + rangeCount - i, 16);
+      if (mask == 0)
+      {
+        continue;
+      }
+
+      _mm512_store_ps(roots, _mm512_mask_blend_ps(nearOk, farRoot, nearRoot));
+      int index = PickClosest(roots, mask, i, 16, rayT);
+      closest = (index >= 0) ? index : closest;
+    }
+
+    return closest;
+  }
+#elif ENGINE_SIMD_X86
+  ENGINE_TARGET_SSE2
+  static int HitRangeSSE2(const SphereSoA& s, const Ray& r, int first, int rangeCount, Interval& rayT)
+  {
+    const Vec3& dir = r.Direction();
+    const Point3& orig = r.Origin();
+
+    const __m128d dirX = _mm_set1_pd(dir.X()), dirY = _mm_set1_pd(dir.Y()), dirZ = _mm_set1_pd(dir.Z());
+    const __m128d origX = _mm_set1_pd(orig.X()), origY = _mm_set1_pd(orig.Y()), origZ = _mm_set1_pd(orig.Z());
+    const __m128d a = _mm_set1_pd(dir.LengthSquared());
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d tMin = _mm_set1_pd(rayT.min);
+
+    alignas(16) double roots[2];
+    int closest = -1;
+
+    for (int i = first; i < first + rangeCount; i += 2)
+    {
+      __m128d ocX = _mm_sub_pd(_mm_loadu_pd(&s.centerX[i]), origX);
+      __m128d ocY = _mm_sub_pd(_mm_loadu_pd(&s.centerY[i]), origY);
+      __m128d ocZ = _mm_sub_pd(_mm_loadu_pd(&s.centerZ[i]), origZ);
+      __m128d radius = _mm_loadu_pd(&s.radii[i]);
+
+      __m128d h = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dirX, ocX), _mm_mul_pd(dirY, ocY)), _mm_mul_pd(dirZ, ocZ));
+      __m128d ocLenSq = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocX, ocX), _mm_mul_pd(ocY, ocY)), _mm_mul_pd(ocZ, ocZ));
+      __m128d c = _mm_sub_pd(ocLenSq, _mm_mul_pd(radius, radius));
+      __m128d discriminant = _mm_sub_pd(_mm_mul_pd(h, h), _mm_mul_pd(a, c));
+
+      __m128d valid = _mm_cmpge_pd(discriminant, zero);
+      if (_mm_movemask_pd(valid) == 0)
+      {
+        continue;
+      }
+
+      __m128d tMax = _mm_set1_pd(rayT.max);
+      __m128d sqrtd = _mm_sqrt_pd(discriminant);
+      __m128d nearRoot = _mm_div_pd(_mm_sub_pd(h, sqrtd), a);
+      __m128d farRoot = _mm_div_pd(_mm_add_pd(h, sqrtd), a);
+
+      __m128d nearOk = _mm_and_pd(valid, _mm_and_pd(_mm_cmplt_pd(tMin, nearRoot), _mm_cmplt_pd(nearRoot, tMax)));
+      __m128d farOk = _mm_and_pd(valid, _mm_and_pd(_mm_cmplt_pd(tMin, farRoot), _mm_cmplt_pd(farRoot, tMax)));
+
+      int mask = _mm_movemask_pd(_mm_or_pd(nearOk, farOk)) & LaneMask(first + rangeCount - i, 2);
+      if (mask == 0)
+      {
+        continue;
+      }
+
+      _mm_store_pd(roots, _mm_or_pd(_mm_and_pd(nearOk, nearRoot), _mm_andnot_pd(nearOk, farRoot)));
+      int index = PickClosest(roots, mask, i, 2, rayT);
+      closest = (index >= 0) ? index : closest;
+    }
+
+    return closest;
+  }
+
+  ENGINE_TARGET_AVX2
+  static int HitRangeAVX2(const SphereSoA& s, const Ray& r, int first, int rangeCount, Interval& rayT)
+  {
+    const Vec3& dir = r.Direction();
+    const Point3& orig = r.Origin();
+
+    const __m256d dirX = _mm256_set1_pd(dir.X()), dirY = _mm256_set1_pd(dir.Y()), dirZ = _mm256_set1_pd(dir.Z());
+    const __m256d origX = _mm256_set1_pd(orig.X()), origY = _mm256_set1_pd(orig.Y()), origZ = _mm256_set1_pd(orig.Z());
+    const __m256d a = _mm256_set1_pd(dir.LengthSquared());
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d tMin = _mm256_set1_pd(rayT.min);
+
+    alignas(32) double roots[4];
+    int closest = -1;
+
+    for (int i = first; i < first + rangeCount; i += 4)
+    {
+      __m256d ocX = _mm256_sub_pd(_mm256_loadu_pd(&s.centerX[i]), origX);
+      __m256d ocY = _mm256_sub_pd(_mm256_loadu_pd(&s.centerY[i]), origY);
+      __m256d ocZ = _mm256_sub_pd(_mm256_loadu_pd(&s.centerZ[i]), origZ);
+      __m256d radius = _mm256_loadu_pd(&s.radii[i]);
+
+      __m256d h = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dirX, ocX), _mm256_mul_pd(dirY, ocY)), _mm256_mul_pd(dirZ, ocZ));
+      __m256d ocLenSq = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocX, ocX), _mm256_mul_pd(ocY, ocY)), _mm256_mul_pd(ocZ, ocZ));
+      __m256d c = _mm256_sub_pd(ocLenSq, _mm256_mul_pd(radius, radius));
+      __m256d discriminant = _mm256_sub_pd(_mm256_mul_pd(h, h), _mm256_mul_pd(a, c));
+
+      __m256d valid = _mm256_cmp_pd(discriminant, zero, _CMP_GE_OQ);
+      if (_mm256_movemask_pd(valid) == 0)
+      {
+        continue;
+      }
+
+      __m256d tMax = _mm256_set1_pd(rayT.max);
+      __m256d sqrtd = _mm256_sqrt_pd(discriminant);
+      __m256d nearRoot = _mm256_div_pd(_mm256_sub_pd(h, sqrtd), a);
+      __m256d farRoot = _mm256_div_pd(_mm256_add_pd(h, sqrtd), a);
+
+      __m256d nearOk = _mm256_and_pd(valid,
+        _mm256_and_pd(_mm256_cmp_pd(tMin, nearRoot, _CMP_LT_OQ), _mm256_cmp_pd(nearRoot, tMax, _CMP_LT_OQ)));
+      __m256d farOk = _mm256_and_pd(valid,
+        _mm256_and_pd(_mm256_cmp_pd(tMin, farRoot, _CMP_LT_OQ), _mm256_cmp_pd(farRoot, tMax, _CMP_LT_OQ)));
+
+      int mask = _mm256_movemask_pd(_mm256_or_pd(nearOk, farOk)) & LaneMask(first + rangeCount - i, 4);
+      if (mask == 0)
+      {
+        continue;
+      }
+
+      _mm256_store_pd(roots, _mm256_blendv_pd(farRoot, nearRoot, nearOk));
+      int index = PickClosest(roots, mask, i, 4, rayT);
+      closest = (index >= 0) ? index : closest;
+    }
+
+    return closest;
+  }
+
+  ENGINE_TARGET_AVX512
+  static int HitRangeAVX512(const SphereSoA& s, const Ray& r, int first, int rangeCount, Interval& rayT)
+  {
+    const Vec3& dir = r.Direction();
+    const Point3& orig = r.Origin();
+
+    const __m512d dirX = _mm512_set1_pd(dir.X()), dirY = _mm512_set1_pd(dir.Y()), dirZ = _mm512_set1_pd(dir.Z());
+    const __m512d origX = _mm512_set1_pd(orig.X()), origY = _mm512_set1_pd(orig.Y()), origZ = _mm512_set1_pd(orig.Z());
+    const __m512d a = _mm512_set1_pd(dir.LengthSquared());
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d tMin = _mm512_set1_pd(rayT.min);
+
+    alignas(64) double roots[8];
+    int closest = -1;
+
+    for (int i = first; i < first + rangeCount; i += 8)
+    {
+      __m512d ocX = _mm512_sub_pd(_mm512_loadu_pd(&s.centerX[i]), origX);
+      __m512d ocY = _mm512_sub_pd(_mm512_loadu_pd(&s.centerY[i]), origY);
+      __m512d ocZ = _mm512_sub_pd(_mm512_loadu_pd(&s.centerZ[i]), origZ);
+      __m512d radius = _mm512_loadu_pd(&s.radii[i]);
+
+      __m512d h = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dirX, ocX), _mm512_mul_pd(dirY, ocY)), _mm512_mul_pd(dirZ, ocZ));
+      __m512d ocLenSq = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocX, ocX), _mm512_mul_pd(ocY, ocY)), _mm512_mul_pd(ocZ, ocZ));
+      __m512d c = _mm512_sub_pd(ocLenSq, _mm512_mul_pd(radius, radius));
+      __m512d discriminant = _mm512_sub_pd(_mm512_mul_pd(h, h), _mm512_mul_pd(a, c));
+
+      __mmask8 valid = _mm512_cmp_pd_mask(discriminant, zero, _CMP_GE_OQ);
+      if (valid == 0)
+      {
+        continue;
+      }
+
+      __m512d tMax = _mm512_set1_pd(rayT.max);
+      __m512d sqrtd = _mm512_sqrt_pd(discriminant);
+      __m512d nearRoot = _mm512_div_pd(_mm512_sub_pd(h, sqrtd), a);
+      __m512d farRoot = _mm512_div_pd(_mm512_add_pd(h, sqrtd), a);
+
+      __mmask8 nearOk = valid & _mm512_cmp_pd_mask(tMin, nearRoot, _CMP_LT_OQ) & _mm512_cmp_pd_mask(nearRoot, tMax, _CMP_LT_OQ);
+      __mmask8 farOk = valid & _mm512_cmp_pd_mask(tMin, farRoot, _CMP_LT_OQ) & _mm512_cmp_pd_mask(farRoot, tMax, _CMP_LT_OQ);
+
+      int mask = int(nearOk | farOk) & LaneMask(first + rangeCount - i, 8);
+      if (mask == 0)
+      {
+        continue;
+      }
+
+      _mm512_store_pd(roots, _mm512_mask_blend_pd(nearOk, farRoot, nearRoot));
+      int index = PickClosest(roots, mask, i, 8, rayT);
+      closest = (index >= 0) ? index : closest;
+    }
+
+    return closest;
+  }
+#endif
+};
+
+#endif // SPHERE_SOA_H
\ No newline at end of file
@@ -0,0 +1,180 @@
+#pragma once
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+  // A thread count of 0 or less uses every hardware thread available
+  explicit ThreadPool(int threadCount = 0)
+  {
+    if (threadCount <= 0)
+    {
+      threadCount = int(std::thread::hardware_concurrency());
+    }
+    threadCount = (threadCount < 1) ? 1 : threadCount;
+
+    for (int i = 0; i < threadCount; i++)
+    {
+      queues.emplace_back(new WorkQueue());
+    }
+
+    for (int i = 0; i < threadCount; i++)
+    {
+      workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(stateMutex);
+      stopping = true;
+    }
+    wakeWorkers.notify_all();
+
+    for (auto& worker : workers)
+    {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int Size() const { return int(workers.size()); }
+
+  void ParallelFor(int taskCount, const std::function<void(int task, int worker)>& job)
+  {
+    // Runs job(task, worker) for every task in [0, taskCount) and blocks until all of them are
+    // done. Tasks are dealt out in contiguous blocks, one per worker, so neighbouring tiles stay
+    // on the same core; a worker that runs dry steals from the back of another worker's queue
+
+    if (taskCount <= 0)
+    {
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(stateMutex);
+
+    int workerCount = Size();
+    for (int w = 0; w < workerCount; w++)
+    {
+      int begin = int((long long)taskCount * w / workerCount);
+      int end = int((long long)taskCount * (w + 1) / workerCount);
+
+      std::lock_guard<std::mutex> queueLock(queues[w]->mutex);
+      for (int task = begin; task < end; task++)
+      {
+        queues[w]->tasks.push_back(task);
+      }
+    }
+
+    currentJob = &job;
+    activeWorkers = workerCount;
+    generation++;
+    wakeWorkers.notify_all();
+
+    roundDone.wait(lock, [this] { return activeWorkers == 0; });
+    currentJob = nullptr;
+  }
+
+private:
+  struct WorkQueue
+  {
+    std::mutex mutex;
+    std::deque<int> tasks;
+  };
+
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+  std::vector<std::thread> workers;
+
+  std::mutex stateMutex;
+  std::condition_variable wakeWorkers;
+  std::condition_variable roundDone;
+  const std::function<void(int, int)>* currentJob = nullptr;
+  unsigned long long generation = 0;
+  int activeWorkers = 0;
+  bool stopping = false;
+
+  bool PopOwn(int worker, int& task)
+  {
+    WorkQueue& queue = *queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if (queue.tasks.empty())
+    {
+      return false;
+    }
+
+    task = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+  }
+
+  bool Steal(int thief, int& task)
+  {
+    int workerCount = Size();
+    for (int offset = 1; offset < workerCount; offset++)
+    {
+      WorkQueue& queue = *queues[(thief + offset) % workerCount];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+
+      if (!queue.tasks.empty())
+      {
+        task = queue.tasks.back();
+        queue.tasks.pop_back();
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void WorkerLoop(int worker)
+  {
+    unsigned long long seenGeneration = 0;
+
+    while (true)
+    {
+      const std::function<void(int, int)>* job;
+      {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        wakeWorkers.wait(lock, [&] { return stopping || generation != seenGeneration; });
+
+        if (stopping)
+        {
+          return;
+        }
+
+        seenGeneration = generation;
+        job = currentJob;
+      }
+
+      // Tasks never spawn other tasks, so once every queue is empty this round is over
+      int task;
+      while (PopOwn(worker, task) || Steal(worker, task))
+      {
+        (*job)(task, worker);
+      }
+
+      std::lock_guard<std::mutex> lock(stateMutex);
+      if (--activeWorkers == 0)
+      {
+        roundDone.notify_one();
+      }
+    }
+  }
+};
+
+#endif // THREAD_POOL_H
\ No newline at end of file
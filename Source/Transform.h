@@ -0,0 +1,203 @@
+#pragma once
+
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <cmath>
+#include "AABB.h"
+#include "Vec3.h"
+
+class Transform
+{
+  // Affine transform, stored as the top three rows of a 4x4 matrix: a linear part in the
+  // first three columns and a translation in the last
+
+public:
+  Transform()
+  {
+    for (int row = 0; row < 3; row++)
+    {
+      for (int col = 0; col < 4; col++)
+      {
+        m[row][col] = (row == col) ? 1 : 0;
+      }
+    }
+  }
+
+  static Transform Translate(const Vec3& offset)
+  {
+    Transform t;
+    t.m[0][3] = offset.X();
+    t.m[1][3] = offset.Y();
+    t.m[2][3] = offset.Z();
+    return t;
+  }
+
+  static Transform Scale(const Vec3& factors)
+  {
+    Transform t;
+    t.m[0][0] = factors.X();
+    t.m[1][1] = factors.Y();
+    t.m[2][2] = factors.Z();
+    return t;
+  }
+
+  static Transform Scale(Real factor)
+  {
+    return Scale(Vec3(factor, factor, factor));
+  }
+
+  static Transform Rotate(double degrees, const Vec3& axis)
+  {
+    // Rotation around axis through the origin, counterclockwise when looking down the axis
+    Vec3 a = Normalized(axis);
+    double s = std::sin(DegToRad(degrees));
+    double c = std::cos(DegToRad(degrees));
+    double x = a.X(), y = a.Y(), z = a.Z();
+
+    Transform t;
+    t.m[0][0] = Real(x * x + (1 - x * x) * c);
+    t.m[0][1] = Real(x * y * (1 - c) - z * s);
+    t.m[0][2] = Real(x * z * (1 - c) + y * s);
+    t.m[1][0] = Real(x * y * (1 - c) + z * s);
+    t.m[1][1] = Real(y * y + (1 - y * y) * c);
+    t.m[1][2] = Real(y * z * (1 - c) - x * s);
+    t.m[2][0] = Real(x * z * (1 - c) - y * s);
+    t.m[2][1] = Real(y * z * (1 - c) + x * s);
+    t.m[2][2] = Real(z * z + (1 - z * z) * c);
+    return t;
+  }
+
+  Transform operator*(const Transform& t) const
+  {
+    // Applies t first, then this transform
+    Transform result;
+    for (int row = 0; row < 3; row++)
+    {
+      for (int col = 0; col < 4; col++)
+      {
+        Real sum = (col == 3) ? m[row][3] : 0;
+        for (int k = 0; k < 3; k++)
+        {
+          sum += m[row][k] * t.m[k][col];
+        }
+        result.m[row][col] = sum;
+      }
+    }
+    return result;
+  }
+
+  Transform Inverse() const
+  {
+    // Inverts the linear part by its adjugate, in double, then moves the translation through
+    // it. Singular transforms have no inverse and give the identity
+    double a[3][3];
+    for (int row = 0; row < 3; row++)
+    {
+      for (int col = 0; col < 3; col++)
+      {
+        a[row][col] = m[row][col];
+      }
+    }
+
+    double cofactor[3][3];
+    for (int row = 0; row < 3; row++)
+    {
+      for (int col = 0; col < 3; col++)
+      {
+        int r0 = (row + 1) % 3, r1 = (row + 2) % 3;
+        int c0 = (col + 1) % 3, c1 = (col + 2) % 3;
+        cofactor[row][col] = a[r0][c0] * a[r1][c1] - a[r0][c1] * a[r1][c0];
+      }
+    }
+
+    double det = a[0][0] * cofactor[0][0] + a[0][1] * cofactor[0][1] + a[0][2] * cofactor[0][2];
+    if (det == 0)
+    {
+      return Transform();
+    }
+
+    Transform inverse;
+    for (int row = 0; row < 3; row++)
+    {
+      double translation = 0;
+      for (int col = 0; col < 3; col++)
+      {
+        double value = cofactor[col][row] / det;
+        inverse.m[row][col] = Real(value);
+        translation -= value * m[col][3];
+      }
+      inverse.m[row][3] = Real(translation);
+    }
+    return inverse;
+  }
+
+  Point3 ApplyPoint(const Point3& p) const
+  {
+    return Point3(
+      m[0][0] * p.X() + m[0][1] * p.Y() + m[0][2] * p.Z() + m[0][3],
+      m[1][0] * p.X() + m[1][1] * p.Y() + m[1][2] * p.Z() + m[1][3],
+      m[2][0] * p.X() + m[2][1] * p.Y() + m[2][2] * p.Z() + m[2][3]);
+  }
+
+  Vec3 ApplyVector(const Vec3& v) const
+  {
+    return Vec3(
+      m[0][0] * v.X() + m[0][1] * v.Y() + m[0][2] * v.Z(),
+      m[1][0] * v.X() + m[1][1] * v.Y() + m[1][2] * v.Z(),
+      m[2][0] * v.X() + m[2][1] * v.Y() + m[2][2] * v.Z());
+  }
+
+  Vec3 ApplyTransposed(const Vec3& v) const
+  {
+    // Multiplies by the transpose of the linear part. Called on the inverse of a transform,
+    // this maps normals through the transform
+    return Vec3(
+      m[0][0] * v.X() + m[1][0] * v.Y() + m[2][0] * v.Z(),
+      m[0][1] * v.X() + m[1][1] * v.Y() + m[2][1] * v.Z(),
+      m[0][2] * v.X() + m[1][2] * v.Y() + m[2][2] * v.Z());
+  }
+
+  Ray ApplyRay(const Ray& r) const
+  {
+    // The direction is not renormalized, so hit distances are the same on both sides
+    return Ray(ApplyPoint(r.Origin()), ApplyVector(r.Direction()));
+  }
+
+  AABB ApplyBox(const AABB& box) const
+  {
+    // Box around the eight transformed corners
+    if (box.IsEmpty())
+    {
+      return box;
+    }
+
+    AABB result;
+    for (int corner = 0; corner < 8; corner++)
+    {
+      Point3 p((corner & 1) ? box.x.max : box.x.min,
+               (corner & 2) ? box.y.max : box.y.min,
+               (corner & 4) ? box.z.max : box.z.min);
+      Point3 q = ApplyPoint(p);
+      result = AABB(result, AABB(q, q));
+    }
+    return result;
+  }
+
+  Real MaxStretch() const
+  {
+    // Largest factor the linear part can lengthen a vector by in any coordinate, its
+    // infinity norm, used to carry error bounds through the transform
+    Real stretch = 0;
+    for (int row = 0; row < 3; row++)
+    {
+      stretch = std::fmax(stretch, std::fabs(m[row][0]) + std::fabs(m[row][1]) + std::fabs(m[row][2]));
+    }
+    return stretch;
+  }
+
+private:
+  Real m[3][4];
+};
+
+#endif // TRANSFORM_H
\ No newline at end of file
@@ -0,0 +1,281 @@
+#pragma once
+
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "BVH.h"
+#include "Hittable.h"
+
+class TriangleMesh : public Hittable
+{
+  // Indexed triangle mesh with one material. Vertices are shared between triangles and stored
+  // as float, triangles are three vertex indices, so a mesh costs little more than its raw
+  // buffers. Build gives the mesh its own BVH and reorders the triangles to match, so a leaf
+  // is a contiguous run of the index buffer
+
+public:
+  typedef Vec3T<float> Vertex;
+
+  // Leaves are kept large: a triangle test is cheaper than fetching a node, and with compact
+  // nodes it keeps the BVH to about a third of the size of the index buffer
+  static const int maxLeafSize = 32;
+  static const int minLeafSize = 16;
+
+  explicit TriangleMesh(MaterialId material = 0) : material(material) {}
+
+  void Reserve(size_t vertexCount, size_t triangleCount)
+  {
+    vertices.reserve(vertexCount);
+    indices.reserve(3 * triangleCount);
+  }
+
+  uint32_t AddVertex(const Vertex& v)
+  {
+    vertices.push_back(v);
+    return uint32_t(vertices.size() - 1);
+  }
+
+  void AddTriangle(uint32_t i0, uint32_t i1, uint32_t i2)
+  {
+    indices.push_back(i0);
+    indices.push_back(i1);
+    indices.push_back(i2);
+    built = false;
+  }
+
+  // Direct access to the buffers, for loaders that fill them in bulk. Every index must name
+  // an existing vertex before Build is called
+  std::vector<Vertex>& Vertices()   { return vertices; }
+  std::vector<uint32_t>& Indices()  { return indices; }
+
+  size_t VertexCount() const   { return vertices.size(); }
+  size_t TriangleCount() const { return indices.size() / 3; }
+
+  size_t MemoryBytes() const
+  {
+    return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(uint32_t)
+         + nodes.capacity() * sizeof(CompactBVHNode);
+  }
+
+  void Build()
+  {
+    size_t triangleCount = TriangleCount();
+    BVHTree tree;
+    tree.Build(int(triangleCount), [&](int i)
+    {
+      Point3 p0, p1, p2;
+      TriangleVertices(i, p0, p1, p2);
+      return AABB(AABB(p0, p1), AABB(p2, p2));
+    }, maxLeafSize, minLeafSize);
+
+    std::vector<uint32_t> permuted(indices.size());
+    for (size_t i = 0; i < triangleCount; i++)
+    {
+      size_t source = size_t(tree.order[i]);
+      permuted[3 * i + 0] = indices[3 * source + 0];
+      permuted[3 * i + 1] = indices[3 * source + 1];
+      permuted[3 * i + 2] = indices[3 * source + 2];
+    }
+    indices.swap(permuted);
+
+    // Only the compact copy of the nodes is kept
+    std::vector<CompactBVHNode>(tree.nodes.begin(), tree.nodes.end()).swap(nodes);
+    bbox = tree.nodes.empty() ? AABB::empty : tree.nodes[0].box;
+    built = true;
+  }
+
+  bool Hit(const Ray& r, Interval rayT, HitRecord& rec) const override
+  {
+    if (!built)
+    {
+      return false;
+    }
+
+    RayShear shear(r);
+    int closest = -1;
+    Real closestT = 0;
+
+    TraverseBVH(nodes, r, rayT, [&](int first, int count, Interval& t)
+    {
+      bool hitAnything = false;
+
+      for (int i = first; i < first + count; i++)
+      {
+        ENGINE_STAT(RenderStats::Thread().primitiveTests++);
+
+        Real hitT, b0, b1, b2;
+        if (Intersect(r, shear, i, t, hitT, b0, b1, b2))
+        {
+          hitAnything = true;
+          closest = i;
+          closestT = hitT;
+          t.max = hitT;
+        }
+      }
+
+      return hitAnything;
+    });
+
+    if (closest < 0)
+    {
+      return false;
+    }
+
+    rec.t = closestT;
+    rec.object = this;
+    rec.primitive = closest;
+    rec.material = material;
+
+    return true;
+  }
+
+  void CompleteHit(const Ray& r, HitRecord& rec) const override
+  {
+    // The point is rebuilt from the barycentric coordinates rather than r.At(t), so its error
+    // only depends on the triangle
+    Point3 p0, p1, p2;
+    TriangleVertices(rec.primitive, p0, p1, p2);
+
+    Real t, b0, b1, b2;
+    if (!Intersect(r, RayShear(r), rec.primitive, Interval::universe, t, b0, b1, b2))
+    {
+      b0 = b1 = b2 = Real(1) / 3;
+    }
+
+    rec.p = b0 * p0 + b1 * p1 + b2 * p2;
+
+    Vec3 pAbsSum = Abs(b0 * p0) + Abs(b1 * p1) + Abs(b2 * p2);
+    rec.pError = PointError(pAbsSum.X() + pAbsSum.Y() + pAbsSum.Z());
+
+    // Degenerate triangles never hit, so the cross product has a length
+    rec.SetFaceNormal(r, Normalized(Cross(p1 - p0, p2 - p0)));
+  }
+
+  AABB BoundingBox() const override { return bbox; }
+
+private:
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  MaterialId material;
+
+  std::vector<CompactBVHNode> nodes;
+  bool built = false;
+  AABB bbox;
+
+  struct RayShear
+  {
+    // Per-ray setup of the watertight test: the axis the ray mostly travels along becomes z,
+    // and a shear maps the ray onto the +z axis through the origin
+
+    int kx, ky, kz;
+    Real sx, sy, sz;
+
+    explicit RayShear(const Ray& r)
+    {
+      const Vec3& d = r.Direction();
+      Vec3 a = Abs(d);
+      kz = (a.X() > a.Y()) ? (a.X() > a.Z() ? 0 : 2) : (a.Y() > a.Z() ? 1 : 2);
+      kx = (kz + 1) % 3;
+      ky = (kx + 1) % 3;
+
+      // Keep the winding of the triangle when the ray points down its main axis
+      if (d[kz] < 0)
+      {
+        std::swap(kx, ky);
+      }
+
+      sx = -d[kx] / d[kz];
+      sy = -d[ky] / d[kz];
+      sz = 1 / d[kz];
+    }
+  };
+
+  static Vec3 Abs(const Vec3& v)
+  {
+    return Vec3(std::fabs(v.X()), std::fabs(v.Y()), std::fabs(v.Z()));
+  }
+
+  void TriangleVertices(int triangle, Point3& p0, Point3& p1, Point3& p2) const
+  {
+    const uint32_t* index = &indices[3 * size_t(triangle)];
+    p0 = Point3(vertices[index[0]]);
+    p1 = Point3(vertices[index[1]]);
+    p2 = Point3(vertices[index[2]]);
+  }
+
+  bool Intersect(
+      const Ray& r,
+      const RayShear& shear,
+      int triangle,
+      const Interval& rayT,
+      Real& t,
+      Real& b0,
+      Real& b1,
+      Real& b2) const
+  {
+    // Watertight ray-triangle test of Woop, Benthin and Wald: the vertices are moved into the
+    // ray's sheared space, where the edge functions decide inside and outside consistently
+    // for triangles sharing an edge, so rays never slip through the seams of a mesh
+
+    Point3 p0, p1, p2;
+    TriangleVertices(triangle, p0, p1, p2);
+
+    const Point3& o = r.Origin();
+    Vec3 a = p0 - o;
+    Vec3 b = p1 - o;
+    Vec3 c = p2 - o;
+
+    int kx = shear.kx, ky = shear.ky, kz = shear.kz;
+    Real ax = a[kx] + shear.sx * a[kz];
+    Real ay = a[ky] + shear.sy * a[kz];
+    Real bx = b[kx] + shear.sx * b[kz];
+    Real by = b[ky] + shear.sy * b[kz];
+    Real cx = c[kx] + shear.sx * c[kz];
+    Real cy = c[ky] + shear.sy * c[kz];
+
+    Real e0 = cx * by - cy * bx;
+    Real e1 = ax * cy - ay * cx;
+    Real e2 = bx * ay - by * ax;
+
+    // An edge function of exactly zero means the ray passes through the edge. Float builds
+    // redo the edge functions in double there, so the neighbouring triangles agree on it
+    if (sizeof(Real) < sizeof(double) && (e0 == 0 || e1 == 0 || e2 == 0))
+    {
+      e0 = Real(double(cx) * double(by) - double(cy) * double(bx));
+      e1 = Real(double(ax) * double(cy) - double(ay) * double(cx));
+      e2 = Real(double(bx) * double(ay) - double(by) * double(ax));
+    }
+
+    if ((e0 < 0 || e1 < 0 || e2 < 0) && (e0 > 0 || e1 > 0 || e2 > 0))
+    {
+      return false;
+    }
+
+    Real det = e0 + e1 + e2;
+    if (det == 0)
+    {
+      return false;
+    }
+
+    Real az = shear.sz * a[kz];
+    Real bz = shear.sz * b[kz];
+    Real cz = shear.sz * c[kz];
+    Real root = (e0 * az + e1 * bz + e2 * cz) / det;
+
+    if (!rayT.Surrounds(root))
+    {
+      return false;
+    }
+
+    t = root;
+    b0 = e0 / det;
+    b1 = e1 / det;
+    b2 = e2 / det;
+    return true;
+  }
+};
+
+#endif // TRIANGLE_MESH_H
\ No newline at end of file
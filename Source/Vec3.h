@@ -5,24 +5,34 @@
 
 #include <cmath>
 #include <iostream>
+#include <limits>
 
-class Vec3
+template <typename T>
+class Vec3T
 {
+  // Three component vector over the scalar type T. The engine uses it through the Vec3 alias,
+  // whose scalar is Real
+
 public:
-  double e[3];
+  typedef T Scalar;
+
+  T e[3];
 
-  Vec3() : e{0,0,0} {}
-  Vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
+  Vec3T() : e{0,0,0} {}
+  Vec3T(T e0, T e1, T e2) : e{e0, e1, e2} {}
 
-  double X() const { return e[0]; }
-  double Y() const { return e[1]; }
-  double Z() const { return e[2]; }
+  template <typename U>
+  explicit Vec3T(const Vec3T<U>& v) : e{T(v.e[0]), T(v.e[1]), T(v.e[2])} {}
 
-  Vec3 operator-() const { return Vec3(-e[0], -e[1], -e[2]); }
-  double operator[](int i) const { return e[i]; }
-  double& operator[](int i) { return e[i]; }
+  T X() const { return e[0]; }
+  T Y() const { return e[1]; }
+  T Z() const { return e[2]; }
 
-  Vec3& operator+=(const Vec3& v)
+  Vec3T operator-() const { return Vec3T(-e[0], -e[1], -e[2]); }
+  T operator[](int i) const { return e[i]; }
+  T& operator[](int i) { return e[i]; }
+
+  Vec3T& operator+=(const Vec3T& v)
   {
     e[0] += v.e[0];
     e[1] += v.e[1];
@@ -30,7 +40,7 @@ public:
     return *this;
   }
 
-  Vec3& operator*=(double t)
+  Vec3T& operator*=(T t)
   {
     e[0] *= t;
     e[1] *= t;
@@ -38,17 +48,17 @@ public:
     return *this;
   }
 
-  Vec3& operator/=(double t)
+  Vec3T& operator/=(T t)
   {
     return *this *= 1 / t;
   }
 
-  double Length() const
+  T Length() const
   {
     return std::sqrt(LengthSquared());
   }
 
-  double LengthSquared() const
+  T LengthSquared() const
   {
     return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
   }
@@ -56,138 +66,109 @@ public:
   bool NearZero() const
   {
     // Return true if the vector is close to zero in all dimensions
-    auto s = 1e-8;
+    const T s = T(1e-8);
     return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
   }
 
-  static Vec3 Random()
+  static Vec3T Random(Rng& rng)
   {
-    return Vec3(RandomDouble(), RandomDouble(), RandomDouble());
+    return Vec3T(T(RandomDouble(rng)), T(RandomDouble(rng)), T(RandomDouble(rng)));
   }
 
-  static Vec3 Random(double min, double max)
+  static Vec3T Random(double min, double max, Rng& rng)
   {
-    return Vec3(RandomDouble(min, max), RandomDouble(min, max), RandomDouble(min, max));
+    return Vec3T(T(RandomDouble(min, max, rng)), T(RandomDouble(min, max, rng)), T(RandomDouble(min, max, rng)));
   }
 
 };
 
+using Vec3 = Vec3T<Real>;
+
 // Point3 is just an alias for vec3, but useful for geometric clarity in the code
 using Point3 = Vec3;
 
 
 // Vector Utility Functions
+//
+// Scalar parameters are spelled typename Vec3T<T>::Scalar so that only the vector arguments
+// decide T, and literals such as 2 or 0.5 convert to it
 
-inline std::ostream& operator<<(std::ostream& out, const Vec3& v)
+template <typename T>
+inline std::ostream& operator<<(std::ostream& out, const Vec3T<T>& v)
 {
   return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
-inline Vec3 operator+(const Vec3& u, const Vec3& v)
+template <typename T>
+inline Vec3T<T> operator+(const Vec3T<T>& u, const Vec3T<T>& v)
 {
-  return Vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+  return Vec3T<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 }
 
-inline Vec3 operator-(const Vec3& u, const Vec3& v)
+template <typename T>
+inline Vec3T<T> operator-(const Vec3T<T>& u, const Vec3T<T>& v)
 {
-  return Vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+  return Vec3T<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
 }
 
-inline Vec3 operator*(const Vec3& u, const Vec3& v)
+template <typename T>
+inline Vec3T<T> operator*(const Vec3T<T>& u, const Vec3T<T>& v)
 {
-  return Vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+  return Vec3T<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-inline Vec3 operator*(double t, const Vec3& v)
+template <typename T>
+inline Vec3T<T> operator*(typename Vec3T<T>::Scalar t, const Vec3T<T>& v)
 {
-  return Vec3(t*v.e[0], t*v.e[1], t*v.e[2]);
+  return Vec3T<T>(t*v.e[0], t*v.e[1], t*v.e[2]);
 }
 
-inline Vec3 operator*(const Vec3& v, double t)
+template <typename T>
+inline Vec3T<T> operator*(const Vec3T<T>& v, typename Vec3T<T>::Scalar t)
 {
   return t * v;
 }
 
-inline Vec3 operator/(const Vec3& v, double t)
+template <typename T>
+inline Vec3T<T> operator/(const Vec3T<T>& v, typename Vec3T<T>::Scalar t)
 {
   return (1 / t) * v;
 }
 
-inline double Dot(const Vec3& u, const Vec3& v)
+template <typename T>
+inline T Dot(const Vec3T<T>& u, const Vec3T<T>& v)
 {
   return u.e[0] * v.e[0]
        + u.e[1] * v.e[1]
        + u.e[2] * v.e[2];
 }
 
-inline Vec3 Cross(const Vec3& u, const Vec3& v)
+template <typename T>
+inline Vec3T<T> Cross(const Vec3T<T>& u, const Vec3T<T>& v)
 {
-  return Vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
-              u.e[2] * v.e[0] - u.e[0] * v.e[2],
-              u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+  return Vec3T<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+                  u.e[2] * v.e[0] - u.e[0] * v.e[2],
+                  u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
 
-inline Vec3 Normalized(const Vec3& v)
+template <typename T>
+inline Vec3T<T> Normalized(const Vec3T<T>& v)
 {
   return v / v.Length();
 }
 
-inline Vec3 RandomNormalized2DVector()
-{
-  while (true)
-  {
-    auto p = Vec3(RandomDouble(-1, 1), RandomDouble(-1, 1), 0);
-
-    if (p.LengthSquared() < 1)
-    {
-      return p;
-    }
-  }
-}
-
-inline Vec3 RandomNormalizedVector()
-{
-  while (true)
-  {
-    auto p = Vec3::Random(-1, 1);
-    auto lenSq = p.LengthSquared();
-
-    if (1e-160 < lenSq && lenSq <= 1)
-    {
-      return p / sqrt(lenSq);
-    }
-  }
-}
-
-inline Vec3 RandomOnHemisphere(const Vec3& normal)
-{
-  Vec3 onUnitSphere = RandomNormalizedVector();
-
-  if (Dot(onUnitSphere, normal) > 0.0) // In the same hemisphere as the normal
-  {
-    return onUnitSphere;
-  }
-  else
-  {
-    return -onUnitSphere;
-  }
-}
-
-inline Vec3 LambertianSphere(const Vec3& normal)
-{
-  return normal + RandomNormalizedVector(); // P + normal + random - P
-}
-
-inline Vec3 Reflect(const Vec3& vector, const Vec3& normal)
+template <typename T>
+inline Vec3T<T> Reflect(const Vec3T<T>& vector, const Vec3T<T>& normal)
 {
   return vector - 2 * Dot(vector, normal) * normal;
 }
 
-inline Vec3 Refract(const Vec3& normalizedVector, const Vec3& normal, double etaOverEtaPrime)
+template <typename T>
+inline Vec3T<T> Refract(const Vec3T<T>& normalizedVector, const Vec3T<T>& normal, typename Vec3T<T>::Scalar etaOverEtaPrime)
 {
-  auto cosTheta = std::fmin(Dot(-normalizedVector, normal), 1.0);
-  Vec3 rOutPerp =  etaOverEtaPrime * (normalizedVector + cosTheta * normal);
-  Vec3 rOutParallel = -std::sqrt(std::fabs(1.0 - rOutPerp.LengthSquared())) * normal;
+  auto cosTheta = std::fmin(Dot(-normalizedVector, normal), T(1));
+  Vec3T<T> rOutPerp =  etaOverEtaPrime * (normalizedVector + cosTheta * normal);
+  Vec3T<T> rOutParallel = -std::sqrt(std::fabs(1 - rOutPerp.LengthSquared())) * normal;
   return rOutPerp + rOutParallel;
 }
 
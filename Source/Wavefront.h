@@ -0,0 +1,101 @@
+#pragma once
+
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "AABB.h"
+#include "Features.h"
+#include "Hittable.h"
+#include "Material.h"
+#include "Sampler.h"
+
+// State for the wavefront integrator. Instead of following one sample through every bounce,
+// it moves a whole wave of paths through one stage at a time: intersect everything, bin the
+// hits by material type, run one scatter kernel per bin, then compact the surviving paths into
+// the next wave. Each stage loops over a flat array doing one kind of work
+
+struct WavefrontPath
+{
+  Ray     ray;
+  Color   throughput;
+  double  scatterPdf;    // Density ray was scattered with, 0 when that bounce sampled no light
+  Sampler sampler;       // Owned by the path, so draws happen in the same order as in RayColor
+  bool    findFeatures;  // Still looking for the features of its sample, see Camera::RecordFeatures
+  int     sample;        // Slot of this path in the wave's result array
+  int     bounce;
+};
+
+class WavefrontQueues
+{
+  // Per-worker wave buffers, reused from tile to tile so a render allocates them only once
+
+public:
+  static const int materialTypeCount = 4;
+
+  std::vector<WavefrontPath> paths;      // Live paths of the current bounce
+  std::vector<WavefrontPath> nextPaths;  // Survivors, compacted for the next bounce
+  std::vector<HitRecord> hits;           // Closest hit of every live path
+  std::vector<int> bins[materialTypeCount];  // Live paths that hit each material type
+  std::vector<Color> results;            // Final color of every sample in the wave
+  std::vector<SampleFeatures> features;  // First-hit features of every sample, when gathered
+  std::vector<uint64_t> samplePixels;    // Pixel index of every sample in the wave
+  std::vector<int> sampleIndices;        // Sample number of every sample in the wave
+  DirectionBatch directions;             // Scatter directions of the diffuse bin
+
+  void SortPaths(const AABB& bounds)
+  {
+    // Reorders the live paths so rays with similar direction and origin are traced next to
+    // each other. The key is the direction octant followed by the Morton code of the origin
+    // quantized inside the scene bounds
+
+    std::vector<std::pair<uint32_t, int>> keys(paths.size());
+    for (size_t p = 0; p < paths.size(); p++)
+    {
+      keys[p] = std::make_pair(SortKey(paths[p].ray, bounds), int(p));
+    }
+    std::sort(keys.begin(), keys.end());
+
+    nextPaths.resize(paths.size());
+    for (size_t p = 0; p < keys.size(); p++)
+    {
+      nextPaths[p] = paths[keys[p].second];
+    }
+    paths.swap(nextPaths);
+    nextPaths.clear();
+  }
+
+private:
+  static uint32_t SortKey(const Ray& r, const AABB& bounds)
+  {
+    const Vec3& dir = r.Direction();
+    uint32_t octant = (dir.X() < 0 ? 1u : 0u) | (dir.Y() < 0 ? 2u : 0u) | (dir.Z() < 0 ? 4u : 0u);
+
+    uint32_t morton = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+      const Interval& extent = bounds.AxisInterval(axis);
+      double relative = (extent.Size() > 0) ? (r.Origin()[axis] - extent.min) / extent.Size() : 0;
+      uint32_t cell = uint32_t(std::min(std::max(relative, 0.0), 1.0) * 511.0);
+      morton |= SpreadBits(cell) << axis;
+    }
+
+    return (octant << 27) | morton;
+  }
+
+  static uint32_t SpreadBits(uint32_t v)
+  {
+    // Spreads the low 9 bits of v so there are two zero bits between each of them
+    uint32_t spread = 0;
+    for (int bit = 0; bit < 9; bit++)
+    {
+      spread |= ((v >> bit) & 1u) << (3 * bit);
+    }
+    return spread;
+  }
+};
+
+#endif // WAVEFRONT_H
\ No newline at end of file